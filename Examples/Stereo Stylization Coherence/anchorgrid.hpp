@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Voronoi anchor points. Image positions are interleaved, as uploaded for instanced drawing; world positions are
+// stored as separate x, y and z arrays so they can be transformed several anchors at a time.
+struct AnchorArrays {
+    std::vector<float> offsets;   // Image position (x, 1 - y) of each anchor.
+    std::vector<float> x, y, z;   // World position of each anchor. Empty until world positions have been computed.
+
+    size_t size() const {
+        return offsets.size() / 2;
+    }
+
+    bool hasWorldPositions() const {
+        return !x.empty();
+    }
+
+    void push(float imageX, float imageY, const float worldPos[3]) {
+        offsets.push_back(imageX);
+        offsets.push_back(1.0f - imageY);
+        x.push_back(worldPos[0]);
+        y.push_back(worldPos[1]);
+        z.push_back(worldPos[2]);
+    }
+
+    // Copy anchor from to index to.
+    void move(size_t from, size_t to) {
+        offsets[to * 2 + 0] = offsets[from * 2 + 0];
+        offsets[to * 2 + 1] = offsets[from * 2 + 1];
+        if (hasWorldPositions()) {
+            x[to] = x[from];
+            y[to] = y[from];
+            z[to] = z[from];
+        }
+    }
+
+    void resize(size_t count) {
+        offsets.resize(count * 2);
+        if (hasWorldPositions()) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+        }
+    }
+};
+
+// Buckets Voronoi anchor points by the m x n grid cell they lie in, so that the anchors of a cell can be found
+// and removed without scanning every anchor. Removal keeps the anchor arrays dense by moving the last anchor
+// into the freed index.
+class AnchorGrid {
+private:
+    size_t m, n;
+    std::vector<std::vector<uint32_t> > cells; // Anchor indices in each cell.
+    std::vector<uint32_t> anchorCells;          // Cell of each anchor.
+    std::vector<uint32_t> anchorSlots;          // Position of each anchor in its cell's list.
+
+    size_t cellOf(float x, float y) const {
+        size_t j = size_t(x * float(m));
+        size_t i = size_t(y * float(n));
+        if (j >= m) j = m - 1;
+        if (i >= n) i = n - 1;
+        return i * m + j;
+    }
+
+public:
+    AnchorGrid() : m(0), n(0) {}
+
+    // Empty the grid and size it to m x n cells.
+    void reset(size_t m_, size_t n_) {
+        m = m_;
+        n = n_;
+        cells.assign(m * n, std::vector<uint32_t>());
+        anchorCells.clear();
+        anchorSlots.clear();
+    }
+
+    // Index all anchors in offsets, e.g. after the offsets have been recomputed wholesale.
+    void rebuild(const std::vector<float>& offsets) {
+        for (size_t c = 0; c < cells.size(); c++) cells[c].clear();
+        anchorCells.clear();
+        anchorSlots.clear();
+        for (size_t k = 0; k < offsets.size() / 2; k++) insert(offsets[k * 2 + 0], 1.0f - offsets[k * 2 + 1]);
+    }
+
+    // Index the anchor just appended to the caller's arrays, at image position (x, y) in [0, 1).
+    void insert(float x, float y) {
+        const size_t c = cellOf(x, y);
+        anchorCells.push_back(uint32_t(c));
+        anchorSlots.push_back(uint32_t(cells[c].size()));
+        cells[c].push_back(uint32_t(anchorCells.size() - 1));
+    }
+
+    // Remove anchor k from the grid and from anchors. The last anchor takes index k.
+    void remove(size_t k, AnchorArrays& anchors) {
+        const size_t last = anchorCells.size() - 1;
+
+        // Swap-remove from the cell's list.
+        std::vector<uint32_t>& cell = cells[anchorCells[k]];
+        const uint32_t slot = anchorSlots[k];
+        cell[slot] = cell.back();
+        anchorSlots[cell[slot]] = slot;
+        cell.pop_back();
+
+        // Swap-remove from the anchor arrays.
+        if (k != last) {
+            cells[anchorCells[last]][anchorSlots[last]] = uint32_t(k);
+            anchorCells[k] = anchorCells[last];
+            anchorSlots[k] = anchorSlots[last];
+            anchors.move(last, k);
+        }
+        anchorCells.pop_back();
+        anchorSlots.pop_back();
+        anchors.resize(last);
+    }
+
+    // Remove all anchors in cell (i, j).
+    void removeCell(size_t i, size_t j, AnchorArrays& anchors) {
+        const std::vector<uint32_t>& cell = cells[i * m + j];
+        while (!cell.empty()) remove(cell.back(), anchors);
+    }
+
+    const std::vector<uint32_t>& cell(size_t i, size_t j) const {
+        return cells[i * m + j];
+    }
+
+    size_t size() const {
+        return anchorCells.size();
+    }
+};
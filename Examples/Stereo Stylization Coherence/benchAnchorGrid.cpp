@@ -0,0 +1,156 @@
+//
+//  benchAnchorGrid.cpp
+//  artoolkitX Stereo Stylization Coherence Example
+//
+//  Measures the cost of the Voronoi density update's anchor removal and insertion, scanning all anchors for
+//  each over-dense cell (as Voronoi::updateDensity() used to) versus looking them up in an AnchorGrid, as the
+//  grid grows from 32 x 32 to 512 x 512 cells.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "anchorgrid.hpp"
+
+static int iterations = 10;
+static size_t scanMax = 128;
+
+// One anchor at a random position in each cell, plus extra anchors in a random tenth of the cells.
+static void seed(size_t m, size_t n, std::mt19937& rng, AnchorArrays& a) {
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    a = AnchorArrays();
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < m; j++) {
+            const int count = (u(rng) < 0.1f ? 4 : 1);
+            for (int k = 0; k < count; k++) {
+                const float worldPos[3] = {u(rng), u(rng), u(rng)};
+                a.push((j + u(rng)) / float(m), (i + u(rng)) / float(n), worldPos);
+            }
+        }
+    }
+}
+
+// Cell densities for one update: a tenth of the cells over-dense, a tenth under-dense, the rest fine.
+static void densities(size_t m, size_t n, std::mt19937& rng, std::vector<int>& d) {
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    d.resize(m * n);
+    for (size_t c = 0; c < m * n; c++) {
+        const float r = u(rng);
+        d[c] = (r < 0.1f ? 1 : (r < 0.2f ? -1 : 0));
+    }
+}
+
+static void add(size_t m, size_t n, size_t i, size_t j, std::mt19937& rng, AnchorArrays& a) {
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    const float x = (j + u(rng)) / float(m);
+    const float y = (i + u(rng)) / float(n);
+    const float worldPos[3] = {x, y, 0.0f};
+    a.push(x, y, worldPos);
+}
+
+static void updateScan(size_t m, size_t n, const std::vector<int>& d, std::mt19937& rng, AnchorArrays& a) {
+    const float mInv = 1.0f / float(m);
+    const float nInv = 1.0f / float(n);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < m; j++) {
+            if (d[i * m + j] == 0) continue;
+            if (d[i * m + j] > 0) {
+                for (int k = int(a.offsets.size()) - 2; k >= 0; k -= 2) {
+                    const float x = a.offsets[k + 0];
+                    const float y = 1.0f - a.offsets[k + 1];
+                    if (x >= float(j) * mInv && y >= float(i) * nInv && x < float(j + 1) * mInv && y < float(i + 1) * nInv) {
+                        a.offsets.erase(a.offsets.begin() + k, a.offsets.begin() + k + 2);
+                        a.x.erase(a.x.begin() + k / 2);
+                        a.y.erase(a.y.begin() + k / 2);
+                        a.z.erase(a.z.begin() + k / 2);
+                    }
+                }
+            }
+            add(m, n, i, j, rng, a);
+        }
+    }
+}
+
+static void updateGrid(size_t m, size_t n, const std::vector<int>& d, std::mt19937& rng, AnchorArrays& a, AnchorGrid& grid) {
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < m; j++) {
+            if (d[i * m + j] == 0) continue;
+            if (d[i * m + j] > 0) grid.removeCell(i, j, a);
+            add(m, n, i, j, rng, a);
+            grid.insert(a.offsets[a.offsets.size() - 2], 1.0f - a.offsets[a.offsets.size() - 1]);
+        }
+    }
+}
+
+static void usage(char *com) {
+    std::printf("Usage: %s [options]\n", com);
+    std::printf("Options:\n");
+    std::printf("  -iterations=n: density updates to time at each grid size (default 10).\n");
+    std::printf("  -scanmax=n: largest m (= n) at which to also time the full scan (default 128; it is quadratic).\n");
+    std::printf("  -h -help --help: show this message\n");
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+        } else if (strncmp(argv[i], "-iterations=", 12) == 0) {
+            iterations = atoi(&(argv[i][12]));
+            if (iterations <= 0) usage(argv[0]);
+        } else if (strncmp(argv[i], "-scanmax=", 9) == 0) {
+            scanMax = size_t(atoi(&(argv[i][9])));
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    std::printf("%9s %10s %14s %14s %9s\n", "cells", "anchors", "scan ms/update", "grid ms/update", "speedup");
+    for (size_t m = 32; m <= 512; m *= 2) {
+        const size_t n = m;
+        std::vector<int> d;
+        double tScan = 0.0, tGrid = 0.0;
+        size_t anchors;
+
+        if (m <= scanMax) {
+            std::mt19937 rng(1);
+            AnchorArrays a;
+            seed(m, n, rng, a);
+            for (int k = 0; k < iterations; k++) {
+                densities(m, n, rng, d);
+                auto t0 = std::chrono::steady_clock::now();
+                updateScan(m, n, d, rng, a);
+                tScan += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            }
+        }
+
+        std::mt19937 rng(1);
+        AnchorArrays a;
+        AnchorGrid grid;
+        seed(m, n, rng, a);
+        anchors = a.size();
+        grid.reset(m, n);
+        grid.rebuild(a.offsets);
+        for (int k = 0; k < iterations; k++) {
+            densities(m, n, rng, d);
+            auto t0 = std::chrono::steady_clock::now();
+            updateGrid(m, n, d, rng, a, grid);
+            tGrid += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        if (grid.size() != a.size() || grid.size() != a.x.size()) {
+            std::printf("Anchor arrays out of step with grid at %zux%zu.\n", m, n);
+            return -1;
+        }
+
+        if (m <= scanMax) {
+            std::printf("%4zux%-4zu %10zu %14.3f %14.3f %8.1fx\n", m, n, anchors, 1000.0 * tScan / iterations, 1000.0 * tGrid / iterations, tScan / tGrid);
+        } else {
+            std::printf("%4zux%-4zu %10zu %14s %14.3f %9s\n", m, n, anchors, "-", 1000.0 * tGrid / iterations, "-");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+//
+//  benchCoherence.cpp
+//  artoolkitX Stereo Stylization Coherence Example
+//
+//  Measures the coherence of stylization over a sequence recorded with the example's --record option, without
+//  a display. For each frame it compares each eye with the same eye's previous frame (temporal coherence), and the
+//  right eye with the left eye (stereo coherence). Each reference pixel's surface point is reprojected into the
+//  other image, and where the same surface is visible there, the colour difference is accumulated.
+//  The comparisons are split into row tiles and run in parallel.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "coherence.hpp"
+
+static const char *recordDirectory = NULL;
+static const char *csvPath = NULL;
+static const char *diffDirectory = NULL;
+static int threads = 0;
+static int tileRows = 32;
+
+struct Comparison {
+    const char *type;      // "temporal" or "stereo".
+    int eye;               // Eye of the current frame.
+    const CoherenceFrame *ref, *cur;
+    CoherenceResult result;
+    std::vector<float> diff;
+};
+
+static bool loadFrame(long frame, int eye, const float pose[16], CoherenceFrame& out) {
+    char name[32];
+    int w, h;
+    snprintf(name, sizeof(name), "/%06ld_%d", frame, eye);
+    const std::string base = std::string(recordDirectory) + name;
+    if (!coherenceReadPPM(base + ".ppm", out.width, out.height, out.rgb)) {
+        fprintf(stderr, "Unable to read '%s.ppm'.\n", base.c_str());
+        return false;
+    }
+    if (!coherenceReadPFM(base + ".pfm", w, h, out.viewPos) || w != out.width || h != out.height) {
+        fprintf(stderr, "Unable to read '%s.pfm', or its size differs from the image.\n", base.c_str());
+        return false;
+    }
+    memcpy(out.pose, pose, sizeof(out.pose));
+    return true;
+}
+
+// Run all comparisons for one frame, as tiles shared between the worker threads.
+static void compare(std::vector<Comparison>& comparisons, const float projection[16], int threadCount) {
+    std::vector<std::pair<size_t, int> > tiles;
+    for (size_t c = 0; c < comparisons.size(); c++) {
+        comparisons[c].result.sum = 0.0;
+        comparisons[c].result.compared = comparisons[c].result.total = 0;
+        if (diffDirectory) comparisons[c].diff.resize(size_t(comparisons[c].ref->width) * comparisons[c].ref->height);
+        for (int row = 0; row < comparisons[c].ref->height; row += tileRows) tiles.push_back(std::make_pair(c, row));
+    }
+    std::vector<std::vector<CoherenceResult> > tileResults(comparisons.size());
+    for (size_t c = 0; c < comparisons.size(); c++) tileResults[c].resize((comparisons[c].ref->height + tileRows - 1) / tileRows);
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t t;
+        while ((t = next++) < tiles.size()) {
+            Comparison& c = comparisons[tiles[t].first];
+            const int row0 = tiles[t].second, row1 = std::min(row0 + tileRows, c.ref->height);
+            tileResults[tiles[t].first][row0 / tileRows] = coherenceCompareRows(*c.ref, *c.cur, projection, row0, row1, diffDirectory ? c.diff.data() : NULL);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threadCount; i++) pool.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+
+    // Sum tiles in order, so results do not depend on the thread count.
+    for (size_t c = 0; c < comparisons.size(); c++) {
+        for (size_t t = 0; t < tileResults[c].size(); t++) {
+            comparisons[c].result.sum += tileResults[c][t].sum;
+            comparisons[c].result.compared += tileResults[c][t].compared;
+            comparisons[c].result.total += tileResults[c][t].total;
+        }
+    }
+}
+
+static void usage(char *com) {
+    printf("Usage: %s -record=<directory> [options]\n", com);
+    printf("Measures temporal and stereo coherence of a sequence recorded with the example's --record option.\n");
+    printf("Options:\n");
+    printf("  -record=dir: the recording directory.\n");
+    printf("  -csv=file: write per-frame results to file (default standard output).\n");
+    printf("  -diff=dir: also write a difference image for each comparison to dir (green: not comparable, red: difference).\n");
+    printf("  -threads=n: worker threads (default: number of hardware threads).\n");
+    printf("  -tile=n: rows per tile (default 32).\n");
+    printf("  -h -help --help: show this message\n");
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+        } else if (strncmp(argv[i], "-record=", 8) == 0) {
+            recordDirectory = &(argv[i][8]);
+        } else if (strncmp(argv[i], "-csv=", 5) == 0) {
+            csvPath = &(argv[i][5]);
+        } else if (strncmp(argv[i], "-diff=", 6) == 0) {
+            diffDirectory = &(argv[i][6]);
+        } else if (strncmp(argv[i], "-threads=", 9) == 0) {
+            threads = atoi(&(argv[i][9]));
+            if (threads <= 0) usage(argv[0]);
+        } else if (strncmp(argv[i], "-tile=", 6) == 0) {
+            tileRows = atoi(&(argv[i][6]));
+            if (tileRows <= 0) usage(argv[0]);
+        } else {
+            fprintf(stderr, "Error: invalid command line argument '%s'.\n", argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (!recordDirectory) usage(argv[0]);
+    if (threads <= 0) threads = std::max(int(std::thread::hardware_concurrency()), 1);
+
+    float projection[16];
+    {
+        std::ifstream in(std::string(recordDirectory) + "/projection.txt");
+        for (int i = 0; i < 16; i++) in >> projection[i];
+        if (!in) {
+            fprintf(stderr, "Unable to read projection from '%s/projection.txt'.\n", recordDirectory);
+            return -1;
+        }
+    }
+    std::ifstream poses(std::string(recordDirectory) + "/poses.txt");
+    if (!poses) {
+        fprintf(stderr, "Unable to read '%s/poses.txt'.\n", recordDirectory);
+        return -1;
+    }
+    FILE *csv = stdout;
+    if (csvPath && !(csv = fopen(csvPath, "w"))) {
+        fprintf(stderr, "Unable to write '%s'.\n", csvPath);
+        return -1;
+    }
+    fprintf(csv, "frame,type,eye,compared,total,sum,mean\n");
+
+    // Frames are read a stereo pair at a time. A pair with a missing eye (no pose that frame) breaks the temporal chain.
+    CoherenceFrame frames[2][2]; // [current/previous][eye]
+    bool have[2][2] = {{false, false}, {false, false}};
+    int cur = 0;
+    long frame = -1, pairs = 0;
+    double seconds = 0.0, sums[3] = {0.0, 0.0, 0.0};
+    long compared[3] = {0, 0, 0};
+    std::string line;
+    bool more = true;
+    std::vector<Comparison> comparisons;
+
+    while (more) {
+        long f = -1;
+        int eye = -1;
+        float pose[16];
+        more = false;
+        while (std::getline(poses, line)) {
+            std::istringstream ls(line);
+            ls >> f >> eye;
+            for (int i = 0; i < 16; i++) ls >> pose[i];
+            if (!ls || eye < 0 || eye > 1) continue;
+            more = true;
+            break;
+        }
+
+        // Process the completed frame when the frame number changes, or at the end.
+        if (frame >= 0 && (!more || f != frame)) {
+            const int prev = 1 - cur;
+            comparisons.clear();
+            for (int e = 0; e <= 1; e++) {
+                if (have[cur][e] && have[prev][e]) {
+                    Comparison c = {"temporal", e, &frames[prev][e], &frames[cur][e], {0.0, 0, 0}, std::vector<float>()};
+                    comparisons.push_back(c);
+                }
+            }
+            if (have[cur][0] && have[cur][1]) {
+                Comparison c = {"stereo", 1, &frames[cur][0], &frames[cur][1], {0.0, 0, 0}, std::vector<float>()};
+                comparisons.push_back(c);
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            compare(comparisons, projection, threads);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            pairs++;
+
+            for (size_t i = 0; i < comparisons.size(); i++) {
+                const Comparison& c = comparisons[i];
+                const int kind = (strcmp(c.type, "stereo") == 0 ? 2 : c.eye);
+                sums[kind] += c.result.sum;
+                compared[kind] += c.result.compared;
+                fprintf(csv, "%ld,%s,%d,%ld,%ld,%f,%f\n", frame, c.type, c.eye, c.result.compared, c.result.total, c.result.sum, c.result.compared ? c.result.sum / c.result.compared : 0.0);
+                if (diffDirectory) {
+                    char name[64];
+                    std::vector<unsigned char> rgb;
+                    snprintf(name, sizeof(name), "/diff_%06ld_%s_%d.ppm", frame, c.type, c.eye);
+                    coherenceDifferenceImage(c.diff, rgb);
+                    coherenceWritePPM(std::string(diffDirectory) + name, c.ref->width, c.ref->height, rgb.data());
+                }
+            }
+
+            cur = prev;
+            have[cur][0] = have[cur][1] = false;
+        }
+        if (!more) break;
+
+        if (f != frame) frame = f;
+        if (!(have[cur][eye] = loadFrame(f, eye, pose, frames[cur][eye]))) {
+            if (csv != stdout) fclose(csv);
+            return -1;
+        }
+    }
+    if (csv != stdout) fclose(csv);
+
+    fprintf(stderr, "%ld frames, %d threads: %.2f ms per frame (%.1f frames/s).\n", pairs, threads, pairs ? 1000.0 * seconds / pairs : 0.0, seconds > 0.0 ? pairs / seconds : 0.0);
+    fprintf(stderr, "Mean difference: temporal left %f, temporal right %f, stereo %f.\n",
+            compared[0] ? sums[0] / compared[0] : 0.0, compared[1] ? sums[1] / compared[1] : 0.0, compared[2] ? sums[2] / compared[2] : 0.0);
+    return 0;
+}
@@ -0,0 +1,200 @@
+//
+//  benchVoronoiRender.cpp
+//  artoolkitX Stereo Stylization Coherence Example
+//
+//  Renders the Voronoi pattern on the CPU with VoronoiRenderer, without a display, and times it for increasing
+//  thread counts. Anchors are placed one per cell of an m x n grid, as Voronoi does initially, and coloured from
+//  a PPM image (or a generated gradient). The output can be written as a PPM, and checked against a brute-force
+//  nearest-anchor search.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "coherence.hpp"
+#include "voronoirender.hpp"
+
+static const char *imagePath = NULL;
+static const char *outPath = NULL;
+static int width = 1280, height = 720;
+static size_t m = 240, n = 135;
+static int iterations = 10;
+static int threadsMax = 0;
+static bool check = false;
+
+// Brute-force reference: each pixel takes the colour at its nearest anchor within radius.
+static long checkRender(const std::vector<float>& offsets, float radius, const std::vector<unsigned char>& frame, int frameWidth, int frameHeight, const std::vector<unsigned char>& out) {
+    const size_t count = offsets.size() / 2;
+    std::vector<float> colors(count * 3);
+    for (size_t k = 0; k < count; k++) {
+        const int x = std::min(int(offsets[k * 2 + 0] * frameWidth), frameWidth - 1);
+        const int y = std::min(int(offsets[k * 2 + 1] * frameHeight), frameHeight - 1);
+        for (int c = 0; c < 3; c++) colors[k * 3 + c] = frame[(size_t(y) * frameWidth + x) * 4 + c];
+    }
+    long bad = 0;
+    for (int y = 0; y < height; y++) {
+        const float v = (float(y) + 0.5f) / float(height);
+        for (int x = 0; x < width; x++) {
+            const float u = (float(x) + 0.5f) / float(width);
+            float best = radius * radius, second = best;
+            size_t nearest = count;
+            for (size_t k = 0; k < count; k++) {
+                const float du = offsets[k * 2 + 0] - u, dv = offsets[k * 2 + 1] - v;
+                const float d2 = du * du + dv * dv;
+                if (d2 < best) {
+                    second = best;
+                    best = d2;
+                    nearest = k;
+                } else if (d2 < second) {
+                    second = d2;
+                }
+            }
+            const unsigned char *p = &out[(size_t(y) * width + x) * 4];
+            if (nearest == count) {
+                if (p[3] != 0) bad++;
+                continue;
+            }
+            if (second - best < 1e-9f) continue; // Tie; either anchor is right.
+            // The renderer interpolates the anchor colour; allow for that against the nearest texel's.
+            for (int c = 0; c < 3; c++) {
+                if (std::abs(float(p[c]) - colors[nearest * 3 + c]) > 64.0f) {
+                    bad++;
+                    break;
+                }
+            }
+        }
+    }
+    return bad;
+}
+
+static void usage(char *com) {
+    std::printf("Usage: %s [options]\n", com);
+    std::printf("Options:\n");
+    std::printf("  -image=file: PPM image to colour the anchors from (default a generated gradient).\n");
+    std::printf("  -out=file: write the rendered pattern to file as a PPM.\n");
+    std::printf("  -size=wxh: output size (default 1280x720).\n");
+    std::printf("  -grid=mxn: anchor grid size (default 240x135).\n");
+    std::printf("  -iterations=n: renders to time for each thread count (default 10).\n");
+    std::printf("  -threads=n: largest thread count to time (default: number of hardware threads).\n");
+    std::printf("  -check: compare the output against a brute-force nearest-anchor search.\n");
+    std::printf("  -h -help --help: show this message\n");
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+        } else if (strncmp(argv[i], "-image=", 7) == 0) {
+            imagePath = &(argv[i][7]);
+        } else if (strncmp(argv[i], "-out=", 5) == 0) {
+            outPath = &(argv[i][5]);
+        } else if (strncmp(argv[i], "-size=", 6) == 0) {
+            if (sscanf(&(argv[i][6]), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) usage(argv[0]);
+        } else if (strncmp(argv[i], "-grid=", 6) == 0) {
+            if (sscanf(&(argv[i][6]), "%zux%zu", &m, &n) != 2 || m == 0 || n == 0) usage(argv[0]);
+        } else if (strncmp(argv[i], "-iterations=", 12) == 0) {
+            iterations = atoi(&(argv[i][12]));
+            if (iterations <= 0) usage(argv[0]);
+        } else if (strncmp(argv[i], "-threads=", 9) == 0) {
+            threadsMax = atoi(&(argv[i][9]));
+            if (threadsMax <= 0) usage(argv[0]);
+        } else if (strcmp(argv[i], "-check") == 0) {
+            check = true;
+        } else {
+            fprintf(stderr, "Error: invalid command line argument '%s'.\n", argv[i]);
+            usage(argv[0]);
+        }
+    }
+    if (threadsMax <= 0) threadsMax = std::max(int(std::thread::hardware_concurrency()), 1);
+
+    // Frame, as RGBA rows bottom to top.
+    int frameWidth = 640, frameHeight = 480;
+    std::vector<unsigned char> rgb, frame;
+    if (imagePath) {
+        if (!coherenceReadPPM(imagePath, frameWidth, frameHeight, rgb)) {
+            fprintf(stderr, "Unable to read '%s'.\n", imagePath);
+            return -1;
+        }
+    } else {
+        rgb.resize(size_t(frameWidth) * frameHeight * 3);
+        for (int y = 0; y < frameHeight; y++) {
+            for (int x = 0; x < frameWidth; x++) {
+                unsigned char *p = &rgb[(size_t(y) * frameWidth + x) * 3];
+                p[0] = (unsigned char)(255 * x / frameWidth);
+                p[1] = (unsigned char)(255 * y / frameHeight);
+                p[2] = (unsigned char)(((x / 32) ^ (y / 32)) & 1 ? 192 : 64);
+            }
+        }
+    }
+    frame.resize(size_t(frameWidth) * frameHeight * 4);
+    for (int y = 0; y < frameHeight; y++) {
+        for (int x = 0; x < frameWidth; x++) {
+            const unsigned char *s = &rgb[(size_t(frameHeight - 1 - y) * frameWidth + x) * 3];
+            unsigned char *d = &frame[(size_t(y) * frameWidth + x) * 4];
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            d[3] = 255;
+        }
+    }
+
+    // One anchor at a random position in each cell, with y up as Voronoi uploads them.
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> r(0.0f, 1.0f);
+    std::vector<float> offsets;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < m; j++) {
+            offsets.push_back((j + r(rng)) / float(m));
+            offsets.push_back(1.0f - (i + r(rng)) / float(n));
+        }
+    }
+    const float radius = 3.0f / float(std::max(m, n)) / 2.0f; // As Voronoi::coneScale() / 2.
+
+    VoronoiRenderer renderer;
+    std::vector<unsigned char> out(size_t(width) * height * 4);
+    std::printf("%zux%zu anchors, %dx%d output.\n", m, n, width, height);
+    std::printf("%8s %12s %10s\n", "threads", "ms/render", "speedup");
+    double t1 = 0.0;
+    for (int threads = 1; threads <= threadsMax; threads *= 2) {
+        double t = 0.0;
+        for (int k = 0; k < iterations; k++) {
+            std::fill(out.begin(), out.end(), 0);
+            auto t0 = std::chrono::steady_clock::now();
+            renderer.render(offsets.data(), offsets.size() / 2, m, n, radius, frame.data(), frameWidth, frameHeight, out.data(), width, height, threads);
+            t += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        if (threads == 1) t1 = t;
+        std::printf("%8d %12.3f %9.1fx\n", threads, 1000.0 * t / iterations, t1 / t);
+        if (threads < threadsMax && threads * 2 > threadsMax) threads = threadsMax / 2;
+    }
+
+    if (check) {
+        const long bad = checkRender(offsets, radius, frame, frameWidth, frameHeight, out);
+        std::printf("Check: %ld of %ld pixels differ from the brute-force search.\n", bad, long(width) * height);
+        if (bad) return -1;
+    }
+    if (outPath) {
+        rgb.resize(size_t(width) * height * 3);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const unsigned char *s = &out[(size_t(height - 1 - y) * width + x) * 4];
+                unsigned char *d = &rgb[(size_t(y) * width + x) * 3];
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+            }
+        }
+        if (!coherenceWritePPM(outPath, width, height, rgb.data())) {
+            fprintf(stderr, "Unable to write '%s'.\n", outPath);
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <ARX/ARG/mtx.h>
+
+// One recorded eye image: the stylized output, the view space position seen at each pixel, and the camera pose.
+// Rows are stored top to bottom.
+struct CoherenceFrame {
+    int width, height;
+    std::vector<unsigned char> rgb;   // 3 bytes per pixel.
+    std::vector<float> viewPos;       // View space x, y, z per pixel.
+    float pose[16];                   // World (marker) to view transform, column-major.
+};
+
+// Result of comparing one frame against a reference frame.
+struct CoherenceResult {
+    double sum;        // Sum of colour differences over compared pixels.
+    long compared;     // Reference pixels that reprojected onto a pixel showing the same surface.
+    long total;        // Reference pixels.
+};
+
+// Depth agreement (in view space units) for a reprojected pixel to count as showing the same surface.
+#define COHERENCE_DEPTH_TOLERANCE 0.1f
+// Colour difference shown at full intensity in difference images.
+#define COHERENCE_DIFFERENCE_SCALE 0.1f
+
+// Inverse of a rigid (rotation and translation) column-major transform.
+static inline void coherenceInvertRigid(const float M[16], float inv[16]) {
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) inv[c * 4 + r] = M[r * 4 + c];
+        inv[r * 4 + 3] = 0.0f;
+        inv[12 + r] = -(M[r * 4 + 0] * M[12] + M[r * 4 + 1] * M[13] + M[r * 4 + 2] * M[14]);
+    }
+    inv[15] = 1.0f;
+}
+
+// Compare rows [row0, row1) of reference frame ref with frame cur. Each reference pixel's surface point is moved into
+// cur's view with the pose change, projected with projection, and if cur sees the same surface there (within
+// COHERENCE_DEPTH_TOLERANCE), the colour difference between the two pixels is accumulated. If diff is non-NULL it
+// receives the difference for each reference pixel, or -1 where there was nothing to compare.
+static inline CoherenceResult coherenceCompareRows(const CoherenceFrame& ref, const CoherenceFrame& cur, const float projection[16], int row0, int row1, float *diff) {
+    CoherenceResult result = {0.0, 0, 0};
+    float refViewInv[16], A[16], PA[16];
+
+    // Reference view space -> current view space, and -> current clip space.
+    coherenceInvertRigid(ref.pose, refViewInv);
+    mtxLoadMatrixf(A, cur.pose);
+    mtxMultMatrixf(A, refViewInv);
+    mtxLoadMatrixf(PA, projection);
+    mtxMultMatrixf(PA, A);
+
+    const float tolerance2 = COHERENCE_DEPTH_TOLERANCE * COHERENCE_DEPTH_TOLERANCE;
+    for (int i = row0; i < row1; i++) {
+        const float *p = &ref.viewPos[size_t(i) * ref.width * 3];
+        const unsigned char *refColor = &ref.rgb[size_t(i) * ref.width * 3];
+        for (int j = 0; j < ref.width; j++, p += 3, refColor += 3) {
+            result.total++;
+            float d = -1.0f;
+
+            const float cw = PA[3] * p[0] + PA[7] * p[1] + PA[11] * p[2] + PA[15];
+            const float x = 0.5f + 0.5f * (PA[0] * p[0] + PA[4] * p[1] + PA[8] * p[2] + PA[12]) / cw;
+            const float y = 0.5f - 0.5f * (PA[1] * p[0] + PA[5] * p[1] + PA[9] * p[2] + PA[13]) / cw;
+            if (x >= 0.0f && y >= 0.0f && x < 1.0f && y < 1.0f) { // Also false for NaN.
+                const size_t curIndex = size_t(int(y * float(cur.height))) * cur.width + size_t(int(x * float(cur.width)));
+                const float *q = &cur.viewPos[curIndex * 3];
+                const float dx = q[0] - (A[0] * p[0] + A[4] * p[1] + A[8] * p[2] + A[12]);
+                const float dy = q[1] - (A[1] * p[0] + A[5] * p[1] + A[9] * p[2] + A[13]);
+                const float dz = q[2] - (A[2] * p[0] + A[6] * p[1] + A[10] * p[2] + A[14]);
+                if (dx * dx + dy * dy + dz * dz <= tolerance2) {
+                    const unsigned char *curColor = &cur.rgb[curIndex * 3];
+                    const float r = float(refColor[0] - curColor[0]) / 255.0f;
+                    const float g = float(refColor[1] - curColor[1]) / 255.0f;
+                    const float b = float(refColor[2] - curColor[2]) / 255.0f;
+                    d = sqrtf(r * r + g * g + b * b);
+                    result.sum += d;
+                    result.compared++;
+                }
+            }
+            if (diff) diff[size_t(i) * ref.width + j] = d;
+        }
+    }
+    return result;
+}
+
+// Render per-pixel differences as an RGB image: green where there was nothing to compare, red scaled by difference.
+static inline void coherenceDifferenceImage(const std::vector<float>& diff, std::vector<unsigned char>& rgb) {
+    rgb.resize(diff.size() * 3);
+    for (size_t k = 0; k < diff.size(); k++) {
+        if (diff[k] < 0.0f) {
+            rgb[k * 3 + 0] = 0;
+            rgb[k * 3 + 1] = 255;
+        } else {
+            const float v = diff[k] / COHERENCE_DIFFERENCE_SCALE * 255.0f;
+            rgb[k * 3 + 0] = (unsigned char)(v > 255.0f ? 255.0f : v);
+            rgb[k * 3 + 1] = 0;
+        }
+        rgb[k * 3 + 2] = 0;
+    }
+}
+
+// Binary PPM (P6), rows top to bottom.
+static inline bool coherenceWritePPM(const std::string& path, int width, int height, const unsigned char *rgb) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    const bool ok = (fwrite(rgb, 3, size_t(width) * height, fp) == size_t(width) * height);
+    fclose(fp);
+    return ok;
+}
+
+static inline bool coherenceReadPPM(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgb) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    int maxval;
+    if (fscanf(fp, "P6 %d %d %d", &width, &height, &maxval) != 3 || maxval != 255 || fgetc(fp) == EOF) {
+        fclose(fp);
+        return false;
+    }
+    rgb.resize(size_t(width) * height * 3);
+    const bool ok = (fread(rgb.data(), 3, size_t(width) * height, fp) == size_t(width) * height);
+    fclose(fp);
+    return ok;
+}
+
+// Colour PFM ("PF"), little-endian. PFM stores rows bottom to top; the vector holds them top to bottom.
+static inline bool coherenceWritePFM(const std::string& path, int width, int height, const float *xyz) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fprintf(fp, "PF\n%d %d\n-1.0\n", width, height);
+    bool ok = true;
+    for (int i = height - 1; i >= 0 && ok; i--) {
+        ok = (fwrite(xyz + size_t(i) * width * 3, sizeof(float) * 3, width, fp) == size_t(width));
+    }
+    fclose(fp);
+    return ok;
+}
+
+static inline bool coherenceReadPFM(const std::string& path, int& width, int& height, std::vector<float>& xyz) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    float scale;
+    if (fscanf(fp, "PF %d %d %f", &width, &height, &scale) != 3 || scale >= 0.0f || fgetc(fp) == EOF) { // Little-endian only.
+        fclose(fp);
+        return false;
+    }
+    xyz.resize(size_t(width) * height * 3);
+    bool ok = true;
+    for (int i = height - 1; i >= 0 && ok; i--) {
+        ok = (fread(&xyz[size_t(i) * width * 3], sizeof(float) * 3, width, fp) == size_t(width));
+    }
+    fclose(fp);
+    return ok;
+}
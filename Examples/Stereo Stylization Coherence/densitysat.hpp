@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Summed-area table of the density rendering of the Voronoi pattern, for the CPU density path. Holds, for each texel,
+// the sum of coverage values and the count of empty (zero coverage) texels over all texels at or below and left of it,
+// so that the mean coverage of any box, and whether it has an empty texel, are found from four lookups each.
+//
+// Images have rows bottom to top, as read back from OpenGL. Cell boxes match those of shaders/voronoi.frag.
+class DensitySAT {
+private:
+    int width, height;
+    std::vector<uint32_t> sums;   // (width + 1) x (height + 1), with a zero first row and column.
+    std::vector<uint32_t> empty;  // Likewise, counting empty texels.
+
+    uint32_t box(const std::vector<uint32_t>& t, int x0, int y0, int x1, int y1) const {
+        const size_t w = size_t(width) + 1;
+        return t[y1 * w + x1] - t[y0 * w + x1] - t[y1 * w + x0] + t[y0 * w + x0];
+    }
+
+public:
+    DensitySAT() : width(0), height(0) {}
+
+    // Build from the 8-bit coverage in the first byte of each stride-byte pixel.
+    void build(const unsigned char *coverage, int width_, int height_, int stride) {
+        width = width_;
+        height = height_;
+        const size_t w = size_t(width) + 1;
+        sums.assign(w * (height + 1), 0);
+        empty.assign(w * (height + 1), 0);
+        for (int y = 0; y < height; y++) {
+            const unsigned char *p = coverage + size_t(y) * width * stride;
+            const uint32_t *sumsBelow = &sums[size_t(y) * w], *emptyBelow = &empty[size_t(y) * w];
+            uint32_t *sumsRow = &sums[size_t(y + 1) * w], *emptyRow = &empty[size_t(y + 1) * w];
+            uint32_t rowSum = 0, rowEmpty = 0;
+            for (int x = 0; x < width; x++, p += stride) {
+                rowSum += *p;
+                rowEmpty += (*p == 0);
+                sumsRow[x + 1] = sumsBelow[x + 1] + rowSum;
+                emptyRow[x + 1] = emptyBelow[x + 1] + rowEmpty;
+            }
+        }
+    }
+
+    // Mean coverage, in [0, 1], of texels [x0, x1) x [y0, y1), or 0 if any of them is empty.
+    float density(int x0, int y0, int x1, int y1) const {
+        if (x1 <= x0 || y1 <= y0 || box(empty, x0, y0, x1, y1)) return 0.0f;
+        return float(box(sums, x0, y0, x1, y1)) / (255.0f * float((x1 - x0) * (y1 - y0)));
+    }
+
+    // Density of each cell of an m x n grid over the image, with rows top to bottom as Voronoi indexes cells.
+    void cellDensities(size_t m, size_t n, std::vector<float>& out) const {
+        out.resize(m * n);
+        for (size_t r = 0; r < n; r++) {
+            const int y0 = int(r * height / n), y1 = int((r + 1) * height / n);
+            for (size_t j = 0; j < m; j++) {
+                const int x0 = int(j * width / m), x1 = int((j + 1) * width / m);
+                out[(n - r - 1) * m + j] = density(x0, y0, x1, y1);
+            }
+        }
+    }
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <ARX/ARG/mtx.h>
+
+// Software rasterizer for the view space positions of the virtual model, as the depth program renders them. The
+// output is RGBA float per pixel with rows bottom to top, as glReadPixels returned it: view space position and 1
+// where the model is nearest, zero elsewhere. Only the model's screen bounding box is rasterized; the buffer is kept
+// between frames and only the previous frame's box is cleared.
+//
+// Triangles are binned into tiles, and tiles are rasterized in parallel with their own depth buffers. Coverage
+// follows OpenGL (pixel centres, top-left rule, nearest window depth wins). Triangles reaching behind the near plane
+// are skipped rather than clipped.
+class ModelDepthRaster {
+private:
+    static constexpr int TILE = 64; // Tile size in pixels.
+
+    // Per vertex: window x and y, NDC z, and view space position and 1 divided by clip w.
+    struct Vertex {
+        float x, y, z;
+        float vx, vy, vz, w;
+        bool valid;
+    };
+    std::vector<Vertex> vertices;
+    std::vector<std::vector<uint32_t> > bins; // Triangles overlapping each tile of the bounding box.
+    int width, height;
+    int bounds[4];     // Box [x0, x1) x [y0, y1) written last frame.
+    int tileBounds[4]; // Box covered by this frame's tiles.
+    int tilesX, tilesY;
+
+    static float edge(float ax, float ay, float bx, float by, float px, float py) {
+        return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    }
+
+    // OpenGL's top-left rule, for counter-clockwise (positive area) edges in window coordinates with y up.
+    static bool topLeft(float ax, float ay, float bx, float by) {
+        return (ay == by && bx < ax) || (by < ay);
+    }
+
+    // First pixel, not before lo, whose centre is at or after a.
+    static int firstCentre(float a, int lo) {
+        const float c = a - 0.5f;
+        if (c <= float(lo)) return lo;
+        const int i = int(c);
+        return (float(i) < c ? i + 1 : i);
+    }
+
+    // One past the last pixel, not after hi, whose centre is at or before b.
+    static int lastCentre(float b, int hi) {
+        const float c = b - 0.5f;
+        if (c < 0.0f) return 0;
+        return std::min(int(std::min(c, float(hi))) + 1, hi);
+    }
+
+    // The triangle's vertices, counter-clockwise in window coordinates, or false if it has no area.
+    bool triangle(uint32_t t, const unsigned int *indices, Vertex v[3], float& invArea) const {
+        v[0] = vertices[indices[t * 3 + 0]];
+        v[1] = vertices[indices[t * 3 + 1]];
+        v[2] = vertices[indices[t * 3 + 2]];
+        float area = edge(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+        if (area == 0.0f) return false;
+        if (area < 0.0f) { // Both windings are drawn.
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+        invArea = 1.0f / area;
+        return true;
+    }
+
+    // Rasterize the tile's triangles, keeping each pixel's nearest.
+    void rasterizeTile(int tile, const unsigned int *indices, float *out, std::vector<float>& zbuffer) const {
+        const int x0 = tileBounds[0] + (tile % tilesX) * TILE, y0 = tileBounds[1] + (tile / tilesX) * TILE;
+        const int x1 = std::min(x0 + TILE, tileBounds[2]), y1 = std::min(y0 + TILE, tileBounds[3]);
+        std::fill(zbuffer.begin(), zbuffer.end(), std::numeric_limits<float>::infinity());
+
+        const std::vector<uint32_t>& bin = bins[tile];
+        Vertex v[3];
+        float invArea;
+        for (size_t b = 0; b < bin.size(); b++) {
+            if (!triangle(bin[b], indices, v, invArea)) continue;
+            const bool tl[3] = {topLeft(v[1].x, v[1].y, v[2].x, v[2].y), topLeft(v[2].x, v[2].y, v[0].x, v[0].y), topLeft(v[0].x, v[0].y, v[1].x, v[1].y)};
+            const float step0 = v[1].y - v[2].y, step1 = v[2].y - v[0].y, step2 = v[0].y - v[1].y;
+
+            // Pixels of the tile whose centres lie within the triangle's bounds.
+            const int px0 = firstCentre(std::min(std::min(v[0].x, v[1].x), v[2].x), x0), px1 = lastCentre(std::max(std::max(v[0].x, v[1].x), v[2].x), x1);
+            const int py0 = firstCentre(std::min(std::min(v[0].y, v[1].y), v[2].y), y0), py1 = lastCentre(std::max(std::max(v[0].y, v[1].y), v[2].y), y1);
+            for (int y = py0; y < py1; y++) {
+                // Edge functions at the row's first pixel centre, then stepped along the row.
+                const float cy = float(y) + 0.5f, cx = float(px0) + 0.5f;
+                float e0 = edge(v[1].x, v[1].y, v[2].x, v[2].y, cx, cy);
+                float e1 = edge(v[2].x, v[2].y, v[0].x, v[0].y, cx, cy);
+                float e2 = edge(v[0].x, v[0].y, v[1].x, v[1].y, cx, cy);
+                float *depth = &zbuffer[(y - y0) * TILE - x0];
+                for (int x = px0; x < px1; x++, e0 += step0, e1 += step1, e2 += step2) {
+                    if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f) continue;
+                    if ((e0 == 0.0f && !tl[0]) || (e1 == 0.0f && !tl[1]) || (e2 == 0.0f && !tl[2])) continue;
+
+                    // Window depth is affine in screen space; view space position is perspective-correct.
+                    const float b0 = e0 * invArea, b1 = e1 * invArea, b2 = e2 * invArea;
+                    const float z = b0 * v[0].z + b1 * v[1].z + b2 * v[2].z;
+                    if (z < -1.0f || z > 1.0f || z >= depth[x]) continue;
+                    depth[x] = z;
+                    const float w = 1.0f / (b0 * v[0].w + b1 * v[1].w + b2 * v[2].w);
+                    float *o = out + (size_t(y) * width + x) * 4;
+                    o[0] = (b0 * v[0].vx + b1 * v[1].vx + b2 * v[2].vx) * w;
+                    o[1] = (b0 * v[0].vy + b1 * v[1].vy + b2 * v[2].vy) * w;
+                    o[2] = (b0 * v[0].vz + b1 * v[1].vz + b2 * v[2].vz) * w;
+                    o[3] = 1.0f;
+                }
+            }
+        }
+    }
+
+public:
+    ModelDepthRaster() : width(0), height(0), tilesX(0), tilesY(0) {
+        bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+    }
+
+    // Rasterize indexCount / 3 triangles of positions (x, y, z per vertex) with model view matrix modelView and
+    // projection (column-major) into out, width x height pixels. threads 0 uses all hardware threads.
+    void render(const float *positions, size_t vertexCount, const unsigned int *indices, size_t indexCount, const float modelView[16], const float projection[16], int width_, int height_, std::vector<float>& out, int threads = 0) {
+        // Reuse the buffer, clearing only what was written last frame.
+        if (width_ != width || height_ != height || out.size() != size_t(width_) * height_ * 4) {
+            width = width_;
+            height = height_;
+            out.assign(size_t(width) * height * 4, 0.0f);
+        } else {
+            for (int y = bounds[1]; y < bounds[3]; y++) std::fill(out.begin() + (size_t(y) * width + bounds[0]) * 4, out.begin() + (size_t(y) * width + bounds[2]) * 4, 0.0f);
+        }
+        bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+
+        // Transform vertices.
+        float PV[16];
+        mtxLoadMatrixf(PV, projection);
+        mtxMultMatrixf(PV, modelView);
+        const float *V = modelView;
+        vertices.resize(vertexCount);
+        for (size_t k = 0; k < vertexCount; k++) {
+            const float *P = positions + k * 3;
+            const float cw = PV[3] * P[0] + PV[7] * P[1] + PV[11] * P[2] + PV[15];
+            const float cz = PV[2] * P[0] + PV[6] * P[1] + PV[10] * P[2] + PV[14];
+            Vertex& v = vertices[k];
+            v.valid = (cw > 0.0f && cz >= -cw);
+            if (!v.valid) continue;
+            const float iw = 1.0f / cw;
+            v.x = (0.5f + 0.5f * (PV[0] * P[0] + PV[4] * P[1] + PV[8] * P[2] + PV[12]) * iw) * float(width);
+            v.y = (0.5f + 0.5f * (PV[1] * P[0] + PV[5] * P[1] + PV[9] * P[2] + PV[13]) * iw) * float(height);
+            v.z = cz * iw;
+            v.vx = (V[0] * P[0] + V[4] * P[1] + V[8] * P[2] + V[12]) * iw;
+            v.vy = (V[1] * P[0] + V[5] * P[1] + V[9] * P[2] + V[13]) * iw;
+            v.vz = (V[2] * P[0] + V[6] * P[1] + V[10] * P[2] + V[14]) * iw;
+            v.w = iw;
+        }
+
+        // Screen bounding box of the model, then bin triangles into its tiles.
+        const size_t triangles = indexCount / 3;
+        float box[4] = {float(width), float(height), 0.0f, 0.0f};
+        for (size_t t = 0; t < triangles; t++) {
+            const Vertex *v[3] = {&vertices[indices[t * 3 + 0]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]]};
+            if (!v[0]->valid || !v[1]->valid || !v[2]->valid) continue;
+            for (int c = 0; c < 3; c++) {
+                box[0] = std::min(box[0], v[c]->x);
+                box[1] = std::min(box[1], v[c]->y);
+                box[2] = std::max(box[2], v[c]->x);
+                box[3] = std::max(box[3], v[c]->y);
+            }
+        }
+        tileBounds[0] = std::max(int(std::floor(box[0])), 0);
+        tileBounds[1] = std::max(int(std::floor(box[1])), 0);
+        tileBounds[2] = std::min(int(std::ceil(box[2])) + 1, width);
+        tileBounds[3] = std::min(int(std::ceil(box[3])) + 1, height);
+        if (tileBounds[2] <= tileBounds[0] || tileBounds[3] <= tileBounds[1]) return;
+        tilesX = (tileBounds[2] - tileBounds[0] + TILE - 1) / TILE;
+        tilesY = (tileBounds[3] - tileBounds[1] + TILE - 1) / TILE;
+        bins.resize(size_t(tilesX) * tilesY);
+        for (size_t b = 0; b < bins.size(); b++) bins[b].clear();
+        for (size_t t = 0; t < triangles; t++) {
+            const Vertex &a = vertices[indices[t * 3 + 0]], &b = vertices[indices[t * 3 + 1]], &c = vertices[indices[t * 3 + 2]];
+            if (!a.valid || !b.valid || !c.valid) continue;
+            const int tx0 = std::max(int(std::min(std::min(a.x, b.x), c.x)) - tileBounds[0], 0) / TILE;
+            const int ty0 = std::max(int(std::min(std::min(a.y, b.y), c.y)) - tileBounds[1], 0) / TILE;
+            const int tx1 = std::min(int(std::max(std::max(a.x, b.x), c.x)) + 1 - tileBounds[0], tileBounds[2] - tileBounds[0] - 1);
+            const int ty1 = std::min(int(std::max(std::max(a.y, b.y), c.y)) + 1 - tileBounds[1], tileBounds[3] - tileBounds[1] - 1);
+            if (tx1 < 0 || ty1 < 0) continue;
+            for (int ty = ty0; ty <= ty1 / TILE; ty++) {
+                for (int tx = tx0; tx <= tx1 / TILE; tx++) bins[size_t(ty) * tilesX + tx].push_back(uint32_t(t));
+            }
+        }
+        std::copy(tileBounds, tileBounds + 4, bounds);
+
+        // Tiles, shared between threads.
+        const int tiles = tilesX * tilesY;
+        if (threads <= 0) threads = std::max(int(std::thread::hardware_concurrency()), 1);
+        threads = std::min(threads, tiles);
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+            std::vector<float> zbuffer(TILE * TILE);
+            int t;
+            while ((t = next++) < tiles) rasterizeTile(t, indices, out.data(), zbuffer);
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; i++) pool.push_back(std::thread(worker));
+        worker();
+        for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+    }
+};
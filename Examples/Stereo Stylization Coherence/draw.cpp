@@ -36,11 +36,21 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <algorithm>
 
 #include "draw.h"
 #include "OBJ_Loader.h"
 #include "utils.hpp"
 #include "voronoi.hpp"
+#include "coherence.hpp"
+#include "densitysat.hpp"
+#include "depthraster.hpp"
+#include "framepreprocess.hpp"
 
 #include <ARX/ARController.h>
 
@@ -82,6 +92,16 @@
 
 #define DRAW_MODELS_MAX 32
 #define BASELINE false
+#define DEPTH_MAX_LATENCY_DEFAULT 1 // Frames by which the depth used for rendering may lag the frame being rendered.
+#define DEPTH_TIMINGS_REPORT_INTERVAL 300 // Frames between timing reports.
+#define DEPTH_NUM_DISPARITIES 64
+#define DEPTH_BLOCK_SIZE 9
+#define DEPTH_BASELINE 0.055f
+#define DEPTH_STRIP_ROWS 32      // Height (in half-resolution rows) of the strips searched with their own disparity band.
+#define DEPTH_BAND_MARGIN 4      // Disparities searched either side of the predicted range.
+#define DEPTH_BAND_MAX 32        // Strips whose band would be wider than this get a full search.
+#define DEPTH_MIN_COVERAGE 0.3f  // Strips with fewer predicted pixels than this get a full search.
+#define DEPTH_FRAME_SLOTS 3      // Preprocessed frames: one being filled, one pending and one being computed from.
 
 #if HAVE_GLES2 || HAVE_GL3
 // Indices of GL program uniforms.
@@ -93,6 +113,7 @@ enum {
     UNIFORM_CAMERA_POSITION,
     UNIFORM_WIDTH,
     UNIFORM_HEIGHT,
+    UNIFORM_STRIDE,
     UNIFORM_COUNT
 };
 // Indices of of GL program attributes.
@@ -105,6 +126,7 @@ static GLint uniforms[2][UNIFORM_COUNT] = {0};
 static GLuint program = 0;
 static GLuint depthProgram = 0;
 static GLuint postProgram = 0;
+static GLuint satProgram = 0;
 
 #if HAVE_GL3
 static GLuint gModelVAO = 0;
@@ -117,6 +139,8 @@ static GLuint gQuadVBOs[2] = {0};
 static GLuint gFBOs[3] = {0};
 static GLuint gFBOTextures[3] = {0};
 static GLuint gRBOs[2] = {0};
+static GLuint gSATFBOs[2] = {0};     // Ping-pong targets for building the density summed-area table.
+static GLuint gSATTextures[2] = {0};
 
 	#if defined(_WIN32)
 	# define ARGL_GET_PROC_ADDRESS wglGetProcAddress
@@ -142,6 +166,7 @@ static GLuint gRBOs[2] = {0};
     PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer = NULL;
     PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D = NULL;
     PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers = NULL;
+    PFNGLBLITFRAMEBUFFERPROC glBlitFramebuffer = NULL;
 
     PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
     PFNGLGENTEXTURESPROC glGenTextures = NULL;
@@ -177,14 +202,89 @@ static objl::Mesh model;
 static std::vector<float> mVertices;
 static std::vector<float> mNormals;
 static Voronoi* voronoi[2];
-static std::vector<cv::Vec3f> worldPositions[2];
-static std::vector<cv::Vec3b> colors[2];
+static std::string gRecordDirectory;
+static long gRecordFrame = 0;
+static bool gVoronoiCPU = false;          // Render the Voronoi pattern on the CPU rather than with instanced cones.
+static int gFrameSize[2] = {0};           // Size of the frame textures.
+static std::vector<unsigned char> gCPUFrame, gCPUPattern; // Frame read back, and pattern rendered, for CPU rendering.
+static bool gDensityCPU = false;          // Compute cell densities on the CPU from the read back density rendering.
+static std::vector<unsigned char> gDensityPixels;
+static DensitySAT gDensitySAT;
+static bool gModelDepthGPU = false;       // Render model view space positions with OpenGL and read them back, rather than rasterizing them on the CPU.
+static std::vector<float> gModelDepth;    // View space position of the model at each pixel, reused between frames.
+static ModelDepthRaster gModelDepthRaster;
 
 static void drawModel(float pose[16], size_t uniform_index);
+static void drawModelMatrix(float modelMatrix[16]);
 static void drawPost(size_t index, const float pose[16], const std::vector<float>& modelDepth, int width, int height, int contentWidth, int contentHeight);
 static cv::Ptr<cv::StereoMatcher> stereoLeft, stereoRight;
 static cv::Ptr<cv::ximgproc::DisparityWLSFilter> wlsFilterLeft, wlsFilterRight;
 static cv::Mat leftDepth, rightDepth;
+
+// Depth estimation runs on its own thread, one frame behind rendering. drawUpdate() submits frame N
+// and returns as soon as depth for frame N - gDepthMaxLatency (or newer) is available, so frame N+1's
+// depth is computed while frame N renders. Rendering always uses the current frame's poses; the
+// view space positions in the depth maps are those of the (up to gDepthMaxLatency) older frame.
+struct DepthJob {
+    long frame;
+    int width, height;
+    int slot;            // Index in gDepthFrames of the preprocessed images.
+    float pose[2][16];   // Marker pose for each eye, if poseValid.
+    bool poseValid[2];
+    int fullEvery;       // 0 for a full disparity search on every frame.
+    int validateEvery;
+};
+struct DepthTimings {
+    long computed;      // Frames for which depth was computed.
+    long rendered;      // Frames rendered.
+    long dropped;       // Frames submitted but superseded before depth was computed.
+    long staleness;     // Sum over rendered frames of frames by which depth lagged.
+    double preprocess;  // Seconds preprocessing, summed over rendered frames.
+    double match, filter, reproject; // Seconds, summed over computed frames.
+    double wait;        // Seconds the render thread waited for depth, summed over rendered frames.
+    // Temporal depth.
+    long temporal;      // Frames matched with pose-predicted disparity bands.
+    long stripsBanded, stripsFull; // Strips searched with a narrow band, and with the full range, in those frames.
+    double matchTemporal; // Seconds matching in those frames.
+    long validated;     // Temporal frames also matched with a full search, for comparison.
+    double validateError, validateBad; // Sum over validated frames of mean absolute disparity difference, and fraction of pixels differing by more than 1.
+    double validateTemporal, validateFull; // Seconds, summed over validated frames, for the temporal and full searches.
+};
+
+// Disparities and poses from the previous frame, for temporal depth. Used only on the depth thread.
+struct TemporalDepthState {
+    bool valid;
+    cv::Mat raw[2];     // Left and right disparity, as output by StereoSGBM.
+    float pose[2][16];
+    bool poseValid[2];
+    int framesSinceFull;
+    long temporalFrames;
+};
+// Stereo matching input for one frame, made by drawUpdate() in a slot that is neither pending nor being computed
+// from, so the buffers are reused rather than allocated each frame.
+struct DepthFrame {
+    cv::Mat rgb[2];  // Guide image for disparity filtering, for each eye.
+    cv::Mat gray[2]; // Half resolution, for matching.
+};
+static std::thread gDepthThread;
+static std::mutex gDepthLock;
+static std::condition_variable gDepthCond;
+static bool gDepthQuit = false;
+static bool gDepthJobPending = false;
+static DepthJob gDepthJob;
+static DepthFrame gDepthFrames[DEPTH_FRAME_SLOTS];
+static int gDepthWorking = -1;         // Slot the depth thread is computing from, or -1.
+static long gDepthFrame = -1;          // Frame of most recently computed depth, or -1 if none.
+static cv::Mat gDepthLeft, gDepthRight; // Most recently computed depth.
+static long gDepthSubmitted = -1;      // Frame most recently submitted.
+static int gDepthMaxLatency = DEPTH_MAX_LATENCY_DEFAULT;
+static int gDepthFullEvery = 0; // Temporal depth off.
+static int gDepthValidateEvery = 0;
+static DepthTimings gDepthTimings = {0};
+static TemporalDepthState gTemporal = {false};
+
+static void depthWorker();
+static void depthCompute(DepthJob& job, cv::Mat& leftDepthOut, cv::Mat& rightDepthOut, DepthTimings& timings);
 static float position[3] = {0};
 static int mouseX = 0, mouseY = 0;
 
@@ -209,6 +309,86 @@ void drawInit() {
     wlsFilterLeft = cv::ximgproc::createDisparityWLSFilter(stereoLeft);
     stereoRight = cv::ximgproc::createRightMatcher(stereoLeft);
     wlsFilterRight = cv::ximgproc::createDisparityWLSFilter(stereoRight);
+
+    gDepthQuit = false;
+    gDepthThread = std::thread(depthWorker);
+}
+
+void drawSetDepthMaxLatency(int frames) {
+    std::lock_guard<std::mutex> lock(gDepthLock);
+    gDepthMaxLatency = std::max(frames, 0);
+}
+
+void drawSetTemporalDepth(int fullEvery, int validateEvery) {
+    std::lock_guard<std::mutex> lock(gDepthLock);
+    gDepthFullEvery = std::max(fullEvery, 0);
+    gDepthValidateEvery = std::max(validateEvery, 0);
+}
+
+void drawSetVoronoiCPU(bool cpu) {
+    gVoronoiCPU = cpu;
+}
+
+void drawSetDensityCPU(bool cpu) {
+    gDensityCPU = cpu;
+}
+
+void drawSetModelDepthGPU(bool gpu) {
+    gModelDepthGPU = gpu;
+}
+
+void drawSetRecordDirectory(const char *directory) {
+    gRecordDirectory = (directory ? directory : "");
+    gRecordFrame = 0;
+    if (gRecordDirectory.empty()) return;
+
+    std::ofstream poses(gRecordDirectory + "/poses.txt", std::ios::trunc);
+    if (!poses) {
+        ARLOGe("Unable to write to recording directory '%s'.\n", directory);
+        gRecordDirectory.clear();
+    }
+}
+
+// Write one eye's recorded frame as <frame>_<eye>.ppm (stylized colour) and <frame>_<eye>.pfm (view space positions),
+// and append its pose to poses.txt. The projection is written with the first frame.
+static void drawRecordFrame(size_t index, const CoherenceFrame& frame, const float pose[16]) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%06ld_%d", gRecordFrame, int(index));
+    if (!coherenceWritePPM(gRecordDirectory + name + ".ppm", frame.width, frame.height, frame.rgb.data()) ||
+        !coherenceWritePFM(gRecordDirectory + name + ".pfm", frame.width, frame.height, frame.viewPos.data())) {
+        ARLOGe("Error writing recording frame '%s%s'.\n", gRecordDirectory.c_str(), name);
+    }
+
+    std::ofstream poses(gRecordDirectory + "/poses.txt", std::ios::app);
+    poses.precision(9);
+    poses << gRecordFrame << " " << index;
+    for (int i = 0; i < 16; i++) poses << " " << pose[i];
+    poses << "\n";
+
+    if (gRecordFrame == 0 && index == 0) {
+        std::ofstream projection(gRecordDirectory + "/projection.txt", std::ios::trunc);
+        projection.precision(9);
+        for (int i = 0; i < 16; i++) projection << gProjection[i] << (i < 15 ? " " : "\n");
+    }
+    if (index == 1) gRecordFrame++;
+}
+
+void drawPrintTimings() {
+    std::lock_guard<std::mutex> lock(gDepthLock);
+    const DepthTimings& t = gDepthTimings;
+    if (!t.computed || !t.rendered) return;
+    ARPRINT("Depth: %ld frames computed, %ld dropped. Per frame: match %.1f ms, filter %.1f ms, reproject %.1f ms.\n",
+            t.computed, t.dropped, 1000.0 * t.match / t.computed, 1000.0 * t.filter / t.computed, 1000.0 * t.reproject / t.computed);
+    ARPRINT("Render: %ld frames, preprocessed in %.1f ms and waited %.1f ms per frame for depth, depth %.2f frames old on average (max allowed %d).\n",
+            t.rendered, 1000.0 * t.preprocess / t.rendered, 1000.0 * t.wait / t.rendered, (double)t.staleness / t.rendered, gDepthMaxLatency);
+    if (t.temporal) {
+        ARPRINT("Temporal depth: %ld of %ld frames, match %.1f ms per frame, %.1f%% of strips needed a full search.\n",
+                t.temporal, t.computed, 1000.0 * t.matchTemporal / t.temporal, 100.0 * t.stripsFull / std::max(t.stripsBanded + t.stripsFull, 1L));
+    }
+    if (t.validated) {
+        ARPRINT("Temporal depth vs. full search (%ld frames): mean disparity difference %.2f px, %.1f%% of pixels differ by > 1 px, speedup %.2fx.\n",
+                t.validated, t.validateError / t.validated, 100.0 * t.validateBad / t.validated, t.validateTemporal > 0.0 ? t.validateFull / t.validateTemporal : 0.0);
+    }
 }
 
 void drawToggleModels() {
@@ -240,6 +420,7 @@ void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_i
     if (!glBindFramebuffer) glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)ARGL_GET_PROC_ADDRESS("glBindFramebuffer");
     if (!glFramebufferTexture2D) glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)ARGL_GET_PROC_ADDRESS("glFramebufferTexture2D");
     if (!glDeleteFramebuffers) glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)ARGL_GET_PROC_ADDRESS("glDeleteFramebuffers");
+    if (!glBlitFramebuffer) glBlitFramebuffer = (PFNGLBLITFRAMEBUFFERPROC)ARGL_GET_PROC_ADDRESS("glBlitFramebuffer");
 
     if (!glActiveTexture) glActiveTexture = (PFNGLACTIVETEXTUREPROC)ARGL_GET_PROC_ADDRESS("glActiveTexture");
     if (!glGenTextures) glGenTextures = (PFNGLGENTEXTURESPROC)ARGL_GET_PROC_ADDRESS("glGenTextures");
@@ -258,7 +439,7 @@ void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_i
         !glAttachShader || !glBindAttribLocation || !glCreateProgram || !glDeleteProgram ||
         !glEnableVertexAttribArray || !glGetUniformLocation || !glUseProgram || !glUniformMatrix4fv ||
         !glVertexAttribPointer || !glBindVertexArray || !glDeleteVertexArrays || !glGenVertexArrays ||
-        !glGenFramebuffers || !glBindFramebuffer || !glFramebufferTexture2D || !glDeleteFramebuffers ||
+        !glGenFramebuffers || !glBindFramebuffer || !glFramebufferTexture2D || !glDeleteFramebuffers || !glBlitFramebuffer ||
         !glActiveTexture || !glGenTextures || !glBindTexture || !glTexImage2D || !glTexParameteri ||
         !glDeleteTextures || !glGenRenderbuffers || !glBindRenderbuffer || !glRenderbufferStorage ||
         !glFramebufferRenderbuffer || !glDeleteRenderbuffers) {
@@ -270,8 +451,10 @@ void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_i
     rotate90 = rotate90_in;
     flipH = flipH_in;
     flipV = flipV_in;
+    gFrameSize[0] = width;
+    gFrameSize[1] = height;
 
-    // Load Voronoi instances (swap bottom two for baseline)
+    // Load Voronoi instances (swap bottom two for baseline). The right eye shares the left eye's anchors.
     voronoi[0] = new Voronoi(drawAPI, 80, 80, width, height);
 #if BASELINE
     voronoi[1] = new Voronoi(drawAPI, 80, 80, width, height);
@@ -312,6 +495,23 @@ void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_i
     glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[2]);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gFBOTextures[2], 0);
 
+#  if HAVE_GL3
+    if (drawAPI == ARG_API_GL3) {
+        // Summed-area table of the density rendering: summed coverage and count of empty texels.
+        glGenFramebuffers(2, gSATFBOs);
+        glGenTextures(2, gSATTextures);
+        for (int j = 0; j <= 1; j++) {
+            glBindTexture(GL_TEXTURE_2D, gSATTextures[j]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, gSATFBOs[j]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gSATTextures[j], 0);
+        }
+    }
+#  endif
+
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -321,34 +521,295 @@ void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_i
 }
 
 void drawUpdate(int width, int height, int contentWidth, int contentHeight, std::vector<unsigned char> frames[2]) {
-    // auto start = std::chrono::system_clock::now();
-    // if (depth.elemSize() > 0) {
-    //     return;
-    // }
-    cv::Mat left(width, height, CV_8UC4, frames[0].data());
-    cv::Mat right(width, height, CV_8UC4, frames[1].data());
-    cv::Mat leftGray, rightGray, leftDisparity, rightDisparity, leftFilteredDisparity, rightFilteredDisparity;
-
-    // Image preprocessing
-    cv::cvtColor(left, left, cv::COLOR_RGBA2RGB);
-    cv::cvtColor(right, right, cv::COLOR_RGBA2RGB);
-    cv::cvtColor(left, leftGray, cv::COLOR_RGB2GRAY);
-    cv::cvtColor(right, rightGray, cv::COLOR_RGB2GRAY);
-    cv::resize(leftGray, leftGray, cv::Size(), 0.5, 0.5, cv::INTER_LINEAR_EXACT);
-    cv::resize(rightGray, rightGray, cv::Size(), 0.5, 0.5, cv::INTER_LINEAR_EXACT);
-
-    // Stereo matching
-    stereoLeft->compute(leftGray, rightGray, leftDisparity);
-    stereoRight->compute(rightGray, leftGray, rightDisparity);
-    leftDisparity.convertTo(leftDisparity, CV_32F, 1.0);
-    rightDisparity.convertTo(rightDisparity, CV_32F, 1.0);
-
-    leftDisparity = (leftDisparity / 16.0f);
-    rightDisparity = (rightDisparity / 16.0f);
+    std::unique_lock<std::mutex> lock(gDepthLock);
+
+    // Preprocess into a free slot. Only this thread submits, so the slot stays free until this frame is submitted.
+    int slot = 0;
+    while (slot == gDepthWorking || (gDepthJobPending && slot == gDepthJob.slot)) slot++;
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    DepthFrame& frame = gDepthFrames[slot];
+    for (int i = 0; i <= 1; i++) {
+        frame.rgb[i].create(height, width, CV_8UC3);
+        frame.gray[i].create(height / 2, width / 2, CV_8UC1);
+        framePreprocess(frames[i].data(), width, height, frame.rgb[i].data, frame.gray[i].data);
+    }
+    const double preprocess = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    lock.lock();
+
+    // Submit this frame, replacing any frame the worker has not yet started on.
+    if (gDepthJobPending) gDepthTimings.dropped++;
+    gDepthSubmitted++;
+    gDepthJob.frame = gDepthSubmitted;
+    gDepthJob.width = width;
+    gDepthJob.height = height;
+    gDepthJob.slot = slot;
+    for (int i = 0; i <= 1; i++) {
+        gDepthJob.poseValid[i] = gModelLoaded[i] && gModelVisbilities[i];
+        if (gDepthJob.poseValid[i]) mtxLoadMatrixf(gDepthJob.pose[i], gModelPoses[i]);
+    }
+    gDepthJob.fullEvery = gDepthFullEvery;
+    gDepthJob.validateEvery = gDepthValidateEvery;
+    gDepthJobPending = true;
+    gDepthCond.notify_all();
+
+    gDepthTimings.preprocess += preprocess;
+
+    // Wait until depth is no more than gDepthMaxLatency frames old.
+    start = std::chrono::steady_clock::now();
+    gDepthCond.wait(lock, []{ return gDepthQuit || (gDepthFrame >= 0 && gDepthFrame >= gDepthSubmitted - gDepthMaxLatency); });
+    gDepthTimings.wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    leftDepth = gDepthLeft;
+    rightDepth = gDepthRight;
+    gDepthTimings.staleness += gDepthSubmitted - gDepthFrame;
+    gDepthTimings.rendered++;
+    bool report = (gDepthTimings.rendered % DEPTH_TIMINGS_REPORT_INTERVAL == 0);
+    lock.unlock();
+
+    if (report) drawPrintTimings();
+}
+
+static void depthWorker() {
+    std::unique_lock<std::mutex> lock(gDepthLock);
+    while (true) {
+        gDepthCond.wait(lock, []{ return gDepthQuit || gDepthJobPending; });
+        if (gDepthQuit) break;
+        DepthJob job = gDepthJob;
+        gDepthWorking = job.slot;
+        gDepthJobPending = false;
+        lock.unlock();
+
+        cv::Mat leftDepthOut, rightDepthOut;
+        DepthTimings timings = {0};
+        depthCompute(job, leftDepthOut, rightDepthOut, timings);
+
+        lock.lock();
+        gDepthLeft = leftDepthOut;
+        gDepthRight = rightDepthOut;
+        gDepthFrame = job.frame;
+        gDepthWorking = -1;
+        gDepthTimings.computed++;
+        gDepthTimings.match += timings.match;
+        gDepthTimings.filter += timings.filter;
+        gDepthTimings.reproject += timings.reproject;
+        gDepthTimings.temporal += timings.temporal;
+        gDepthTimings.stripsBanded += timings.stripsBanded;
+        gDepthTimings.stripsFull += timings.stripsFull;
+        gDepthTimings.matchTemporal += timings.matchTemporal;
+        gDepthTimings.validated += timings.validated;
+        gDepthTimings.validateError += timings.validateError;
+        gDepthTimings.validateBad += timings.validateBad;
+        gDepthTimings.validateTemporal += timings.validateTemporal;
+        gDepthTimings.validateFull += timings.validateFull;
+        gDepthCond.notify_all();
+    }
+}
+
+// Predict this frame's disparity magnitudes (0 where unknown) by moving the points of the previous frame's
+// disparity map by the change in camera pose relative to the marker. Where points collide, the nearest wins.
+static void depthPredict(const cv::Mat& prevRaw, int sign, const float prevPose[16], const float pose[16], bool havePoses, cv::Mat& predicted) {
+    const int w = prevRaw.cols, h = prevRaw.rows;
+    const float f = float(w) / 2.0f / tanf(45.0f / 180.0f * M_PI / 2.0f);
+    const float cx = float(w) / 2.0f, cy = float(h) / 2.0f;
+    const float fB = f * DEPTH_BASELINE;
+    float delta[16], prevPoseInv[16];
+
+    // Camera motion: previous camera coordinates -> marker -> current camera coordinates.
+    mtxLoadIdentityf(delta);
+    if (havePoses && invertMatrix(prevPose, prevPoseInv)) {
+        mtxLoadMatrixf(delta, pose);
+        mtxMultMatrixf(delta, prevPoseInv);
+    }
+
+    predicted.create(h, w, CV_32F);
+    predicted.setTo(0.0f);
+    for (int y = 0; y < h; y++) {
+        const short *rawRow = prevRaw.ptr<short>(y);
+        for (int x = 0; x < w; x++) {
+            const float d = float(sign * rawRow[x]) / 16.0f;
+            if (d <= 0.0f || d >= float(DEPTH_NUM_DISPARITIES)) continue; // Unmatched, or at infinity.
+            const float Z = fB / d;
+            // Camera coordinates in OpenGL convention (y up, looking down -z), as the poses are.
+            const float P[4] = {(float(x) - cx) * Z / f, -(float(y) - cy) * Z / f, -Z, 1.0f};
+            float Q[4];
+            transformVector(P, delta, Q);
+            const float Z2 = -Q[2];
+            if (Z2 <= 0.0f) continue;
+            const int x2 = int(lroundf(cx + f * Q[0] / Z2));
+            const int y2 = int(lroundf(cy - f * Q[1] / Z2));
+            if (x2 < 0 || x2 >= w || y2 < 0 || y2 >= h) continue;
+            float& p = predicted.at<float>(y2, x2);
+            p = std::max(p, fB / Z2);
+        }
+    }
+}
+
+// Match rows [y0, y1) of a against b, searching disparity magnitudes [lo, lo + num). sign is 1 for the
+// left matcher and -1 for the right. Unmatched pixels are set to the value a full search would give them.
+static void depthMatchStrip(const cv::Mat& a, const cv::Mat& b, int sign, int y0, int y1, int lo, int num, cv::Mat& raw) {
+    const int r0 = std::max(y0 - DEPTH_BLOCK_SIZE, 0);
+    const int r1 = std::min(y1 + DEPTH_BLOCK_SIZE, a.rows);
+    const int minDisparity = (sign > 0 ? lo : -(lo + num) + 1);
+    const short invalid = short((sign > 0 ? -1 : -DEPTH_NUM_DISPARITIES) * 16);
+    cv::Ptr<cv::StereoSGBM> matcher = cv::StereoSGBM::create(minDisparity, num, DEPTH_BLOCK_SIZE);
+    cv::Mat disparity;
+
+    matcher->compute(a.rowRange(r0, r1), b.rowRange(r0, r1), disparity);
+    for (int y = y0; y < y1; y++) {
+        const short *in = disparity.ptr<short>(y - r0);
+        short *out = raw.ptr<short>(y);
+        for (int x = 0; x < a.cols; x++) {
+            const int m = sign * in[x] / 16;
+            out[x] = (m < lo || m >= lo + num ? invalid : in[x]);
+        }
+    }
+}
+
+// Disparity for one eye. With a prediction, each strip is searched only in a narrow band around its predicted
+// disparities. Strips with too little prediction, too wide a band, or many matches at the band's edges
+// (suggesting the true disparity is outside it) are searched over the full range.
+static void depthMatch(const cv::Mat& a, const cv::Mat& b, int sign, const cv::Mat& predicted, cv::Mat& raw, long& stripsBanded, long& stripsFull) {
+    const int w = a.cols, h = a.rows;
+    raw.create(h, w, CV_16S);
+
+    for (int y0 = 0; y0 < h; y0 += DEPTH_STRIP_ROWS) {
+        const int y1 = std::min(y0 + DEPTH_STRIP_ROWS, h);
+        const int area = w * (y1 - y0);
+        bool full = true;
+
+        if (!predicted.empty()) {
+            // Robust range of predicted disparities in the strip, from a histogram.
+            int hist[DEPTH_NUM_DISPARITIES] = {0};
+            int count = 0;
+            for (int y = y0; y < y1; y++) {
+                const float *p = predicted.ptr<float>(y);
+                for (int x = 0; x < w; x++) {
+                    if (p[x] <= 0.0f) continue;
+                    hist[std::min(int(p[x]), DEPTH_NUM_DISPARITIES - 1)]++;
+                    count++;
+                }
+            }
+            if (count >= DEPTH_MIN_COVERAGE * area) {
+                int lo = 0, hi = DEPTH_NUM_DISPARITIES - 1, sum = 0;
+                while (sum + hist[lo] <= count / 50) sum += hist[lo++];
+                sum = 0;
+                while (sum + hist[hi] <= count / 50) sum += hist[hi--];
+                lo = std::max(lo - DEPTH_BAND_MARGIN, 0);
+                hi = std::min(hi + 1 + DEPTH_BAND_MARGIN, DEPTH_NUM_DISPARITIES - 1);
+                const int num = (hi - lo + 1 + 15) / 16 * 16; // StereoSGBM requires a multiple of 16.
+                if (num <= DEPTH_BAND_MAX) {
+                    lo = std::min(lo, DEPTH_NUM_DISPARITIES - num);
+                    depthMatchStrip(a, b, sign, y0, y1, lo, num, raw);
+
+                    int matched = 0, edge = 0;
+                    for (int y = y0; y < y1; y++) {
+                        const short *r = raw.ptr<short>(y);
+                        for (int x = 0; x < w; x++) {
+                            const int m = sign * r[x] / 16;
+                            if (m < lo || m >= lo + num) continue;
+                            matched++;
+                            if ((lo > 0 && m == lo) || (lo + num < DEPTH_NUM_DISPARITIES && m == lo + num - 1)) edge++;
+                        }
+                    }
+                    full = (matched < count / 2 || edge * 10 > matched);
+                }
+            }
+        }
+
+        if (full) {
+            depthMatchStrip(a, b, sign, y0, y1, 0, DEPTH_NUM_DISPARITIES, raw);
+            stripsFull++;
+        } else {
+            stripsBanded++;
+        }
+    }
+}
+
+// Compute view space maps for both eyes. The two eyes' matching, filtering and reprojection run concurrently.
+static void depthCompute(DepthJob& job, cv::Mat& leftDepthOut, cv::Mat& rightDepthOut, DepthTimings& timings) {
+    const int width = job.width, height = job.height;
+    // Preprocessed by drawUpdate().
+    const DepthFrame& frame = gDepthFrames[job.slot];
+    const cv::Mat& left = frame.rgb[0];
+    const cv::Mat& right = frame.rgb[1];
+    const cv::Mat& leftGray = frame.gray[0];
+    const cv::Mat& rightGray = frame.gray[1];
+    // Disparities are reused between frames; only this thread uses them.
+    static cv::Mat leftDisparity, rightDisparity, leftFilteredDisparity, rightFilteredDisparity;
+    auto t1 = std::chrono::steady_clock::now();
+
+    // Stereo matching. With temporal depth, the previous frame's disparity, moved by the change in pose, limits the search.
+    cv::Mat leftRaw, rightRaw;
+    const bool temporal = job.fullEvery > 0 && gTemporal.valid && gTemporal.raw[0].size() == leftGray.size() && gTemporal.framesSinceFull < job.fullEvery - 1;
+    std::future<void> rightDone;
+    if (temporal) {
+        long stripsBanded[2] = {0}, stripsFull[2] = {0};
+        rightDone = std::async(std::launch::async, [&]{
+            cv::Mat predicted;
+            depthPredict(gTemporal.raw[1], -1, gTemporal.pose[1], job.pose[1], gTemporal.poseValid[1] && job.poseValid[1], predicted);
+            depthMatch(rightGray, leftGray, -1, predicted, rightRaw, stripsBanded[1], stripsFull[1]);
+        });
+        cv::Mat predicted;
+        depthPredict(gTemporal.raw[0], 1, gTemporal.pose[0], job.pose[0], gTemporal.poseValid[0] && job.poseValid[0], predicted);
+        depthMatch(leftGray, rightGray, 1, predicted, leftRaw, stripsBanded[0], stripsFull[0]);
+        rightDone.get();
+        gTemporal.framesSinceFull++;
+        timings.temporal = 1;
+        timings.stripsBanded = stripsBanded[0] + stripsBanded[1];
+        timings.stripsFull = stripsFull[0] + stripsFull[1];
+    } else {
+        rightDone = std::async(std::launch::async, [&]{
+            stereoRight->compute(rightGray, leftGray, rightRaw);
+        });
+        stereoLeft->compute(leftGray, rightGray, leftRaw);
+        rightDone.get();
+        gTemporal.framesSinceFull = 0;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    if (temporal) timings.matchTemporal = std::chrono::duration<double>(t2 - t1).count();
+
+    // Compare the left eye's temporal disparity with a full search.
+    if (temporal && job.validateEvery > 0 && gTemporal.temporalFrames++ % job.validateEvery == 0) {
+        cv::Mat fullRaw;
+        auto tv = std::chrono::steady_clock::now();
+        stereoLeft->compute(leftGray, rightGray, fullRaw);
+        timings.validateFull = std::chrono::duration<double>(std::chrono::steady_clock::now() - tv).count();
+        timings.validateTemporal = std::chrono::duration<double>(t2 - t1).count();
+        long n = 0, bad = 0;
+        double error = 0.0;
+        for (int y = 0; y < leftRaw.rows; y++) {
+            const short *r = leftRaw.ptr<short>(y), *f = fullRaw.ptr<short>(y);
+            for (int x = 0; x < leftRaw.cols; x++) {
+                if (r[x] < 0 || f[x] < 0) continue;
+                const float e = fabsf(float(r[x] - f[x])) / 16.0f;
+                error += e;
+                if (e > 1.0f) bad++;
+                n++;
+            }
+        }
+        timings.validated = 1;
+        timings.validateError = (n ? error / n : 0.0);
+        timings.validateBad = (n ? double(bad) / n : 0.0);
+    }
+
+    gTemporal.valid = true;
+    gTemporal.raw[0] = leftRaw;
+    gTemporal.raw[1] = rightRaw;
+    for (int i = 0; i <= 1; i++) {
+        gTemporal.poseValid[i] = job.poseValid[i];
+        if (job.poseValid[i]) mtxLoadMatrixf(gTemporal.pose[i], job.pose[i]);
+    }
+
+    leftRaw.convertTo(leftDisparity, CV_32F, 1.0 / 16.0);
+    rightRaw.convertTo(rightDisparity, CV_32F, 1.0 / 16.0);
 
     // Disparity filtering
+    rightDone = std::async(std::launch::async, [&]{
+        wlsFilterRight->filter(rightDisparity, right, rightFilteredDisparity, leftDisparity);
+    });
     wlsFilterLeft->filter(leftDisparity, left, leftFilteredDisparity, rightDisparity);
-    wlsFilterRight->filter(rightDisparity, right, rightFilteredDisparity, leftDisparity);
+    rightDone.get();
+    auto t3 = std::chrono::steady_clock::now();
 
     // Save disparity maps
     // cv::imwrite("disparityFL.jpg", leftFilteredDisparity);
@@ -366,13 +827,18 @@ void drawUpdate(int width, int height, int contentWidth, int contentHeight, std:
         0.0f, 0.0f, 0.895f * -1.0f / baseline, 0.0f
     };
     cv::Mat Q(4, 4, CV_32F, QData);
-    cv::reprojectImageTo3D(leftFilteredDisparity, leftDepth, Q);
-    cv::reprojectImageTo3D(-rightFilteredDisparity, rightDepth, Q);
+    rightDone = std::async(std::launch::async, [&]{
+        rightFilteredDisparity *= -1.0;
+        cv::reprojectImageTo3D(rightFilteredDisparity, rightDepthOut, Q);
+    });
+    cv::reprojectImageTo3D(leftFilteredDisparity, leftDepthOut, Q);
+    rightDone.get();
     // depth = focal * baseline / disparity;
+    auto t4 = std::chrono::steady_clock::now();
 
-    // auto now = std::chrono::system_clock::now();
-    // auto elapsed = now - start;
-    // printf("Disparity: %d\n", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+    timings.match = std::chrono::duration<double>(t2 - t1).count();
+    timings.filter = std::chrono::duration<double>(t3 - t2).count();
+    timings.reproject = std::chrono::duration<double>(t4 - t3).count();
 }
 
 // Prepare framebuffer for rendering of real image
@@ -382,6 +848,16 @@ void drawPrepare() {
 }
 
 void drawCleanup() {
+    if (gDepthThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(gDepthLock);
+            gDepthQuit = true;
+            gDepthCond.notify_all();
+        }
+        gDepthThread.join();
+        drawPrintTimings();
+    }
+
 #if HAVE_GLES2 || HAVE_GL3
     if (drawAPI == ARG_API_GLES2 || drawAPI == ARG_API_GL3) {
         if (program) {
@@ -404,6 +880,15 @@ void drawCleanup() {
                 glDeleteTextures(2, gFBOTextures);
                 glDeleteFramebuffers(2, gFBOs);
             }
+            if (gSATFBOs[0]) {
+                glDeleteTextures(2, gSATTextures);
+                glDeleteFramebuffers(2, gSATFBOs);
+                gSATFBOs[0] = gSATFBOs[1] = 0;
+            }
+            if (satProgram) {
+                glDeleteProgram(satProgram);
+                satProgram = 0;
+            }
         }
 #endif // HAVE_GL3
     }
@@ -610,7 +1095,8 @@ void draw(size_t index, int width, int height, int contentWidth, int contentHeig
     glEnable(GL_DEPTH_TEST);
 
     size_t poseIndex = 0;
-    std::vector<float> modelDepth(contentWidth * contentHeight * 4);
+    bool modelDrawn = false;
+    if (gModelDepthGPU) gModelDepth.assign(contentWidth * contentHeight * 4, 0.0f);
     if (visible) {
         for (int i = 0; i < DRAW_MODELS_MAX; i++) {
             if (i == index && gModelLoaded[i] && gModelVisbilities[i]) {
@@ -618,21 +1104,41 @@ void draw(size_t index, int width, int height, int contentWidth, int contentHeig
                 glUseProgram(program);
                 drawModel(&(gModelPoses[i][0]), 0);
 
-                // Draw view space coordinates of virtual model
-                glUseProgram(depthProgram);
-                glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[2]);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-                drawModel(&(gModelPoses[i][0]), 1);
-                glReadPixels(0, 0, contentWidth, contentHeight, GL_RGBA, GL_FLOAT, modelDepth.data());
+                // View space coordinates of virtual model
+                if (gModelDepthGPU) {
+                    glUseProgram(depthProgram);
+                    glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[2]);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    drawModel(&(gModelPoses[i][0]), 1);
+                    glReadPixels(0, 0, contentWidth, contentHeight, GL_RGBA, GL_FLOAT, gModelDepth.data());
+                } else {
+                    float modelMatrix[16], modelView[16];
+                    drawModelMatrix(modelMatrix);
+                    mtxLoadMatrixf(modelView, gModelPoses[i]);
+                    mtxMultMatrixf(modelView, modelMatrix);
+                    gModelDepthRaster.render(mVertices.data(), mVertices.size() / 3, model.Indices.data(), model.Indices.size(), modelView, gProjection, contentWidth, contentHeight, gModelDepth);
+                }
 
                 poseIndex = i;
+                modelDrawn = true;
                 break;
             }
         }
     }
+    if (!modelDrawn && !gModelDepthGPU) {
+        gModelDepthRaster.render(mVertices.data(), 0, NULL, 0, gView, gProjection, contentWidth, contentHeight, gModelDepth); // Clears the buffer.
+    }
 
     // Post processing step (stylization)
-    drawPost(index, &(gModelPoses[poseIndex][0]), modelDepth, width, height, contentWidth, contentHeight);
+    drawPost(index, &(gModelPoses[poseIndex][0]), gModelDepth, width, height, contentWidth, contentHeight);
+}
+
+// Model to marker transform of the virtual model.
+static void drawModelMatrix(float modelMatrix[16]) {
+    mtxLoadIdentityf(modelMatrix);
+    mtxScalef(modelMatrix, 0.05f, 0.05f, 0.05f);
+    mtxRotatef(modelMatrix, 90.0f, 1.0f, 0.0f, 0.0f);
+    mtxTranslatef(modelMatrix, 0.0f, 1.25f, 0.0f);
 }
 
 static void drawModel(float pose[16], size_t uniform_index) {
@@ -663,10 +1169,7 @@ static void drawModel(float pose[16], size_t uniform_index) {
 
 #if HAVE_GLES2 || HAVE_GL3
     if (drawAPI == ARG_API_GLES2 || drawAPI == ARG_API_GL3) {
-        mtxLoadIdentityf(modelMatrix);
-        mtxScalef(modelMatrix, 0.05f, 0.05f, 0.05f);
-        mtxRotatef(modelMatrix, 90.0f, 1.0f, 0.0f, 0.0f);
-        mtxTranslatef(modelMatrix, 0.0f, 1.25f, 0.0f);
+        drawModelMatrix(modelMatrix);
         glUniformMatrix4fv(uniforms[uniform_index][UNIFORM_VIEW_MATRIX], 1, GL_FALSE, pose);
         glUniformMatrix4fv(uniforms[uniform_index][UNIFORM_MODEL_MATRIX], 1, GL_FALSE, modelMatrix);
         glUniformMatrix4fv(uniforms[uniform_index][UNIFORM_PROJECTION_MATRIX], 1, GL_FALSE, gProjection);
@@ -728,6 +1231,31 @@ static void drawModel(float pose[16], size_t uniform_index) {
 #endif
 }
 
+#if HAVE_GL3
+// Build the summed-area table of the density rendering in gFBOTextures[1] (its lower left width x height texels) by
+// recursive doubling, alternating between the two SAT targets. Returns the texture holding the table.
+static GLuint drawDensitySAT(int width, int height) {
+    GLuint source = gFBOTextures[1];
+    int target = 0;
+    glUseProgram(satProgram);
+    glViewport(0, 0, width, height);
+    glDisable(GL_BLEND);
+    auto pass = [&](int dx, int dy) {
+        glBindFramebuffer(GL_FRAMEBUFFER, gSATFBOs[target]);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glUniform2i(uniforms[0][UNIFORM_STRIDE], dx, dy);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        source = gSATTextures[target];
+        target = 1 - target;
+    };
+    pass(0, 0);
+    for (int stride = 1; stride < width; stride *= 2) pass(stride, 0);
+    for (int stride = 1; stride < height; stride *= 2) pass(0, stride);
+    glEnable(GL_BLEND); // As drawPattern() left it, for the density pass.
+    return source;
+}
+#endif
+
 static void drawPost(size_t index, const float pose[16], const std::vector<float>& modelDepth, int width, int height, int contentWidth, int contentHeight) {
     const GLfloat vertices [6][2] = {
         {-1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f},
@@ -742,6 +1270,7 @@ static void drawPost(size_t index, const float pose[16], const std::vector<float
             const char *resourcesDir = arUtilGetResourcesDirectoryPath(
                 AR_UTIL_RESOURCES_DIRECTORY_BEHAVIOR_BEST);
             const std::string voronoiString = std::string(resourcesDir) + "/voronoi.frag";
+            const std::string satString = std::string(resourcesDir) + "/sat.frag";
             const std::string fragPathGLES2 = std::string(resourcesDir) + "/shaderES2.frag";
 
             const char vertShaderStringGLES2[] =
@@ -770,6 +1299,15 @@ static void drawPost(size_t index, const float pose[16], const std::vector<float
 
             uniforms[0][UNIFORM_WIDTH] = glGetUniformLocation(postProgram, "width");
             uniforms[0][UNIFORM_HEIGHT] = glGetUniformLocation(postProgram, "height");
+
+            if (drawAPI == ARG_API_GL3) {
+                satProgram = loadShaderProgram(NULL, vertShaderStringGL3, satString.c_str(), NULL);
+
+                glBindAttribLocation(satProgram, ATTRIBUTE_VERTEX, "position");
+                glBindAttribLocation(satProgram, ATTRIBUTE_NORMAL, "texCoord");
+
+                uniforms[0][UNIFORM_STRIDE] = glGetUniformLocation(satProgram, "stride");
+            }
         }
     }
 #  if HAVE_GLES2
@@ -813,183 +1351,104 @@ static void drawPost(size_t index, const float pose[16], const std::vector<float
 #  if !BASELINE // This boolean determines whether to run anchor repositioning and density redistribution
     voronoi[index]->updateDepth(depth, modelDepth, pose, gProjection, width, height, contentWidth, contentHeight);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[1]);
-    glBindTexture(GL_TEXTURE_2D, gFBOTextures[0]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    voronoi[index]->drawPattern(true);
+    // Density is maintained once per stereo frame, by the eye that owns the shared anchors.
+    if (voronoi[index]->ownsAnchors()) {
+        glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[1]);
+        glBindTexture(GL_TEXTURE_2D, gFBOTextures[0]);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        voronoi[index]->drawPattern(true);
 
 #   if HAVE_GL3
-    glBindVertexArray(gQuadVAO);
-    glUseProgram(postProgram);
+        if (!gDensityCPU && drawAPI == ARG_API_GL3) {
+            glBindVertexArray(gQuadVAO);
+            glBindTexture(GL_TEXTURE_2D, drawDensitySAT(contentWidth, contentHeight));
+            glUseProgram(postProgram);
+            glUniform1f(uniforms[0][UNIFORM_WIDTH], float(contentWidth));
+            glUniform1f(uniforms[0][UNIFORM_HEIGHT], float(contentHeight));
+            voronoi[index]->updateDensity(postProgram, depth, modelDepth, pose, width, height, contentWidth, contentHeight);
+        } else
 #   endif
-
-    glUniform1f(uniforms[0][UNIFORM_WIDTH], float(contentWidth));
-    glUniform1f(uniforms[0][UNIFORM_HEIGHT], float(contentHeight));
-    glBindTexture(GL_TEXTURE_2D, gFBOTextures[1]);
-    voronoi[index]->updateDensity(postProgram, depth, modelDepth, pose, width, height, contentWidth, contentHeight);
+        {
+            gDensityPixels.resize(size_t(contentWidth) * contentHeight * 4);
+            glReadPixels(0, 0, contentWidth, contentHeight, GL_RGBA, GL_UNSIGNED_BYTE, gDensityPixels.data());
+            gDensitySAT.build(gDensityPixels.data(), contentWidth, contentHeight, 4);
+            voronoi[index]->updateDensity(gDensitySAT, depth, modelDepth, pose, width, height, contentWidth, contentHeight);
+        }
+    }
 #  endif
 
     glViewport(gViewport[0] + gViewport[2] / 2 * index, gViewport[1], gViewport[2] / 2, gViewport[3]);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, gFBOTextures[0]);
-
-    voronoi[index]->drawPattern(false);
+#  if HAVE_GL3
+    if (gVoronoiCPU && drawAPI == ARG_API_GL3) {
+        // Read back the frame, render the pattern into the (free, after the density pass) second frame texture,
+        // and blit that into this eye's viewport. Pixels no anchor covers keep the clear colour, as with the cones.
+        const int w = gFrameSize[0], h = gFrameSize[1];
+        gCPUFrame.resize(size_t(w) * h * 4);
+        gCPUPattern.resize(size_t(w) * h * 4);
+        glBindFramebuffer(GL_FRAMEBUFFER, gFBOs[0]);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, gCPUFrame.data());
+
+        GLfloat clear[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+        uint32_t clearColor = 0;
+        for (int k = 0; k < 4; k++) clearColor |= uint32_t(std::min(std::max(clear[k], 0.0f), 1.0f) * 255.0f + 0.5f) << (k * 8);
+        std::fill((uint32_t *)gCPUPattern.data(), (uint32_t *)gCPUPattern.data() + size_t(w) * h, clearColor);
+        voronoi[index]->drawPatternCPU(gCPUFrame.data(), w, h, gCPUPattern.data(), w, h);
+
+        glBindTexture(GL_TEXTURE_2D, gFBOTextures[1]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, gCPUPattern.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gFBOs[1]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, w, h, gViewport[0] + gViewport[2] / 2 * index, gViewport[1], gViewport[0] + gViewport[2] / 2 * (index + 1), gViewport[1] + gViewport[3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    } else
+#  endif
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, gFBOTextures[0]);
 
-# if false // This boolean determines whether to run the quantitative measurement or not
-    std::vector<unsigned char> pixels(contentWidth * contentHeight * 4);
-    glReadPixels(gViewport[0] + gViewport[2] / 2 * index, gViewport[1], contentWidth, contentHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        voronoi[index]->drawPattern(false);
+    }
 
-    // Compare pixels with the same world positions from last frame
-    float viewInv[16];
-    invertMatrix(pose, viewInv);
-    if (!worldPositions[index].empty()) {
-        // Change 0 to 1 for visual coherence
-        const size_t newIndex = (index + 1) % 2;
-        std::vector<float> differencesRaw;
-        differencesRaw.reserve(contentWidth * contentHeight);
-        float count = 0.0f;
+    // Record the stylized image, the view space position at each pixel and the pose, for offline coherence measurement
+    if (!gRecordDirectory.empty()) {
+        std::vector<unsigned char> pixels(contentWidth * contentHeight * 4);
+        glReadPixels(gViewport[0] + gViewport[2] / 2 * index, gViewport[1], contentWidth, contentHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
 
+        CoherenceFrame frame;
+        frame.width = contentWidth;
+        frame.height = contentHeight;
+        frame.rgb.resize(contentWidth * contentHeight * 3);
+        frame.viewPos.resize(contentWidth * contentHeight * 3);
         for (size_t i = 0; i < contentHeight; i++) {
             for (size_t j = 0; j < contentWidth; j++) {
-                const size_t index2 = i * contentWidth + j;
-                const float worldPos[4] = {
-                    worldPositions[newIndex][index2][0],
-                    worldPositions[newIndex][index2][1],
-                    worldPositions[newIndex][index2][2],
-                    1.0f,
-                };
-                float viewPos[4];
-                transformVector(worldPos, pose, viewPos);
-
-                for (int j = 0; j < 4; j++) {
-                    viewPos[j] /= viewPos[3];
-                }
-
-                float imagePos[4];
-                transformVector(viewPos, gProjection, imagePos);
-
-                for (int j = 0; j < 4; j++) {
-                    imagePos[j] /= imagePos[3];
-                }
-
-                const float x = (imagePos[0] + 1.0f) / 2.0f;
-                const float y = 1.0f - (imagePos[1] + 1.0f) / 2.0f;
-                if (isnan(x) || isnan(y) || isinf(x) || isinf(y) || x < 0.0f || y < 0.0f || x >= 1.0f || y >= 1.0f) {
-                    differencesRaw.push_back(-1.0f);
-                    continue;
-                }
+                const size_t index2 = i * contentWidth + j; // OpenGL rows are bottom to top.
+                const size_t outIndex = (contentHeight - i - 1) * contentWidth + j;
+                const float x = float(j) / float(contentWidth);
+                const float y = float(contentHeight - i - 1) / float(contentHeight);
 
-                const size_t modelIndex = ((contentHeight - int(y * float(contentHeight)) - 1) * contentWidth + int(x * float(contentHeight))) * 4;
                 cv::Vec3f v = cv::Vec3f(0.0f, 0.0f, 0.0f);
-
-                if (modelIndex < modelDepth.size() - 2) {
+                if (index2 * 4 < modelDepth.size() - 2) {
                     v = cv::Vec3f(
-                        modelDepth[modelIndex + 0],
-                        modelDepth[modelIndex + 1],
-                        modelDepth[modelIndex + 2]
+                        modelDepth[index2 * 4 + 0],
+                        modelDepth[index2 * 4 + 1],
+                        modelDepth[index2 * 4 + 2]
                     );
                 }
 
                 if (v[0] == 0.0f && v[1] == 0.0f && v[2] == 0.0f) {
-                    const size_t ix = int(x * float(width));
-                    const size_t iy = int(y * float(height));
-                    v = depth.at<cv::Vec3f>(iy, ix);
+                    v = depth.at<cv::Vec3f>(int(y * float(height)), int(x * float(width)));
                 }
 
-                if (cv::norm(v, cv::Vec3f(viewPos), cv::NORM_L2) <= 0.1f) {
-                    const size_t ix = int(x * float(contentWidth));
-                    const size_t iy = contentHeight - int(y * float(contentHeight)) - 1;
-                    const cv::Vec3b color = colors[newIndex][index2];
-                    const size_t pixelIndex = (iy * contentWidth + ix) * 4;
-                    const float value = cv::norm(cv::Vec3f(color) / 255.0, cv::Vec3f(pixels[pixelIndex + 0], pixels[pixelIndex + 1], pixels[pixelIndex + 2]) / 255.0, cv::NORM_L2);
-                    differencesRaw.push_back(value);
-                    count += value;
-                } else {
-                    differencesRaw.push_back(-1.0f);
+                for (int k = 0; k < 3; k++) {
+                    frame.rgb[outIndex * 3 + k] = pixels[index2 * 4 + k];
+                    frame.viewPos[outIndex * 3 + k] = v[k];
                 }
             }
         }
-
-#  if true // Constant normalization factor for visualization
-        float normFactor = 0.1f;
-#  else // Non-constant normalization factor based on maximum of 3 standard deviations from the mean
-        const float mean = count / float(contentWidth * contentHeight);
-        float sd = 0.0f;
-        for (float x : differencesRaw) {
-            if (x == -1.0f) {
-                continue;
-            }
-            sd += (x - mean) * (x - mean);
-        }
-
-        sd /= float(contentWidth * contentHeight - 1);
-
-        for (float x : differencesRaw) {
-            if (x == -1.0f || x - mean > 3 * sd) {
-                continue;
-            }
-            normFactor = std::max(normFactor, x);
-        }
-#  endif
-
-        printf("Index %d: %f\n", index, count);
-        std::vector<cv::Vec3b> differences;
-        differences.reserve(contentWidth * contentHeight);
-        for (size_t i = 0; i < contentHeight; i++) {
-            for (size_t j = 0; j < contentWidth; j++) {
-                const float diff = differencesRaw[(contentHeight - i - 1) * contentWidth + j];
-                if (diff == -1.0f) {
-                    differences.push_back(cv::Vec3b(0, 255, 0));
-                } else {
-                    differences.push_back(cv::Vec3b(0, 0, int(diff / normFactor * 256.0f)));
-                }
-            }
-        }
-
-        // Save pixel difference images
-        // cv::Mat diffImage(contentHeight, contentWidth, CV_8UC3, differences.data());
-        // if (index == 0) {
-        //     cv::imwrite("differenceL.jpg", diffImage);
-        // } else {
-        //     cv::imwrite("differenceR.jpg", diffImage);
-        // }
-    }
-
-    // Save pixel world positions for current frame
-    worldPositions[index].resize(contentWidth * contentHeight);
-    colors[index].resize(contentWidth * contentHeight);
-    for (size_t i = 0; i < contentHeight; i++) {
-        for (size_t j = 0; j < contentWidth; j++) {
-            const size_t index2 = i * contentWidth + j;
-            const float x = float(j) / float(contentWidth);
-            const float y = float(contentHeight - i - 1) / float(contentHeight);
-
-            cv::Vec3f v = cv::Vec3f(0.0f, 0.0f, 0.0f);
-            if (index2 * 4 < modelDepth.size() - 2) {
-                v = cv::Vec3f(
-                    modelDepth[index2 * 4 + 0],
-                    modelDepth[index2 * 4 + 1],
-                    modelDepth[index2 * 4 + 2]
-                );
-            }
-
-            if (v[0] == 0.0f && v[1] == 0.0f && v[2] == 0.0f) {
-                v = depth.at<cv::Vec3f>(int(y * float(height)), int(x * float(width)));
-            }
-
-            const float P[4] = {
-                v[0],
-                v[1],
-                v[2],
-                1.0f
-            };
-            float worldPos[4];
-            transformVector(P, viewInv, worldPos);
-            colors[index][index2] = cv::Vec3b(pixels[index2 * 4 + 0], pixels[index2 * 4 + 1], pixels[index2 * 4 + 2]);
-            worldPositions[index][index2] = cv::Vec3f(worldPos[0], worldPos[1], worldPos[2]);
-        }
+        drawRecordFrame(index, frame, pose);
     }
-# endif
+
 
     glBindTexture(GL_TEXTURE_2D, 0);
 #endif
@@ -51,8 +51,25 @@ void drawInit();
 void drawToggleModels();
 // Recreate OpenGL context and buffers
 void drawSetup(ARG_API drawAPI_in, bool rotate90_in, bool flipH_in, bool flipV_in, int width, int height);
-// Update objects requiring frame data (disparity/view space maps)
+// Update objects requiring frame data (disparity/view space maps). Depth is computed on a separate thread;
+// returns once depth no more than the maximum latency (in frames) behind this frame is available.
 void drawUpdate(int width, int height, int contentWidth, int contentHeight, std::vector<unsigned char> frames[2]);
+// Set the number of frames by which depth may lag the rendered frame. 0 waits for the current frame's depth.
+void drawSetDepthMaxLatency(int frames);
+// Predict disparity from the previous frame and the change in marker pose, and search only a narrow band around it.
+// A full search is made every fullEvery frames (0 disables temporal depth), and every validateEvery temporal frames
+// the result is compared against a full search (0 disables).
+void drawSetTemporalDepth(int fullEvery, int validateEvery);
+// Record each eye's stylized image, view space positions and pose to directory, for benchCoherence. NULL stops recording.
+void drawSetRecordDirectory(const char *directory);
+// Render the Voronoi pattern on the CPU (multi-threaded nearest-anchor search) instead of with instanced cones. Default false.
+void drawSetVoronoiCPU(bool cpu);
+// Compute Voronoi cell densities on the CPU from the read back density rendering, rather than in a shader. Default false.
+void drawSetDensityCPU(bool cpu);
+// Render the model's view space positions with OpenGL and read them back, instead of rasterizing them on the CPU. Default false.
+void drawSetModelDepthGPU(bool gpu);
+// Print per-stage depth timings and the time rendering waited for depth
+void drawPrintTimings();
 // Enable framebuffer and viewport for capturing frames and virtual models on a texture
 void drawPrepare();
 // Load virtual models
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <ARX/AR/config.h>
+
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h>
+#endif
+
+// Stereo matching input from a captured RGBA frame, in one pass: the frame as RGB (the guide image for disparity
+// filtering) and at half resolution in gray. Each gray pixel is the luma of the mean colour of a 2x2 block, with
+// OpenCV's RGB2GRAY fixed point weights; this is within one level of converting to gray and then resizing by 0.5
+// with INTER_LINEAR_EXACT. For an odd width or height the last column or row is left out of the gray image.
+
+// Luma weights, scaled by 1 << 14.
+#define FRAME_GRAY_R 4899
+#define FRAME_GRAY_G 9617
+#define FRAME_GRAY_B 1868
+
+// One pair of rows: row0 and row1 (width RGBA pixels each) to rgb0 and rgb1, and gray (width / 2 pixels).
+static inline void framePreprocessRows(const unsigned char *row0, const unsigned char *row1, int width, unsigned char *rgb0, unsigned char *rgb1, unsigned char *gray) {
+    int x = 0;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    for (; x + 8 <= width; x += 8) {
+        const uint8x8x4_t a = vld4_u8(row0 + x * 4), b = vld4_u8(row1 + x * 4);
+        uint8x8x3_t c;
+        c.val[0] = a.val[0];
+        c.val[1] = a.val[1];
+        c.val[2] = a.val[2];
+        vst3_u8(rgb0 + x * 3, c);
+        c.val[0] = b.val[0];
+        c.val[1] = b.val[1];
+        c.val[2] = b.val[2];
+        vst3_u8(rgb1 + x * 3, c);
+        // Channel sums over four 2x2 blocks.
+        const uint16x4_t r = vpadal_u8(vpaddl_u8(a.val[0]), b.val[0]);
+        const uint16x4_t g = vpadal_u8(vpaddl_u8(a.val[1]), b.val[1]);
+        const uint16x4_t bl = vpadal_u8(vpaddl_u8(a.val[2]), b.val[2]);
+        uint32x4_t y = vmull_n_u16(r, FRAME_GRAY_R);
+        y = vmlal_n_u16(y, g, FRAME_GRAY_G);
+        y = vmlal_n_u16(y, bl, FRAME_GRAY_B);
+        const uint16x4_t y16 = vrshrn_n_u32(y, 16); // Weights' 1 << 14, and the mean of four.
+        vst1_lane_u32((uint32_t *)(gray + x / 2), vreinterpret_u32_u8(vmovn_u16(vcombine_u16(y16, y16))), 0);
+    }
+#elif HAVE_INTEL_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(FRAME_GRAY_R, FRAME_GRAY_G, FRAME_GRAY_B, 0, FRAME_GRAY_R, FRAME_GRAY_G, FRAME_GRAY_B, 0);
+    const __m128i round = _mm_set1_epi32(1 << 15);
+    for (; x + 4 <= width; x += 4) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(row0 + x * 4)), b = _mm_loadu_si128((const __m128i *)(row1 + x * 4));
+        // Channel sums over two 2x2 blocks, as 16-bit RGBA.
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)); // Pixels x and x + 1.
+        const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)); // Pixels x + 2 and x + 3.
+        const __m128i sums = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        __m128i y = _mm_madd_epi16(sums, weights);    // R and G terms, B term, for each block.
+        y = _mm_add_epi32(y, _mm_srli_epi64(y, 32));  // Luma in 32-bit lanes 0 and 2.
+        y = _mm_srli_epi32(_mm_add_epi32(y, round), 16);
+        gray[x / 2] = (unsigned char)_mm_cvtsi128_si32(y);
+        gray[x / 2 + 1] = (unsigned char)_mm_extract_epi16(y, 4);
+        // Whole pixels, each alpha overwritten by the next pixel's red, and the last pixel's RGB.
+        std::memcpy(rgb0 + x * 3, row0 + x * 4, 4);
+        std::memcpy(rgb0 + x * 3 + 3, row0 + x * 4 + 4, 4);
+        std::memcpy(rgb0 + x * 3 + 6, row0 + x * 4 + 8, 4);
+        std::memcpy(rgb0 + x * 3 + 9, row0 + x * 4 + 12, 3);
+        std::memcpy(rgb1 + x * 3, row1 + x * 4, 4);
+        std::memcpy(rgb1 + x * 3 + 3, row1 + x * 4 + 4, 4);
+        std::memcpy(rgb1 + x * 3 + 6, row1 + x * 4 + 8, 4);
+        std::memcpy(rgb1 + x * 3 + 9, row1 + x * 4 + 12, 3);
+    }
+#endif
+    for (; x < width; x++) {
+        for (int c = 0; c < 3; c++) {
+            rgb0[x * 3 + c] = row0[x * 4 + c];
+            rgb1[x * 3 + c] = row1[x * 4 + c];
+        }
+        if (x & 1) {
+            const unsigned char *p = row0 + (x - 1) * 4, *q = row1 + (x - 1) * 4;
+            const uint32_t r = p[0] + p[4] + q[0] + q[4], g = p[1] + p[5] + q[1] + q[5], b = p[2] + p[6] + q[2] + q[6];
+            gray[x / 2] = (unsigned char)((r * FRAME_GRAY_R + g * FRAME_GRAY_G + b * FRAME_GRAY_B + (1 << 15)) >> 16);
+        }
+    }
+}
+
+// rgba is width x height; rgb must hold width x height and grayHalf (width / 2) x (height / 2) pixels, rows contiguous.
+static inline void framePreprocess(const unsigned char *rgba, int width, int height, unsigned char *rgb, unsigned char *grayHalf) {
+    int y = 0;
+    for (; y + 2 <= height; y += 2) {
+        framePreprocessRows(rgba + size_t(y) * width * 4, rgba + size_t(y + 1) * width * 4, width,
+                            rgb + size_t(y) * width * 3, rgb + size_t(y + 1) * width * 3, grayHalf + size_t(y / 2) * (width / 2));
+    }
+    if (y < height) {
+        const unsigned char *p = rgba + size_t(y) * width * 4;
+        unsigned char *q = rgb + size_t(y) * width * 3;
+        for (int x = 0; x < width; x++, p += 4, q += 3) {
+            q[0] = p[0];
+            q[1] = p[1];
+            q[2] = p[2];
+        }
+    }
+}
@@ -79,6 +79,13 @@ const char *vconfl = NULL;
 const char *vconfr = NULL;
 #endif
 const char *cpara = NULL;
+static int depthLatency = -1;
+static int temporalDepth = 0;
+static int depthValidate = 0;
+static const char *recordDirectory = NULL;
+static bool voronoiCPU = false;
+static bool densityCPU = false;
+static bool modelDepthGPU = false;
 
 // Window and GL context.
 static SDL_GLContext gSDLContext = NULL;
@@ -249,11 +256,18 @@ int main(int argc, char *argv[]) {
   arControllers[1]->startRunning(vconfr, cpara, NULL, 0);
 
   drawInit();
+  if (depthLatency >= 0) drawSetDepthMaxLatency(depthLatency);
+  if (temporalDepth > 0) drawSetTemporalDepth(temporalDepth, depthValidate);
+  if (recordDirectory) drawSetRecordDirectory(recordDirectory);
+  if (voronoiCPU) drawSetVoronoiCPU(true);
+  if (densityCPU) drawSetDensityCPU(true);
+  if (modelDepthGPU) drawSetModelDepthGPU(true);
 
   bool paused = true;
   bool firstFrame = true;
   int width, height;
   int contentWidth, contentHeight;
+  std::vector<unsigned char> frames[2]; // Captured RGBA frames, reused between frames.
 
   // Main loop.
   bool done = false;
@@ -288,6 +302,9 @@ int main(int argc, char *argv[]) {
         if (ev.key.keysym.sym == SDLK_v) {
           drawToggleModels();
         }
+        if (ev.key.keysym.sym == SDLK_t) {
+          drawPrintTimings();
+        }
         if (ev.key.keysym.sym == SDLK_SPACE) {
           paused = !paused;
         }
@@ -369,10 +386,8 @@ int main(int argc, char *argv[]) {
         contextWasUpdated = false;
       }
 
-      std::vector<unsigned char> frames[2];
-
       for (int i = 0; i <= 1; i++) {
-        frames[i].reserve(width * height * 4);
+        frames[i].resize(size_t(width) * height * 4);
         arControllers[i]->updateTextureRGBA32(0, (uint32_t*) frames[i].data());
       }
 
@@ -456,6 +471,22 @@ static void processCommandLineOptions(int argc, char *argv[]) {
         i++;
         cpara = argv[i];
         gotTwoPartOption = TRUE;
+      } else if (strcmp(argv[i], "--depthlatency") == 0) {
+        i++;
+        depthLatency = atoi(argv[i]);
+        gotTwoPartOption = TRUE;
+      } else if (strcmp(argv[i], "--temporaldepth") == 0) {
+        i++;
+        temporalDepth = atoi(argv[i]);
+        gotTwoPartOption = TRUE;
+      } else if (strcmp(argv[i], "--depthvalidate") == 0) {
+        i++;
+        depthValidate = atoi(argv[i]);
+        gotTwoPartOption = TRUE;
+      } else if (strcmp(argv[i], "--record") == 0) {
+        i++;
+        recordDirectory = argv[i];
+        gotTwoPartOption = TRUE;
       }
     }
     if (!gotTwoPartOption) {
@@ -479,6 +510,12 @@ static void processCommandLineOptions(int argc, char *argv[]) {
           arLogLevel = AR_LOG_LEVEL_ERROR;
         else
           usage(argv[0]);
+      } else if (strcmp(argv[i], "--cpuvoronoi") == 0) {
+        voronoiCPU = true;
+      } else if (strcmp(argv[i], "--cpudensity") == 0) {
+        densityCPU = true;
+      } else if (strcmp(argv[i], "--gpumodeldepth") == 0) {
+        modelDepthGPU = true;
       } else {
         ARLOGe("Error: invalid command line argument '%s'.\n", argv[i]);
         usage(argv[0]);
@@ -494,6 +531,13 @@ static void usage(char *com) {
   ARPRINT("  --vconfl <video parameter for the left camera>\n");
   ARPRINT("  --vconfr <video parameter for the right camera>\n");
   ARPRINT("  --cpara <camera parameter file for the camera>\n");
+  ARPRINT("  --depthlatency <frames by which stereo depth may lag the rendered frame, default 1>\n");
+  ARPRINT("  --temporaldepth <frames between full disparity searches; in between, search only around the disparity predicted from the previous frame and pose change. Default 0 (off)>\n");
+  ARPRINT("  --depthvalidate <with --temporaldepth, compare every nth temporal frame against a full search and report the difference and speedup>\n");
+  ARPRINT("  --record <existing directory in which to record stylized frames, depth and poses for benchCoherence>\n");
+  ARPRINT("  --cpuvoronoi: Render the Voronoi pattern on the CPU instead of with instanced cones.\n");
+  ARPRINT("  --cpudensity: Compute Voronoi cell densities on the CPU from the read back density rendering.\n");
+  ARPRINT("  --gpumodeldepth: Render the model's view space positions with OpenGL and read them back, rather than rasterizing them on the CPU.\n");
   ARPRINT("  --version: Print artoolkitX version and exit.\n");
   ARPRINT("  -loglevel=l: Set the log level to l, where l is one of DEBUG INFO "
           "WARN ERROR.\n");
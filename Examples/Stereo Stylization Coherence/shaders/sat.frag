@@ -0,0 +1,24 @@
+#version 150 core
+
+out vec4 fragColor;
+
+// With stride (0, 0), converts the density rendering to coverage in x and emptiness (1 or 0) in y. Otherwise adds the
+// texel stride away to each texel; passes with strides 1, 2, 4, ... along x and then along y give the summed-area table.
+uniform sampler2D source;
+uniform ivec2 stride;
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec2 value;
+    if (stride == ivec2(0)) {
+        float coverage = texelFetch(source, p, 0).x;
+        value = vec2(coverage, coverage <= 10e-6 ? 1.0 : 0.0);
+    } else {
+        value = texelFetch(source, p, 0).xy;
+        ivec2 q = p - stride;
+        if (q.x >= 0 && q.y >= 0) {
+            value += texelFetch(source, q, 0).xy;
+        }
+    }
+    fragColor = vec4(value, 0.0, 0.0);
+}
@@ -1,27 +1,35 @@
 #version 150 core
 
 out vec4 fragColor;
-in vec2 vTexCoord;
 
 uniform float width;
 uniform float height;
-uniform int cellWidth;
-uniform int cellHeight;
+uniform int columns;
+uniform int rows;
 
-uniform sampler2D frame;
+// Summed-area table of the density rendering (see sat.frag): summed coverage in x, count of empty texels in y.
+uniform sampler2D sat;
+
+vec2 sum(int x, int y) {
+    if (x < 0 || y < 0) {
+        return vec2(0.0);
+    }
+    return texelFetch(sat, ivec2(x, y), 0).xy;
+}
 
 void main() {
-    float total = 0.0;
-    for (int i = 0; i < cellWidth; i++) {
-        for (int j = 0; j < cellHeight; j++) {
-            float value = texture(frame, vTexCoord + vec2(float(i) / width, -float(j) / height)).x;
-            if (value <= 10e-6) {
-                fragColor = vec4(0.0);
-                return;
-            }
-            total += value;
-        }
+    // Texels of this cell, [x0, x1) x [y0, y1).
+    ivec2 cell = ivec2(gl_FragCoord.xy);
+    int x0 = cell.x * int(width) / columns;
+    int x1 = (cell.x + 1) * int(width) / columns;
+    int y0 = cell.y * int(height) / rows;
+    int y1 = (cell.y + 1) * int(height) / rows;
+
+    vec2 total = sum(x1 - 1, y1 - 1) - sum(x0 - 1, y1 - 1) - sum(x1 - 1, y0 - 1) + sum(x0 - 1, y0 - 1);
+    if (total.y > 0.5) {
+        fragColor = vec4(0.0);
+        return;
     }
 
-    fragColor = vec4(total / float(cellWidth * cellHeight));
+    fragColor = vec4(total.x / float((x1 - x0) * (y1 - y0)));
 }
@@ -2,6 +2,9 @@
 #include <cstdlib>
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <future>
+#include <thread>
 
 #include <ARX/ARController.h>
 #include <ARX/ARG/mtx.h>
@@ -9,8 +12,17 @@
 #include <opencv2/core.hpp>
 
 #include "OBJ_Loader.h"
+#include "anchorgrid.hpp"
+#include "voronoirender.hpp"
+#include "densitysat.hpp"
 #include "utils.hpp"
 
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h>
+#endif
+
 #if HAVE_GL
 #  if ARX_TARGET_PLATFORM_MACOS
 #    include <OpenGL/gl.h>
@@ -54,13 +66,18 @@ private:
     objl::Mesh model;
 
     std::vector<float> vertices;
-    std::vector<float> offsets;
-    std::vector<float> worldPositions;
+    AnchorArrays anchors;
+    AnchorGrid grid; // Anchors of each cell.
+    std::vector<unsigned char> keep; // Reprojection result for each anchor, reused between frames.
+    std::vector<float> cellDensity;  // Density of each cell, reused between frames.
+    VoronoiRenderer cpuRenderer;
 
     const Voronoi* other;
     static constexpr float EPSILON = 0.2f;
     static constexpr float ALPHA = 0.01f;
     static constexpr float BETA = 0.9f;
+    static constexpr size_t REPROJECT_BLOCK = 256;          // Anchors projected together before their depth tests.
+    static constexpr size_t REPROJECT_THREAD_MIN = 8192;    // Anchors per thread below which reprojection is not split.
 
     // Load programs for rendering Voronoi diagram
     void loadPrograms(ARG_API drawAPI) {
@@ -122,9 +139,14 @@ private:
         uniforms[1] = glGetUniformLocation(program, "density");
     }
 
+    // Cone radius in normalized device coordinates
+    float coneScale() const {
+        return 3.0f / float(std::max(m, n));
+    }
+
     // Load OpenGL and buffers
     void loadGL(ARG_API drawAPI) {
-        const float scale = 3.0f / float(std::max(m, n));
+        const float scale = coneScale();
         mtxLoadIdentityf(transform);
         mtxRotatef(transform, -90.0f, 1.0f, 0.0f, 0.0f);
         mtxScalef(transform, scale, 0.5f, scale);
@@ -178,7 +200,7 @@ private:
     }
 
     // Get model view space depth at screen position
-    cv::Vec3f getModelDepth(const std::vector<float>& modelDepth, float x, float y, int contentWidth, int contentHeight) {
+    cv::Vec3f getModelDepth(const std::vector<float>& modelDepth, float x, float y, int contentWidth, int contentHeight) const {
         const size_t modelIndex = (int((1.0f - y) * float(contentHeight)) * contentWidth + int(x * float(contentHeight))) * 4;
         if (modelIndex > modelDepth.size()) {
             return cv::Vec3f(0.0f, 0.0f, 0.0f);
@@ -192,7 +214,7 @@ private:
     }
 
     // Get world position at screen position, either by converting model view space or estimated stereo view space to world position
-    void getWorldPosition(float x, float y, float worldPos[4], const cv::Mat& depth, const std::vector<float> &modelDepth, int width, int height, int contentWidth, int contentHeight, const float viewInv[16]) {
+    void getWorldPosition(float x, float y, float worldPos[4], const cv::Mat& depth, const std::vector<float> &modelDepth, int width, int height, int contentWidth, int contentHeight, const float viewInv[16]) const {
         cv::Vec3f v = getModelDepth(modelDepth, x, y, contentWidth, contentHeight);
         if (v[0] == 0.0f && v[1] == 0.0f && v[2] == 0.0f) {
             v = depth.at<cv::Vec3f>(int(y * float(height)), int(x * float(width)));
@@ -206,13 +228,115 @@ private:
         transformVector(P, viewInv, worldPos);
     }
 
+    // Project the world positions of source anchors [begin, end) with view matrix V and combined projection and view
+    // matrix PV (both column-major, V affine). Anchors landing inside the image at a view space position within EPSILON
+    // of the depth there get keep set and their image position written to the same index of offsets; others get keep
+    // cleared.
+    void reprojectRange(const AnchorArrays& source, std::vector<float>& offsets, size_t begin, size_t end, const float V[16], const float PV[16], const cv::Mat& depth, const std::vector<float> &modelDepth, int width, int height, int contentWidth, int contentHeight) {
+        float sx[REPROJECT_BLOCK], sy[REPROJECT_BLOCK], vx[REPROJECT_BLOCK], vy[REPROJECT_BLOCK], vz[REPROJECT_BLOCK];
+        const float *X = source.x.data(), *Y = source.y.data(), *Z = source.z.data();
+
+        for (size_t b = begin; b < end; b += REPROJECT_BLOCK) {
+            const size_t count = std::min(end - b, size_t(REPROJECT_BLOCK));
+            size_t k = 0;
+
+            // Transform a block to view space and to image space [0, 1).
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+            for (; k + 4 <= count; k += 4) {
+                const float32x4_t wx = vld1q_f32(X + b + k), wy = vld1q_f32(Y + b + k), wz = vld1q_f32(Z + b + k);
+                vst1q_f32(vx + k, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(V[12]), wx, V[0]), wy, V[4]), wz, V[8]));
+                vst1q_f32(vy + k, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(V[13]), wx, V[1]), wy, V[5]), wz, V[9]));
+                vst1q_f32(vz + k, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(V[14]), wx, V[2]), wy, V[6]), wz, V[10]));
+                const float32x4_t cx = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(PV[12]), wx, PV[0]), wy, PV[4]), wz, PV[8]);
+                const float32x4_t cy = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(PV[13]), wx, PV[1]), wy, PV[5]), wz, PV[9]);
+                const float32x4_t cw = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(PV[15]), wx, PV[3]), wy, PV[7]), wz, PV[11]);
+                // 1/w by reciprocal estimate and two Newton-Raphson steps.
+                float32x4_t r = vrecpeq_f32(cw);
+                r = vmulq_f32(vrecpsq_f32(cw, r), r);
+                r = vmulq_f32(vrecpsq_f32(cw, r), r);
+                const float32x4_t half = vdupq_n_f32(0.5f);
+                vst1q_f32(sx + k, vmlaq_f32(half, vmulq_f32(cx, r), half));
+                vst1q_f32(sy + k, vmlsq_f32(half, vmulq_f32(cy, r), half));
+            }
+#elif HAVE_INTEL_SIMD
+            for (; k + 4 <= count; k += 4) {
+                const __m128 wx = _mm_loadu_ps(X + b + k), wy = _mm_loadu_ps(Y + b + k), wz = _mm_loadu_ps(Z + b + k);
+#  define ROW(M, r) _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(M[r])), _mm_mul_ps(wy, _mm_set1_ps(M[4 + r]))), _mm_add_ps(_mm_mul_ps(wz, _mm_set1_ps(M[8 + r])), _mm_set1_ps(M[12 + r])))
+                _mm_storeu_ps(vx + k, ROW(V, 0));
+                _mm_storeu_ps(vy + k, ROW(V, 1));
+                _mm_storeu_ps(vz + k, ROW(V, 2));
+                const __m128 cx = ROW(PV, 0), cy = ROW(PV, 1), cw = ROW(PV, 3);
+#  undef ROW
+                const __m128 half = _mm_set1_ps(0.5f);
+                _mm_storeu_ps(sx + k, _mm_add_ps(half, _mm_mul_ps(_mm_div_ps(cx, cw), half)));
+                _mm_storeu_ps(sy + k, _mm_sub_ps(half, _mm_mul_ps(_mm_div_ps(cy, cw), half)));
+            }
+#endif
+            for (; k < count; k++) {
+                const float wx = X[b + k], wy = Y[b + k], wz = Z[b + k];
+                vx[k] = V[0] * wx + V[4] * wy + V[8] * wz + V[12];
+                vy[k] = V[1] * wx + V[5] * wy + V[9] * wz + V[13];
+                vz[k] = V[2] * wx + V[6] * wy + V[10] * wz + V[14];
+                const float cw = PV[3] * wx + PV[7] * wy + PV[11] * wz + PV[15];
+                sx[k] = 0.5f + 0.5f * (PV[0] * wx + PV[4] * wy + PV[8] * wz + PV[12]) / cw;
+                sy[k] = 0.5f - 0.5f * (PV[1] * wx + PV[5] * wy + PV[9] * wz + PV[13]) / cw;
+            }
+
+            // Depth test. Out of range comparisons are also false for NaN.
+            for (k = 0; k < count; k++) {
+                const float x = sx[k], y = sy[k];
+                if (!(x >= 0.0f && y >= 0.0f && x < 1.0f && y < 1.0f)) {
+                    keep[b + k] = 0;
+                    continue;
+                }
+                cv::Vec3f v = getModelDepth(modelDepth, x, y, contentWidth, contentHeight);
+                if (v[0] == 0.0f && v[1] == 0.0f && v[2] == 0.0f) {
+                    v = depth.at<cv::Vec3f>(int(y * float(height)), int(x * float(width)));
+                }
+                const float dx = v[0] - vx[k], dy = v[1] - vy[k], dz = v[2] - vz[k];
+                keep[b + k] = (dx * dx + dy * dy + dz * dz <= EPSILON * EPSILON);
+                offsets[(b + k) * 2 + 0] = x;
+                offsets[(b + k) * 2 + 1] = 1.0f - y;
+            }
+        }
+    }
+
+    // Remove the anchors of over-dense cells and add an anchor to each cell outside the density bounds
+    void redistribute(const cv::Mat& depth, const std::vector<float> &modelDepth, const float view[16], int width, int height, int contentWidth, int contentHeight) {
+        float viewInv[16];
+        invertMatrix(view, viewInv);
+
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < m; j++) {
+                const float d = cellDensity[i * m + j];
+                if (d > ALPHA && d < BETA) {
+                    continue;
+                }
+
+                if (d >= BETA) {
+                    grid.removeCell(i, j, anchors);
+                }
+
+                const float x = (j + float(rand()) / float(RAND_MAX)) / float(m);
+                const float y = (i + float(rand()) / float(RAND_MAX)) / float(n);
+                float worldPos[4];
+                getWorldPosition(x, y, worldPos, depth, modelDepth, width, height, contentWidth, contentHeight, viewInv);
+                anchors.push(x, y, worldPos);
+                grid.insert(x, y);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, modelO2BO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * anchors.offsets.size(), anchors.offsets.data());
+    }
+
 public:
     const size_t m, n;
 
     // Initialization step of Voronoi diagram of reference frame
     Voronoi(ARG_API drawAPI, size_t m, size_t n, int width, int height) : m(m), n(n), other(NULL) {
         // centers.resize(m * n);
-        offsets.resize(m * n * 2);
+        anchors.offsets.resize(m * n * 2);
 
         for (size_t i = 0; i < n; i++) {
             for (size_t j = 0; j < m; j++) {
@@ -220,151 +344,126 @@ public:
                 const float y = (i + float(rand()) / float(RAND_MAX)) / float(n);
                 const size_t index = i * m + j;
                 // centers[index] = std::make_pair(x, y);
-                offsets[index * 2 + 0] = x;
-                offsets[index * 2 + 1] = (1.0f - y);
+                anchors.offsets[index * 2 + 0] = x;
+                anchors.offsets[index * 2 + 1] = (1.0f - y);
             }
         }
+        grid.reset(m, n);
+        grid.rebuild(anchors.offsets);
 
         loadGL(drawAPI);
 
         glBindBuffer(GL_ARRAY_BUFFER, modelO2BO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * offsets.size(), offsets.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * anchors.offsets.size(), anchors.offsets.data());
     }
 
-        // Initialization step of Voronoi diagram from reference frame
+    // Initialization step of Voronoi diagram sharing the anchors of a reference frame. Its anchors are maintained
+    // by the reference frame's instance; this instance only projects them into its own view.
     Voronoi(ARG_API drawAPI, const Voronoi* other) : m(other->m), n(other->n), other(other) {
-        offsets.resize(other->offsets.size());
-
         loadGL(drawAPI);
     }
 
-    // Update world positions based on estimated view space and model view space
+    // Whether this instance maintains its anchors' positions and density, rather than sharing another's
+    bool ownsAnchors() const {
+        return !other;
+    }
+
+    // Update world positions based on estimated view space and model view space. With shared anchors, only
+    // update this view's image positions of the anchors that are visible in it.
     void updateDepth(const cv::Mat& depth, const std::vector<float> &modelDepth, const float view[16], const float projection[16], int width, int height, int contentWidth, int contentHeight) {
         float viewInv[16];
         invertMatrix(view, viewInv);
 
         // Create initial world positions
-        if (worldPositions.empty()) {
-            if (other) {
-                worldPositions = other->worldPositions;
-            } else {
-                worldPositions.resize(m * n * 3);
-                for (size_t i = 0; i < n; i++) {
-                    for (size_t j = 0; j < m; j++) {
-                        const size_t index = i * m + j;
-                        const float x = offsets[index * 2 + 0];
-                        const float y = (1.0f - offsets[index * 2 + 1]);
-                        float worldPos[4];
-                        getWorldPosition(x, y, worldPos, depth, modelDepth, width, height, contentWidth, contentHeight, viewInv);
-                        worldPositions[index * 3 + 0] = worldPos[0];
-                        worldPositions[index * 3 + 1] = worldPos[1];
-                        worldPositions[index * 3 + 2] = worldPos[2];
-                    }
-                }
+        if (!other && !anchors.hasWorldPositions()) {
+            const size_t count = anchors.size();
+            anchors.x.resize(count);
+            anchors.y.resize(count);
+            anchors.z.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                const float x = anchors.offsets[i * 2 + 0];
+                const float y = (1.0f - anchors.offsets[i * 2 + 1]);
+                float worldPos[4];
+                getWorldPosition(x, y, worldPos, depth, modelDepth, width, height, contentWidth, contentHeight, viewInv);
+                anchors.x[i] = worldPos[0];
+                anchors.y[i] = worldPos[1];
+                anchors.z[i] = worldPos[2];
             }
         }
 
-        // Remap world positions to new image space positions
-        std::vector<float> newOffsets, newWorldPositions;
-        newOffsets.reserve(m * n * 2);
-        newWorldPositions.reserve(m * n * 3);
-        for (size_t i = 0; i < offsets.size() / 2; i++) {
-            const float worldPos[4] = {
-                worldPositions[i * 3 + 0],
-                worldPositions[i * 3 + 1],
-                worldPositions[i * 3 + 2],
-                1.0f,
-            };
-            float viewPos[4];
-            transformVector(worldPos, view, viewPos);
-
-            for (int j = 0; j < 4; j++) {
-                viewPos[j] /= viewPos[3];
-            }
-
-            float imagePos[4];
-            transformVector(viewPos, projection, imagePos);
-
-            for (int j = 0; j < 4; j++) {
-                imagePos[j] /= imagePos[3];
-            }
-
-            const float x = (imagePos[0] + 1.0f) / 2.0f;
-            const float y = 1.0f - (imagePos[1] + 1.0f) / 2.0f;
-            if (isnan(x) || isnan(y) || isinf(x) || isinf(y) || x < 0.0f || y < 0.0f || x >= 1.0f || y >= 1.0f) {
-                continue;
-            }
-
-            cv::Vec3f v = getModelDepth(modelDepth, x, y, contentWidth, contentHeight);
-            if (v[0] == 0.0f && v[1] == 0.0f && v[2] == 0.0f) {
-                v = depth.at<cv::Vec3f>(int(y * float(height)), int(x * float(width)));
-            }
-
-            if (cv::norm(v, cv::Vec3f(viewPos), cv::NORM_L2) <= EPSILON) {
-                newOffsets.push_back(x);
-                newOffsets.push_back(1.0f - y);
-                for (int j = 0; j < 3; j++) {
-                    newWorldPositions.push_back(worldPositions[i * 3 + j]);
-                }
-            }
+        // Remap world positions to new image space positions, in blocks split between threads
+        const AnchorArrays& source = (other ? other->anchors : anchors);
+        float projectionView[16];
+        mtxLoadMatrixf(projectionView, projection);
+        mtxMultMatrixf(projectionView, view);
+        const size_t count = source.size();
+        keep.resize(count);
+        if (other) anchors.offsets.resize(count * 2);
+        const size_t threads = std::max<size_t>(std::min<size_t>(std::thread::hardware_concurrency(), count / REPROJECT_THREAD_MIN), 1);
+        const size_t perThread = ((count + threads - 1) / threads + REPROJECT_BLOCK - 1) / REPROJECT_BLOCK * REPROJECT_BLOCK;
+        std::vector<std::future<void> > done;
+        for (size_t t = 1; t < threads; t++) {
+            const size_t begin = std::min(t * perThread, count), end = std::min(begin + perThread, count);
+            done.push_back(std::async(std::launch::async, [=, &source, &depth, &modelDepth]{
+                reprojectRange(source, anchors.offsets, begin, end, view, projectionView, depth, modelDepth, width, height, contentWidth, contentHeight);
+            }));
         }
-
-        offsets = newOffsets;
-        worldPositions = newWorldPositions;
+        reprojectRange(source, anchors.offsets, 0, std::min(perThread, count), view, projectionView, depth, modelDepth, width, height, contentWidth, contentHeight);
+        for (size_t t = 0; t < done.size(); t++) done[t].get();
+
+        // Compact surviving anchors in place. Shared anchors not visible in this view are only left out of its offsets.
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!keep[i]) continue;
+            if (kept != i) anchors.move(i, kept);
+            kept++;
+        }
+        anchors.resize(kept);
+        if (!other) grid.rebuild(anchors.offsets);
 
         glBindBuffer(GL_ARRAY_BUFFER, modelO2BO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * offsets.size(), offsets.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * anchors.offsets.size(), anchors.offsets.data());
     }
 
-    // Update anchor point density based on a specialized rendering of the Voronoi diagram
+    // Update anchor point density based on a specialized rendering of the Voronoi diagram. program computes each cell's
+    // density from the summed-area table of the rendering, which must be bound.
     void updateDensity(GLuint program, const cv::Mat& depth, const std::vector<float> &modelDepth, const float view[16], int width, int height, int contentWidth, int contentHeight) {
-        float viewInv[16];
-        invertMatrix(view, viewInv);
+        if (other) return;
 
         glViewport(0, 0, m, n);
         glBindFramebuffer(GL_FRAMEBUFFER, FBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUniform1i(glGetUniformLocation(program, "cellWidth"), int(contentWidth / m));
-        glUniform1i(glGetUniformLocation(program, "cellHeight"), int(contentHeight / n));
+        glUniform1i(glGetUniformLocation(program, "columns"), int(m));
+        glUniform1i(glGetUniformLocation(program, "rows"), int(n));
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
         std::vector<unsigned char> density(m * n * 3);
         glReadPixels(0, 0, m, n, GL_RGB, GL_UNSIGNED_BYTE, density.data());
-
-        const float mInv = 1.0f / float(m);
-        const float nInv = 1.0f / float(n);
-
+        cellDensity.resize(m * n);
         for (size_t i = 0; i < n; i++) {
             for (size_t j = 0; j < m; j++) {
-                const float d = float(density[((n - i - 1) * m + j) * 3]) / 255.0f;
-                if (d > ALPHA && d < BETA) {
-                    continue;
-                }
-
-                if (d >= BETA) {
-                    for (int k = offsets.size() - 2; k >= 0; k -= 2) {
-                        const float x = offsets[k + 0];
-                        const float y = 1.0f - offsets[k + 1];
-                        if (x >= float(j) * mInv && y >= float(i) * nInv && x < float(j + 1) * mInv && y < float(i + 1) * nInv) {
-                            offsets.erase(offsets.begin() + k, offsets.begin() + k + 2);
-                        }
-                    }
-                }
-
-                const float x = (j + float(rand()) / float(RAND_MAX)) / float(m);
-                const float y = (i + float(rand()) / float(RAND_MAX)) / float(n);
-                offsets.push_back(x);
-                offsets.push_back(1.0f - y);
-                float worldPos[4];
-                getWorldPosition(x, y, worldPos, depth, modelDepth, width, height, contentWidth, contentHeight, viewInv);
-                for (int i = 0; i < 3; i++) {
-                    worldPositions.push_back(worldPos[i]);
-                }
+                cellDensity[i * m + j] = float(density[((n - i - 1) * m + j) * 3]) / 255.0f;
             }
         }
+        redistribute(depth, modelDepth, view, width, height, contentWidth, contentHeight);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, modelO2BO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * offsets.size(), offsets.data());
+    // As above, with the cell densities computed on the CPU from the summed-area table of the read back rendering
+    void updateDensity(const DensitySAT& sat, const cv::Mat& depth, const std::vector<float> &modelDepth, const float view[16], int width, int height, int contentWidth, int contentHeight) {
+        if (other) return;
+
+        // The shader's output is blended over black by its own alpha, so it holds the squared density; ALPHA and BETA
+        // apply to that.
+        sat.cellDensities(m, n, cellDensity);
+        for (size_t c = 0; c < cellDensity.size(); c++) cellDensity[c] *= cellDensity[c];
+        redistribute(depth, modelDepth, view, width, height, contentWidth, contentHeight);
+    }
+
+    // Draw the Voronoi pattern (as drawPattern(false) does) on the CPU, into out (RGBA, rows bottom to top), coloured
+    // from frame (RGBA, rows bottom to top). Pixels farther than a cone radius from any anchor are left as they are.
+    void drawPatternCPU(const unsigned char *frame, int frameWidth, int frameHeight, unsigned char *out, int width, int height, int threads = 0) {
+        // Normalized device coordinates span twice the normalized image coordinates.
+        cpuRenderer.render(anchors.offsets.data(), anchors.size(), m, n, coneScale() / 2.0f, frame, frameWidth, frameHeight, out, width, height, threads);
     }
 
     // Draw Voronoi pattern, with or without specialized density rendering
@@ -388,7 +487,7 @@ public:
 #else
         glBindVertexArray(modelVAO);
 #endif
-        glDrawArraysInstanced(GL_TRIANGLES, 0, model.Indices.size(), offsets.size() / 2);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, model.Indices.size(), anchors.size());
 #if HAVE_GL3
         glBindVertexArray(0);
 #endif
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// CPU equivalent of the instanced cone rendering of the Voronoi pattern. Each anchor's cone has its apex at the
+// anchor and its depth rises linearly with distance (equal in x and y in normalized image coordinates) to the
+// cone's radius, so with depth testing each pixel within a radius of some anchor takes the colour the frame has
+// at its nearest anchor. Other pixels are left as they are.
+//
+// Images are RGBA with rows bottom to top, as OpenGL reads and samples them, and anchor offsets are (x, y) in
+// [0, 1) with y up, as uploaded for the instanced rendering. Pixels are found from a nearest-anchor search over
+// the anchor grid: anchors are sorted by cell of an m x n grid, and each pixel searches only the anchors of cells
+// within a radius of it. The image is split into tiles shared between worker threads.
+class VoronoiRenderer {
+private:
+    static constexpr int TILE = 32; // Tile size in pixels.
+
+    std::vector<uint32_t> cellStart;         // Start of each cell's anchors in the sorted arrays, and the end, for m x n + 1 cells.
+    std::vector<uint32_t> cellFill;          // Next free position in each cell while sorting.
+    std::vector<float> sortedU, sortedV;     // Anchor positions, by cell.
+    std::vector<uint32_t> sortedColors;      // RGBA colour of each anchor, by cell.
+
+    // Frame colour at (u, v), bilinearly interpolated between texel centres and clamped at the edges.
+    static uint32_t sample(const unsigned char *frame, int width, int height, float u, float v) {
+        const float x = std::min(std::max(u * float(width) - 0.5f, 0.0f), float(width - 1));
+        const float y = std::min(std::max(v * float(height) - 0.5f, 0.0f), float(height - 1));
+        const int x0 = int(x), y0 = int(y);
+        const int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+        const float fx = x - float(x0), fy = y - float(y0);
+        const unsigned char *p00 = frame + (size_t(y0) * width + x0) * 4, *p01 = frame + (size_t(y0) * width + x1) * 4;
+        const unsigned char *p10 = frame + (size_t(y1) * width + x0) * 4, *p11 = frame + (size_t(y1) * width + x1) * 4;
+        uint32_t c = 0;
+        for (int k = 0; k < 3; k++) {
+            const float top = float(p00[k]) + (float(p01[k]) - float(p00[k])) * fx;
+            const float bottom = float(p10[k]) + (float(p11[k]) - float(p10[k])) * fx;
+            c |= uint32_t(top + (bottom - top) * fy + 0.5f) << (k * 8);
+        }
+        return c | 0xff000000u; // Opaque, as the cone fragments are.
+    }
+
+    void renderTile(int tx, int ty, size_t m, size_t n, float radius, unsigned char *out, int width, int height) const {
+        const int x0 = tx * TILE, y0 = ty * TILE;
+        const int x1 = std::min(x0 + TILE, width), y1 = std::min(y0 + TILE, height);
+        const float radius2 = radius * radius;
+        const float rm = radius * float(m), rn = radius * float(n);
+
+        for (int y = y0; y < y1; y++) {
+            const float v = (float(y) + 0.5f) / float(height);
+            const int i0 = std::max(int(v * float(n) - rn), 0), i1 = std::min(int(v * float(n) + rn), int(n) - 1);
+            uint32_t *row = (uint32_t *)(out + size_t(y) * width * 4);
+            for (int x = x0; x < x1; x++) {
+                const float u = (float(x) + 0.5f) / float(width);
+                const int j0 = std::max(int(u * float(m) - rm), 0), j1 = std::min(int(u * float(m) + rm), int(m) - 1);
+                float best = radius2;
+                uint32_t nearest = UINT32_MAX;
+                // Cells j0..j1 of a row are contiguous in the sorted anchors.
+                for (int i = i0; i <= i1; i++) {
+                    const uint32_t end = cellStart[size_t(i) * m + j1 + 1];
+                    for (uint32_t a = cellStart[size_t(i) * m + j0]; a < end; a++) {
+                        const float du = sortedU[a] - u, dv = sortedV[a] - v;
+                        const float d2 = du * du + dv * dv;
+                        if (d2 < best) {
+                            best = d2;
+                            nearest = a;
+                        }
+                    }
+                }
+                if (nearest != UINT32_MAX) row[x] = sortedColors[nearest];
+            }
+        }
+    }
+
+public:
+    // Draw count anchors with offsets (x, y) into out (width x height), coloured from frame (frameWidth x frameHeight).
+    // radius is the cone radius in normalized image coordinates. threads 0 uses all hardware threads.
+    void render(const float *offsets, size_t count, size_t m, size_t n, float radius, const unsigned char *frame, int frameWidth, int frameHeight, unsigned char *out, int width, int height, int threads = 0) {
+        // Anchors sorted by cell (counting sort), with their colours.
+        cellStart.assign(m * n + 1, 0);
+        for (size_t k = 0; k < count; k++) {
+            const float u = offsets[k * 2 + 0], v = offsets[k * 2 + 1];
+            const size_t j = std::min(size_t(std::max(u, 0.0f) * float(m)), m - 1);
+            const size_t i = std::min(size_t(std::max(v, 0.0f) * float(n)), n - 1);
+            cellStart[i * m + j + 1]++;
+        }
+        for (size_t c = 0; c < m * n; c++) cellStart[c + 1] += cellStart[c];
+        sortedU.resize(count);
+        sortedV.resize(count);
+        sortedColors.resize(count);
+        cellFill.assign(cellStart.begin(), cellStart.end() - 1);
+        for (size_t k = 0; k < count; k++) {
+            const float u = offsets[k * 2 + 0], v = offsets[k * 2 + 1];
+            const size_t j = std::min(size_t(std::max(u, 0.0f) * float(m)), m - 1);
+            const size_t i = std::min(size_t(std::max(v, 0.0f) * float(n)), n - 1);
+            const uint32_t a = cellFill[i * m + j]++;
+            sortedU[a] = u;
+            sortedV[a] = v;
+            sortedColors[a] = sample(frame, frameWidth, frameHeight, u, v);
+        }
+
+        // Tiles, shared between threads.
+        const int tilesX = (width + TILE - 1) / TILE, tilesY = (height + TILE - 1) / TILE;
+        const int tiles = tilesX * tilesY;
+        if (threads <= 0) threads = std::max(int(std::thread::hardware_concurrency()), 1);
+        threads = std::min(threads, tiles);
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+            int t;
+            while ((t = next++) < tiles) renderTile(t % tilesX, t / tilesX, m, n, radius, out, width, height);
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; i++) pool.push_back(std::thread(worker));
+        worker();
+        for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+    }
+};
@@ -47,6 +47,8 @@
  *******************************************************/
 
 #include <ARX/AR/ar.h>
+#include "arLabelingBracket.h"
+#include "arRefineMarkers.h"
 #include <stdio.h>
 #include <math.h>
 
@@ -87,6 +89,8 @@ ARHandle *arCreateHandle(ARParamLT *paramLT)
     arMalloc(handle->labelInfo.labelImage, AR_LABELING_LABEL_TYPE, handle->xsize*handle->ysize);
     
     handle->pattHandle = NULL;
+    handle->labelingBrackets = NULL;
+    handle->refineMarkers = NULL;
     
     arSetDebugMode(handle, AR_DEFAULT_DEBUG_MODE);
     
@@ -108,6 +112,9 @@ int arDeleteHandle(ARHandle *handle)
         handle->arImageProcInfo = NULL;
     }
     
+    arLabelingBracketFinal(handle);
+    arRefineMarkersFinal(handle);
+    
     //if(handle->arParamLT != NULL) arParamLTFree(&handle->arParamLT);
     free(handle->labelInfo.labelImage);
 #if !AR_DISABLE_LABELING_DEBUG_MODE
@@ -190,6 +197,7 @@ void arSetLabelingThreshMode(ARHandle *handle, const AR_LABELING_THRESH_MODE mod
             arImageProcFinal(handle->arImageProcInfo);
             handle->arImageProcInfo = NULL;
         }
+        arLabelingBracketFinal(handle);
 
         mode1 = mode;
         switch (mode) {
@@ -39,7 +39,8 @@
 #include <stdio.h>
 #include <ARX/AR/ar.h>
 #include <ARX/AR/arImageProc.h>
-#include "arRefineCorners.h"
+#include "arRefineMarkers.h"
+#include "arLabelingBracket.h"
 #if DEBUG_PATT_GETID
 extern int cnt;
 #endif
@@ -89,13 +90,8 @@ cnt = 0;
             if (thresholds[1] < 0) thresholds[1] = 0;
             thresholds[2] = arHandle->arLabelingThresh;
             
-            for (i = 0; i < 3; i++) {
-                if (arLabeling(frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode, thresholds[i], arHandle->arImageProcMode, &(arHandle->labelInfo), NULL) < 0) return -1;
-                if (arDetectMarker2(arHandle->xsize, arHandle->ysize, &(arHandle->labelInfo), arHandle->arImageProcMode, arHandle->areaMax, arHandle->areaMin, arHandle->squareFitThresh, arHandle->markerInfo2, &(arHandle->marker2_num)) < 0) return -1;
-                if (arGetMarkerInfo(frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat, arHandle->markerInfo2, arHandle->marker2_num, arHandle->pattHandle, arHandle->arImageProcMode, arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf), arHandle->pattRatio, arHandle->markerInfo, &(arHandle->marker_num), arHandle->matrixCodeType) < 0) return -1;
-                marker_nums[i] = 0;
-                for (j = 0; j < arHandle->marker_num; j++) if (arHandle->markerInfo[j].idPatt != -1 || arHandle->markerInfo[j].idMatrix != -1) marker_nums[i]++;
-            }
+            // Evaluate all three thresholds in parallel. The current threshold's results land in arHandle.
+            if (arLabelingBracketDetect(arHandle, frame, thresholds, marker_nums) < 0) return -1;
 
             if (arHandle->arDebug == AR_DEBUG_ENABLE) ARLOGe("Auto threshold (bracket) marker counts -[%3d: %3d] [%3d: %3d] [%3d: %3d]+.\n", thresholds[1], marker_nums[1], thresholds[2], marker_nums[2], thresholds[0], marker_nums[0]);
         
@@ -123,6 +119,9 @@ cnt = 0;
                     arHandle->arLabelingThreshAutoBracketUnder = (-threshDiff + 1) / 2;
                 }
                 if (arHandle->arDebug == AR_DEBUG_ENABLE) ARLOGe("Auto threshold (bracket) adjusted threshold to %d.\n", arHandle->arLabelingThresh);
+                // The results at the new threshold have already been computed, so use them rather than detecting again.
+                if (arLabelingBracketAdopt(arHandle, (marker_nums[0] >= marker_nums[1] ? 0 : 1)) < 0) return -1;
+                detectionIsDone = 1;
             }
             arHandle->arLabelingThreshAutoIntervalTTL = arHandle->arLabelingThreshAutoInterval;
         }
@@ -187,20 +186,7 @@ cnt = 0;
     
     if (arHandle->arCornerRefinementMode == AR_CORNER_REFINEMENT_ENABLE) {
         // Refine marker co-ordinates.
-        ARfloat obVertex[4][2];
-        for (int i = 0; i < 4; i++) {
-            float arXIn = (float)arHandle->markerInfo->vertex[i][0];
-            float arYIn = (float)arHandle->markerInfo->vertex[i][1];
-            arParamIdeal2ObservLTf(&arHandle->arParamLT->paramLTf, arXIn, arYIn, &obVertex[i][0], &obVertex[i][1]);
-        }
-        arRefineCorners((float (*)[2])obVertex, frame->buffLuma, arHandle->xsize, arHandle->ysize);
-        for (int i = 0; i < 4; i++) {
-            float newX, newY;
-            arParamObserv2IdealLTf(&arHandle->arParamLT->paramLTf, obVertex[i][0], obVertex[i][1], &newX, &newY);
-            arHandle->markerInfo->vertex[i][0] = (ARdouble)newX;
-            arHandle->markerInfo->vertex[i][1] = (ARdouble)newY;
-        }
-        //free(obVertex);
+        arRefineMarkers(arHandle, frame);
     }
     
     // If history mode is not enabled, just perform a basic confidence cutoff.
@@ -40,6 +40,10 @@
 #include <ARX/AR/arImageProc.h>
 #if AR_IMAGEPROC_USE_VIMAGE
 #  include <Accelerate/Accelerate.h>
+#elif HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
 #endif
 
 ARImageProcInfo *arImageProcInit(const int xsize, const int ysize)
@@ -51,6 +55,8 @@ ARImageProcInfo *arImageProcInit(const int xsize, const int ysize)
         ipi->imageY = ysize;
 #if AR_IMAGEPROC_USE_VIMAGE
         ipi->tempBuffer = NULL;
+#else
+        ipi->colSums = NULL;
 #endif
     }
     return (ipi);
@@ -62,6 +68,8 @@ void arImageProcFinal(ARImageProcInfo *ipi)
     if (ipi->image2) free (ipi->image2);
 #if AR_IMAGEPROC_USE_VIMAGE
     if (ipi->tempBuffer) free (ipi->tempBuffer);
+#else
+    if (ipi->colSums) free (ipi->colSums);
 #endif
     free (ipi);
 }
@@ -199,11 +207,75 @@ int arImageProcLumaHistAndOtsu(ARImageProcInfo *ipi, const ARUint8 *__restrict d
     return (0);
 }
 
+#if !AR_IMAGEPROC_USE_VIMAGE
+// Add one row of luma values to the running column sums.
+static void boxFilterColSumsAddRow(unsigned int *__restrict colSums, const ARUint8 *__restrict row, const int width)
+{
+    int i = 0;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    for (; i <= width - 16; i += 16) {
+        uint8x16_t p = vld1q_u8(row + i);
+        uint16x8_t p_l = vmovl_u8(vget_low_u8(p));
+        uint16x8_t p_h = vmovl_u8(vget_high_u8(p));
+        vst1q_u32(colSums + i,      vaddw_u16(vld1q_u32(colSums + i),      vget_low_u16(p_l)));
+        vst1q_u32(colSums + i + 4,  vaddw_u16(vld1q_u32(colSums + i + 4),  vget_high_u16(p_l)));
+        vst1q_u32(colSums + i + 8,  vaddw_u16(vld1q_u32(colSums + i + 8),  vget_low_u16(p_h)));
+        vst1q_u32(colSums + i + 12, vaddw_u16(vld1q_u32(colSums + i + 12), vget_high_u16(p_h)));
+    }
+#elif HAVE_INTEL_SIMD
+    __m128i zero = _mm_setzero_si128();
+    for (; i <= width - 16; i += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i p_l = _mm_unpacklo_epi8(p, zero);
+        __m128i p_h = _mm_unpackhi_epi8(p, zero);
+        __m128i *s = (__m128i *)(colSums + i);
+        _mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(p_l, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(p_l, zero)));
+        _mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(p_h, zero)));
+        _mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(p_h, zero)));
+    }
+#endif
+    for (; i < width; i++) colSums[i] += row[i];
+}
+
+// Remove one row of luma values from the running column sums.
+static void boxFilterColSumsSubRow(unsigned int *__restrict colSums, const ARUint8 *__restrict row, const int width)
+{
+    int i = 0;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    for (; i <= width - 16; i += 16) {
+        uint8x16_t p = vld1q_u8(row + i);
+        uint16x8_t p_l = vmovl_u8(vget_low_u8(p));
+        uint16x8_t p_h = vmovl_u8(vget_high_u8(p));
+        vst1q_u32(colSums + i,      vsubw_u16(vld1q_u32(colSums + i),      vget_low_u16(p_l)));
+        vst1q_u32(colSums + i + 4,  vsubw_u16(vld1q_u32(colSums + i + 4),  vget_high_u16(p_l)));
+        vst1q_u32(colSums + i + 8,  vsubw_u16(vld1q_u32(colSums + i + 8),  vget_low_u16(p_h)));
+        vst1q_u32(colSums + i + 12, vsubw_u16(vld1q_u32(colSums + i + 12), vget_high_u16(p_h)));
+    }
+#elif HAVE_INTEL_SIMD
+    __m128i zero = _mm_setzero_si128();
+    for (; i <= width - 16; i += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i p_l = _mm_unpacklo_epi8(p, zero);
+        __m128i p_h = _mm_unpackhi_epi8(p, zero);
+        __m128i *s = (__m128i *)(colSums + i);
+        _mm_storeu_si128(s + 0, _mm_sub_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(p_l, zero)));
+        _mm_storeu_si128(s + 1, _mm_sub_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(p_l, zero)));
+        _mm_storeu_si128(s + 2, _mm_sub_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(p_h, zero)));
+        _mm_storeu_si128(s + 3, _mm_sub_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(p_h, zero)));
+    }
+#endif
+    for (; i < width; i++) colSums[i] -= row[i];
+}
+#endif // !AR_IMAGEPROC_USE_VIMAGE
+
 int arImageProcLumaHistAndBoxFilterWithBias(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr, const int boxSize, const int bias)
 {
     int ret, i;
 #if !AR_IMAGEPROC_USE_VIMAGE
-    int j, kernelSizeHalf;
+    int j, kernelSizeHalf, rowCount;
+    unsigned int val;
+    unsigned char *__restrict out;
 #endif
     
     ret = arImageProcLumaHist(ipi, dataPtr);
@@ -228,22 +300,33 @@ int arImageProcLumaHistAndBoxFilterWithBias(ARImageProcInfo *ipi, const ARUint8
         return (-1);
     }
 #else
+    if (!ipi->colSums) {
+        ipi->colSums = (unsigned int *)malloc(ipi->imageX * sizeof(unsigned int));
+        if (!ipi->colSums) return (-1);
+    }
     kernelSizeHalf = boxSize >> 1;
+    
+    // Vertical pass: colSums[i] holds the sum of column i over the rows of the kernel
+    // centred on row j, truncated at the top and bottom of the image.
+    memset(ipi->colSums, 0, ipi->imageX * sizeof(unsigned int));
+    for (j = 0; j <= kernelSizeHalf && j < ipi->imageY; j++) boxFilterColSumsAddRow(ipi->colSums, dataPtr + j*ipi->imageX, ipi->imageX);
+    
     for (j = 0; j < ipi->imageY; j++) {
+        if (j > 0) {
+            if (j + kernelSizeHalf < ipi->imageY) boxFilterColSumsAddRow(ipi->colSums, dataPtr + (j + kernelSizeHalf)*ipi->imageX, ipi->imageX);
+            if (j - kernelSizeHalf - 1 >= 0) boxFilterColSumsSubRow(ipi->colSums, dataPtr + (j - kernelSizeHalf - 1)*ipi->imageX, ipi->imageX);
+        }
+        rowCount = (j + kernelSizeHalf < ipi->imageY ? j + kernelSizeHalf : ipi->imageY - 1) - (j - kernelSizeHalf > 0 ? j - kernelSizeHalf : 0) + 1;
+        
+        // Horizontal pass: running sum of colSums across the kernel centred on column i.
+        out = ipi->image2 + j*ipi->imageX;
+        val = 0;
+        for (i = 0; i <= kernelSizeHalf && i < ipi->imageX; i++) val += ipi->colSums[i];
         for (i = 0; i < ipi->imageX; i++) {
-            int val, count, kernel_i, kernel_j, ii, jj;
-            val = count = 0;
-            for (kernel_j = -kernelSizeHalf; kernel_j <= kernelSizeHalf; kernel_j++) {
-                jj = j + kernel_j;
-                if (jj < 0 || jj >= ipi->imageY) continue;
-                for (kernel_i = -kernelSizeHalf; kernel_i <= kernelSizeHalf; kernel_i++) {
-                    ii = i + kernel_i;
-                    if (ii < 0 || ii >= ipi->imageX) continue;
-                    val += dataPtr[ii + jj*(ipi->imageX)];
-                    count++;
-                }
-            }
-            ipi->image2[i + j*(ipi->imageX)] = val / count;
+            int colCount = (i + kernelSizeHalf < ipi->imageX ? i + kernelSizeHalf : ipi->imageX - 1) - (i - kernelSizeHalf > 0 ? i - kernelSizeHalf : 0) + 1;
+            out[i] = val / (unsigned int)(colCount * rowCount);
+            if (i + kernelSizeHalf + 1 < ipi->imageX) val += ipi->colSums[i + kernelSizeHalf + 1];
+            if (i - kernelSizeHalf >= 0) val -= ipi->colSums[i - kernelSizeHalf];
         }
     }
 #endif
@@ -0,0 +1,202 @@
+/*
+ *  arLabelingBracket.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2026 artoolkitX contributors.
+ *
+ *  Author(s): artoolkitX contributors.
+ *
+ */
+
+#include "arLabelingBracket.h"
+#include <ARX/ARUtil/thread_sub.h>
+#include <string.h>
+
+#define AR_LABELING_BRACKET_WORKER_COUNT 2
+
+typedef struct {
+    ARHandle          *arHandle;
+    AR2VideoBufferT   *frame;
+    int                thresh;
+    int                ret;
+    ARLabelInfo        labelInfo;
+    int                marker2_num;
+    ARMarkerInfo2      markerInfo2[AR_SQUARE_MAX];
+    int                marker_num;
+    ARMarkerInfo       markerInfo[AR_SQUARE_MAX];
+    THREAD_HANDLE_T   *threadHandle;
+} ARLabelingBracket;
+
+struct _ARLabelingBrackets {
+    ARLabelingBracket  bracket[AR_LABELING_BRACKET_WORKER_COUNT];
+};
+
+static int detectAtThreshold(ARHandle *arHandle, AR2VideoBufferT *frame, int thresh,
+                             ARLabelInfo *labelInfo, ARMarkerInfo2 *markerInfo2, int *marker2_num, ARMarkerInfo *markerInfo, int *marker_num)
+{
+    if (arLabeling(frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode, thresh, arHandle->arImageProcMode, labelInfo, NULL) < 0) return -1;
+    if (arDetectMarker2(arHandle->xsize, arHandle->ysize, labelInfo, arHandle->arImageProcMode, arHandle->areaMax, arHandle->areaMin, arHandle->squareFitThresh, markerInfo2, marker2_num) < 0) return -1;
+    if (arGetMarkerInfo(frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat, markerInfo2, *marker2_num, arHandle->pattHandle, arHandle->arImageProcMode, arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf), arHandle->pattRatio, markerInfo, marker_num, arHandle->matrixCodeType) < 0) return -1;
+    return 0;
+}
+
+static int countIdentified(const ARMarkerInfo *markerInfo, const int marker_num)
+{
+    int i, count = 0;
+    for (i = 0; i < marker_num; i++) if (markerInfo[i].idPatt != -1 || markerInfo[i].idMatrix != -1) count++;
+    return count;
+}
+
+static void runBracket(ARLabelingBracket *b)
+{
+    b->ret = detectAtThreshold(b->arHandle, b->frame, b->thresh, &(b->labelInfo), b->markerInfo2, &(b->marker2_num), b->markerInfo, &(b->marker_num));
+}
+
+static void *bracketWorker(THREAD_HANDLE_T *threadHandle)
+{
+    ARLabelingBracket *b = (ARLabelingBracket *)threadGetArg(threadHandle);
+    
+    while (threadStartWait(threadHandle) == 0) {
+        runBracket(b);
+        threadEndSignal(threadHandle);
+    }
+    return (NULL);
+}
+
+static struct _ARLabelingBrackets *bracketsInit(ARHandle *arHandle)
+{
+    struct _ARLabelingBrackets *brackets;
+    int i;
+    
+    arMalloc(brackets, struct _ARLabelingBrackets, 1);
+    for (i = 0; i < AR_LABELING_BRACKET_WORKER_COUNT; i++) {
+        ARLabelingBracket *b = &(brackets->bracket[i]);
+        arMalloc(b->labelInfo.labelImage, AR_LABELING_LABEL_TYPE, arHandle->xsize*arHandle->ysize);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        b->labelInfo.bwImage = NULL;
+#endif
+        b->labelInfo.label_num = 0;
+        b->marker2_num = 0;
+        b->marker_num = 0;
+        b->threadHandle = threadInit(i, b, bracketWorker);
+        if (!b->threadHandle) ARLOGw("Unable to start auto threshold (bracket) worker thread. Brackets will be evaluated serially.\n");
+    }
+    return (brackets);
+}
+
+int arLabelingBracketDetect(ARHandle *arHandle, AR2VideoBufferT *frame, const int thresholds[3], int marker_nums[3])
+{
+    ARLabelingBracket *b;
+    int i, ret;
+    
+    if (!arHandle || !frame) return (-1);
+    
+    if (!arHandle->labelingBrackets) arHandle->labelingBrackets = bracketsInit(arHandle);
+    
+    for (i = 0; i < AR_LABELING_BRACKET_WORKER_COUNT; i++) {
+        b = &(arHandle->labelingBrackets->bracket[i]);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        // Keep the workspace debug image in step with arHandle's, so that the two may be exchanged.
+        if (arHandle->arDebug == AR_DEBUG_ENABLE) {
+            if (!b->labelInfo.bwImage) arMalloc(b->labelInfo.bwImage, ARUint8, arHandle->xsize * arHandle->ysize);
+        } else if (b->labelInfo.bwImage) {
+            free(b->labelInfo.bwImage);
+            b->labelInfo.bwImage = NULL;
+        }
+#endif
+        b->arHandle = arHandle;
+        b->frame = frame;
+        b->thresh = thresholds[i];
+        if (b->threadHandle) threadStartSignal(b->threadHandle);
+    }
+    
+    ret = detectAtThreshold(arHandle, frame, thresholds[2], &(arHandle->labelInfo), arHandle->markerInfo2, &(arHandle->marker2_num), arHandle->markerInfo, &(arHandle->marker_num));
+    marker_nums[2] = countIdentified(arHandle->markerInfo, arHandle->marker_num);
+    
+    for (i = 0; i < AR_LABELING_BRACKET_WORKER_COUNT; i++) {
+        b = &(arHandle->labelingBrackets->bracket[i]);
+        if (b->threadHandle) threadEndWait(b->threadHandle);
+        else runBracket(b);
+        if (b->ret < 0) ret = -1;
+        marker_nums[i] = countIdentified(b->markerInfo, b->marker_num);
+    }
+    
+    return (ret);
+}
+
+int arLabelingBracketAdopt(ARHandle *arHandle, int bracket)
+{
+    ARLabelingBracket *b;
+    AR_LABELING_LABEL_TYPE *labelImage;
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    ARUint8 *bwImage;
+#endif
+    
+    if (!arHandle || !arHandle->labelingBrackets || bracket < 0 || bracket >= AR_LABELING_BRACKET_WORKER_COUNT) return (-1);
+    b = &(arHandle->labelingBrackets->bracket[bracket]);
+    
+    // Exchange label images, so that arHandle owns the images matching its results.
+    labelImage = arHandle->labelInfo.labelImage;
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    bwImage = arHandle->labelInfo.bwImage;
+#endif
+    arHandle->labelInfo = b->labelInfo;
+    b->labelInfo.labelImage = labelImage;
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    b->labelInfo.bwImage = bwImage;
+#endif
+    
+    arHandle->marker2_num = b->marker2_num;
+    memcpy(arHandle->markerInfo2, b->markerInfo2, b->marker2_num * sizeof(ARMarkerInfo2));
+    arHandle->marker_num = b->marker_num;
+    memcpy(arHandle->markerInfo, b->markerInfo, b->marker_num * sizeof(ARMarkerInfo));
+    
+    return (0);
+}
+
+void arLabelingBracketFinal(ARHandle *arHandle)
+{
+    int i;
+    
+    if (!arHandle || !arHandle->labelingBrackets) return;
+    
+    for (i = 0; i < AR_LABELING_BRACKET_WORKER_COUNT; i++) {
+        ARLabelingBracket *b = &(arHandle->labelingBrackets->bracket[i]);
+        if (b->threadHandle) {
+            threadWaitQuit(b->threadHandle);
+            threadFree(&(b->threadHandle));
+        }
+        free(b->labelInfo.labelImage);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        free(b->labelInfo.bwImage);
+#endif
+    }
+    free(arHandle->labelingBrackets);
+    arHandle->labelingBrackets = NULL;
+}
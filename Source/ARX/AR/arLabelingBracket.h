@@ -0,0 +1,66 @@
+/*
+ *  arLabelingBracket.h
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2026 artoolkitX contributors.
+ *
+ *  Author(s): artoolkitX contributors.
+ *
+ */
+
+#ifndef AR_LABELING_BRACKET_H
+#define AR_LABELING_BRACKET_H
+
+#include <ARX/AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Evaluate labelling, square detection and pattern matching at each of the three
+// thresholds of an auto-threshold bracket. thresholds[0] and thresholds[1] are evaluated
+// in parallel on worker threads into per-bracket workspaces, and thresholds[2] is evaluated
+// on the calling thread directly into arHandle->labelInfo, markerInfo2 and markerInfo.
+// On return, marker_nums[i] holds the number of identified markers at thresholds[i].
+// Workspaces and threads are created on first use and held in arHandle->labelingBrackets.
+int arLabelingBracketDetect(ARHandle *arHandle, AR2VideoBufferT *frame, const int thresholds[3], int marker_nums[3]);
+
+// Move the results from the workspace for thresholds[bracket] (0 or 1) of the last call to
+// arLabelingBracketDetect() into arHandle. The result is identical to repeating detection
+// at that threshold directly into arHandle.
+int arLabelingBracketAdopt(ARHandle *arHandle, int bracket);
+
+// Stop worker threads and free workspaces.
+void arLabelingBracketFinal(ARHandle *arHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AR_LABELING_BRACKET_H
@@ -48,7 +48,20 @@
 
 #include <ARX/AR/ar.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#if defined(ANDROID)
+#  include <malloc.h>
+#  define AR_PAGE_ALIGNED_ALLOC(s) memalign(4096,s)
+#  define AR_PAGE_ALIGNED_FREE(p) free(p)
+#elif defined(_WIN32)
+#  define AR_PAGE_ALIGNED_ALLOC(s) _aligned_malloc(s, 4096)
+#  define AR_PAGE_ALIGNED_FREE(p) _aligned_free(p)
+#else
+#  define AR_PAGE_ALIGNED_ALLOC(s) valloc(s)
+#  define AR_PAGE_ALIGNED_FREE(p) free(p)
+#endif
 
 ARPattHandle *arPattCreateHandle(void)
 {
@@ -81,6 +94,19 @@ ARPattHandle *arPattCreateHandle2(const int pattSize, const int patternCountMax)
             arMalloc(pattHandle->pattBW[i*4 + j], int, pattSize*pattSize);
         }
     }
+    
+    // 16-bit copies of the patterns for template matching. Each orientation is padded to a whole
+    // number of 32-byte vectors, and the blocks are page-aligned, so that every orientation is aligned.
+    pattHandle->pattBlockStride = (pattSize*pattSize*3 + 15) & ~15;
+    pattHandle->pattBWBlockStride = (pattSize*pattSize + 15) & ~15;
+    pattHandle->pattBlock = (ARInt16 *)AR_PAGE_ALIGNED_ALLOC(patternCountMax*4*pattHandle->pattBlockStride*sizeof(ARInt16));
+    pattHandle->pattBWBlock = (ARInt16 *)AR_PAGE_ALIGNED_ALLOC(patternCountMax*4*pattHandle->pattBWBlockStride*sizeof(ARInt16));
+    if (!pattHandle->pattBlock || !pattHandle->pattBWBlock) {
+        ARLOGe("Out of memory!!\n");
+        exit(1);
+    }
+    memset(pattHandle->pattBlock, 0, patternCountMax*4*pattHandle->pattBlockStride*sizeof(ARInt16));
+    memset(pattHandle->pattBWBlock, 0, patternCountMax*4*pattHandle->pattBWBlockStride*sizeof(ARInt16));
 
     return pattHandle;
 }
@@ -104,6 +130,8 @@ int arPattDeleteHandle(ARPattHandle *pattHandle)
 	free(pattHandle->pattf);
 	free(pattHandle->pattpow);
 	free(pattHandle->pattpowBW);
+	AR_PAGE_ALIGNED_FREE(pattHandle->pattBlock);
+	AR_PAGE_ALIGNED_FREE(pattHandle->pattBWBlock);
 	
 	free(pattHandle);
 	pattHandle = NULL;
@@ -51,6 +51,11 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdbool.h>
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#endif
 #if DEBUG_PATT_GETID
 #  ifndef __APPLE__
 #    include <GL/gl.h>
@@ -99,6 +104,7 @@ int  cnt = 1;
 
 static void   get_cpara( ARdouble world[4][2], ARdouble vertex[4][2],
                          ARdouble para[3][3] );
+static int    pattern_correlate( const ARInt16 *input, const ARInt16 *patt, const int count );
 static int    pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int size,
                              int *code, int *dir, ARdouble *cf );
 static int    decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t in, uint8_t recd127[127], uint64_t *out_p);
@@ -1689,9 +1695,46 @@ static void get_cpara( ARdouble world[4][2], ARdouble vertex[4][2],
     arMatrixFree( c );
 }
 
+// Dot product of count 16-bit values, where count is a multiple of 16 and patt is 16-byte aligned.
+// Products are summed in pairs into 32-bit lanes, so the result is exactly the scalar integer sum.
+static int pattern_correlate( const ARInt16 *input, const ARInt16 *patt, const int count )
+{
+    int i;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    int32x4_t acc0 = vdupq_n_s32(0);
+    int32x4_t acc1 = vdupq_n_s32(0);
+    for (i = 0; i < count; i += 8) {
+        int16x8_t in = vld1q_s16(input + i);
+        int16x8_t pt = vld1q_s16(patt + i);
+        acc0 = vmlal_s16(acc0, vget_low_s16(in), vget_low_s16(pt));
+        acc1 = vmlal_s16(acc1, vget_high_s16(in), vget_high_s16(pt));
+    }
+    acc0 = vaddq_s32(acc0, acc1);
+    return (vgetq_lane_s32(acc0, 0) + vgetq_lane_s32(acc0, 1) + vgetq_lane_s32(acc0, 2) + vgetq_lane_s32(acc0, 3));
+#elif HAVE_INTEL_SIMD
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    for (i = 0; i < count; i += 16) {
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(input + i)), _mm_load_si128((const __m128i *)(patt + i))));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(input + i + 8)), _mm_load_si128((const __m128i *)(patt + i + 8))));
+    }
+    acc0 = _mm_add_epi32(acc0, acc1);
+    acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (_mm_cvtsi128_si32(acc0));
+#else
+    int sum = 0;
+    for (i = 0; i < count; i++) sum += input[i] * patt[i];
+    return (sum);
+#endif
+}
+
 static int pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int size, int *code, int *dir, ARdouble *cf )
 {
-    int   *input = NULL;
+    ARInt16  input[AR_PATT_SIZE1_MAX*AR_PATT_SIZE1_MAX*3]; // Zero-mean input pattern, zero-padded to the pattern block stride.
+    const ARInt16 *pattBlock;
+    const ARdouble *pattpow;
+    int    pattCount, stride;
     int    sum, ave;
     int    res1, res2;
     int    i, j, k, l;
@@ -1706,110 +1749,58 @@ static int pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int
     }
 
     if ( mode == AR_TEMPLATE_MATCHING_COLOR ) {
-        const int SIZE_SQD_X3 = size*size*3;
-        
-        arMalloc( input, int, SIZE_SQD_X3 );
-        if ( NULL == input ) {
-            return -1;
-        }
-
-        sum = ave = 0;
-        for (i=0; i < SIZE_SQD_X3; i++) {
-            ave += (255-data[i]);
-        }
-        ave /= (SIZE_SQD_X3);
-
-        for (i=0; i < SIZE_SQD_X3; i++) {
-            input[i] = (255-data[i]) - ave;
-            sum += input[i]*input[i];
-        }
-
-        datapow = SQRT( (ARdouble)sum );
-        //if( datapow == 0.0 ) {
-        if ( datapow/(size*SQRT_3_0) < AR_PATT_CONTRAST_THRESH1 ) {
-            *code = 0;
-            *dir  = 0;
-            *cf   = -_1_0;
-            free( input );
-            return -2; // Insufficient contrast.
-        }
-
-        res1 = res2 = -1;
-        k = -1; // Best match in search space.
-        max = _0_0;
-        for ( l = 0; l < pattHandle->patt_num; l++ ) { // Consider the whole search space.
-            k++;
-            while( pattHandle->pattf[k] == 0 ) k++; // No pattern at this slot.
-            if( pattHandle->pattf[k] == 2 ) continue; // Pattern at this slot is deactivated.
-            for( j = 0; j < 4; j++ ) { // The 4 rotated variants of the pattern.
-                sum = 0;
-                for(i=0; i < SIZE_SQD_X3; i++)
-                    sum += input[i] * pattHandle->patt[k * 4 + j][i]; // Correlation operation.
-                sum2 = sum / pattHandle->pattpow[k*4 + j] / datapow;
-                if( sum2 > max ) { max = sum2; res1 = j; res2 = k; }
-            }
-        }
-        *dir  = res1;
-        *code = res2;
-        *cf   = max;
+        pattCount = size*size*3;
+        pattBlock = pattHandle->pattBlock;
+        pattpow = pattHandle->pattpow;
+        stride = pattHandle->pattBlockStride;
+    } else if ( mode == AR_TEMPLATE_MATCHING_MONO ) {
+        pattCount = size*size;
+        pattBlock = pattHandle->pattBWBlock;
+        pattpow = pattHandle->pattpowBW;
+        stride = pattHandle->pattBWBlockStride;
+    } else {
+        return -1;
+    }
 
-        free( input );
-        return 0;
+    sum = ave = 0;
+    for ( i=0; i < pattCount; i++ ) {
+        ave += (255-data[i]);
     }
-    else if ( mode == AR_TEMPLATE_MATCHING_MONO ) {
-        const int SIZE_SQD = size*size;
+    ave /= (pattCount);
 
-        arMalloc( input, int, SIZE_SQD );
-        if ( NULL == input ) {
-            return -1;
-        }
-        
-        sum = ave = 0;
-        for ( i=0; i < SIZE_SQD; i++ ) {
-            ave += (255-data[i]);
-        }
-        ave /= (SIZE_SQD);
+    for ( i=0; i < pattCount; i++ ) {
+        input[i] = (ARInt16)((255-data[i]) - ave);
+        sum += input[i] * input[i];
+    }
+    for ( ; i < stride; i++ ) input[i] = 0;
 
-        for ( i=0; i < SIZE_SQD; i++ ) {
-            input[i] = (255-data[i]) - ave;
-            sum += input[i] * input[i];
-        }
+    datapow = SQRT( (ARdouble)sum );
+    //if( datapow == 0.0 ) {
+    if ( (mode == AR_TEMPLATE_MATCHING_COLOR ? datapow/(size*SQRT_3_0) : datapow/size) < AR_PATT_CONTRAST_THRESH1 ) {
+        *code = 0;
+        *dir  = 0;
+        *cf   = -_1_0;
+        return -2; // Insufficient contrast.
+    }
 
-        datapow = SQRT( (ARdouble)sum );
-        //if( datapow == 0.0 ) {
-        if ( datapow/size < AR_PATT_CONTRAST_THRESH1 ) {
-            *code = 0;
-            *dir  = 0;
-            *cf   = -_1_0;
-            free( input );
-            return -2; // Insufficient contrast.
-        }
-
-        res1 = res2 = -1;
-        k = -1;
-        max = _0_0;
-        for ( l = 0; l < pattHandle->patt_num; l++ ) {
-            k++;
-            while ( pattHandle->pattf[k] == 0 ) k++;
-            if ( pattHandle->pattf[k] == 2 ) continue;
-            for ( j = 0; j < 4; j++ ) {
-                sum = 0;
-                for ( i=0; i < SIZE_SQD; i++ )
-                    sum += input[i] * (pattHandle->pattBW[k * 4 + j][i]);
-                sum2 = sum / pattHandle->pattpowBW[k * 4 + j] / datapow;
-                if ( sum2 > max ) { max = sum2; res1 = j; res2 = k; }
-            }
+    res1 = res2 = -1;
+    k = -1; // Best match in search space.
+    max = _0_0;
+    for ( l = 0; l < pattHandle->patt_num; l++ ) { // Consider the whole search space.
+        k++;
+        while ( pattHandle->pattf[k] == 0 ) k++; // No pattern at this slot.
+        if ( pattHandle->pattf[k] == 2 ) continue; // Pattern at this slot is deactivated.
+        for ( j = 0; j < 4; j++ ) { // The 4 rotated variants of the pattern.
+            sum = pattern_correlate(input, pattBlock + (k*4 + j)*stride, stride); // Correlation operation.
+            sum2 = sum / pattpow[k*4 + j] / datapow;
+            if ( sum2 > max ) { max = sum2; res1 = j; res2 = k; }
         }
-        *dir  = res1;
-        *code = res2;
-        *cf   = max;
-
-        free( input );
-        return 0;
-    }
-    else {
-        return -1;
     }
+    *dir  = res1;
+    *code = res2;
+    *cf   = max;
+
+    return 0;
 }
 
 static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t in, uint8_t recd127[127], uint64_t *out_p)
@@ -131,6 +131,14 @@ int arPattLoadFromBuffer(ARPattHandle *pattHandle, const char *buffer) {
         }
         pattHandle->pattpowBW[patno*4 + h] = sqrt((ARdouble)m);
         if( pattHandle->pattpowBW[patno*4 + h] == 0.0 ) pattHandle->pattpowBW[patno*4 + h] = 0.0000001;
+
+        // Keep 16-bit copies for template matching. Values are in range [-255, 255]. Padding stays zero.
+        for( i = 0; i < pattHandle->pattSize*pattHandle->pattSize*3; i++ ) {
+            pattHandle->pattBlock[(patno*4 + h)*pattHandle->pattBlockStride + i] = (ARInt16)pattHandle->patt[patno*4 + h][i];
+        }
+        for( i = 0; i < pattHandle->pattSize*pattHandle->pattSize; i++ ) {
+            pattHandle->pattBWBlock[(patno*4 + h)*pattHandle->pattBWBlockStride + i] = (ARInt16)pattHandle->pattBW[patno*4 + h][i];
+        }
     }
 
     free(bufCopy);
@@ -0,0 +1,171 @@
+/*
+ *  arRefineMarkers.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2026 artoolkitX contributors.
+ *
+ *  Author(s): artoolkitX contributors.
+ *
+ */
+
+#include "arRefineMarkers.h"
+
+#if !HAVE_OPENCV
+
+void arRefineMarkers(ARHandle *arHandle, AR2VideoBufferT *frame)
+{
+    // Corner refinement requires OpenCV, so there is nothing to do.
+    (void)arHandle;
+    (void)frame;
+}
+
+void arRefineMarkersFinal(ARHandle *arHandle)
+{
+    (void)arHandle;
+}
+
+#else
+
+#include "arRefineCorners.h"
+#include <ARX/ARUtil/thread_sub.h>
+
+#define AR_REFINE_MARKERS_WORKER_COUNT 3
+#define AR_REFINE_MARKERS_PARALLEL_MIN 4 // Fewer markers than this are refined on the calling thread alone.
+
+typedef struct {
+    ARHandle          *arHandle;
+    AR2VideoBufferT   *frame;
+    int                share;       // This worker refines markers share, share + shares, share + 2*shares, ...
+    int                shares;
+    THREAD_HANDLE_T   *threadHandle;
+} ARRefineMarkersWorker;
+
+struct _ARRefineMarkers {
+    ARRefineMarkersWorker worker[AR_REFINE_MARKERS_WORKER_COUNT];
+};
+
+static void refineMarker(ARHandle *arHandle, AR2VideoBufferT *frame, ARMarkerInfo *markerInfo)
+{
+    ARfloat obVertex[4][2];
+    int i;
+    
+    for (i = 0; i < 4; i++) {
+        arParamIdeal2ObservLTf(&arHandle->arParamLT->paramLTf, (float)markerInfo->vertex[i][0], (float)markerInfo->vertex[i][1], &obVertex[i][0], &obVertex[i][1]);
+    }
+    arRefineCorners((float (*)[2])obVertex, frame->buffLuma, arHandle->xsize, arHandle->ysize);
+    for (i = 0; i < 4; i++) {
+        float newX, newY;
+        arParamObserv2IdealLTf(&arHandle->arParamLT->paramLTf, obVertex[i][0], obVertex[i][1], &newX, &newY);
+        markerInfo->vertex[i][0] = (ARdouble)newX;
+        markerInfo->vertex[i][1] = (ARdouble)newY;
+    }
+}
+
+static void refineShare(ARHandle *arHandle, AR2VideoBufferT *frame, int share, int shares)
+{
+    int i;
+    for (i = share; i < arHandle->marker_num; i += shares) refineMarker(arHandle, frame, &(arHandle->markerInfo[i]));
+}
+
+static void *refineWorker(THREAD_HANDLE_T *threadHandle)
+{
+    ARRefineMarkersWorker *w = (ARRefineMarkersWorker *)threadGetArg(threadHandle);
+    
+    while (threadStartWait(threadHandle) == 0) {
+        refineShare(w->arHandle, w->frame, w->share, w->shares);
+        threadEndSignal(threadHandle);
+    }
+    return (NULL);
+}
+
+static struct _ARRefineMarkers *workersInit(void)
+{
+    struct _ARRefineMarkers *workers;
+    int i;
+    
+    arMalloc(workers, struct _ARRefineMarkers, 1);
+    for (i = 0; i < AR_REFINE_MARKERS_WORKER_COUNT; i++) {
+        workers->worker[i].threadHandle = threadInit(i, &(workers->worker[i]), refineWorker);
+        if (!workers->worker[i].threadHandle) ARLOGw("Unable to start corner refinement worker thread. Its markers will be refined serially.\n");
+    }
+    return (workers);
+}
+
+void arRefineMarkers(ARHandle *arHandle, AR2VideoBufferT *frame)
+{
+    ARRefineMarkersWorker *w;
+    int i, shares;
+    
+    if (!arHandle || !frame || !frame->buffLuma) return;
+    
+    if (arHandle->marker_num < AR_REFINE_MARKERS_PARALLEL_MIN) {
+        refineShare(arHandle, frame, 0, 1);
+        return;
+    }
+    
+    if (!arHandle->refineMarkers) arHandle->refineMarkers = workersInit();
+    
+    // The calling thread takes share 0, and the workers the rest.
+    shares = AR_REFINE_MARKERS_WORKER_COUNT + 1;
+    for (i = 0; i < AR_REFINE_MARKERS_WORKER_COUNT; i++) {
+        w = &(arHandle->refineMarkers->worker[i]);
+        w->arHandle = arHandle;
+        w->frame = frame;
+        w->share = i + 1;
+        w->shares = shares;
+        if (w->threadHandle) threadStartSignal(w->threadHandle);
+    }
+    
+    refineShare(arHandle, frame, 0, shares);
+    
+    for (i = 0; i < AR_REFINE_MARKERS_WORKER_COUNT; i++) {
+        w = &(arHandle->refineMarkers->worker[i]);
+        if (w->threadHandle) threadEndWait(w->threadHandle);
+        else refineShare(arHandle, frame, w->share, w->shares);
+    }
+}
+
+void arRefineMarkersFinal(ARHandle *arHandle)
+{
+    int i;
+    
+    if (!arHandle || !arHandle->refineMarkers) return;
+    
+    for (i = 0; i < AR_REFINE_MARKERS_WORKER_COUNT; i++) {
+        ARRefineMarkersWorker *w = &(arHandle->refineMarkers->worker[i]);
+        if (w->threadHandle) {
+            threadWaitQuit(w->threadHandle);
+            threadFree(&(w->threadHandle));
+        }
+    }
+    free(arHandle->refineMarkers);
+    arHandle->refineMarkers = NULL;
+}
+
+#endif // HAVE_OPENCV
@@ -274,6 +274,10 @@ typedef struct {
     ARdouble       *pattpowBW;      ///< Root-mean-square of the pattern intensities.
     //ARdouble        pattRatio;      ///< 
     int             pattSize;       ///< Number of rows/columns in the pattern.
+    ARInt16        *pattBlock;      ///< Contiguous copy of the values in patt as 16-bit integers, with each orientation of each pattern starting at a multiple of pattBlockStride, zero-padded. Used for template matching.
+    ARInt16        *pattBWBlock;    ///< Contiguous copy of the values in pattBW as 16-bit integers, with each orientation of each pattern starting at a multiple of pattBWBlockStride, zero-padded. Used for template matching.
+    int             pattBlockStride;   ///< Number of elements per pattern orientation in pattBlock. A multiple of 16.
+    int             pattBWBlockStride; ///< Number of elements per pattern orientation in pattBWBlock. A multiple of 16.
 } ARPattHandle;
 
 /*!
@@ -372,6 +376,8 @@ typedef struct {
     ARdouble           areaMax;
     ARdouble           areaMin;
     ARdouble           squareFitThresh;
+    struct _ARLabelingBrackets *labelingBrackets;           ///< Private. When arLabelingThreshMode is AR_LABELING_THRESH_MODE_AUTO_BRACKETING, per-threshold workspaces and worker threads. Allocated as required.
+    struct _ARRefineMarkers *refineMarkers;                 ///< Private. When arCornerRefinementMode is AR_CORNER_REFINEMENT_ENABLE, worker threads for corner refinement. Allocated as required.
 } ARHandle;
 
 
@@ -843,7 +849,8 @@ AR_EXTERN ARdouble arGetSquareFitThresh(ARHandle *handle);
 /*!
     @brief   Enable or disable square tracking subpixel corner refinement.
     @details If compiled with OpenCV available, the square tracker allows
-        marker corner locations to be subpixel-refined.
+        marker corner locations to be subpixel-refined. The corners of every
+        detected marker are refined, in parallel when there are several.
     @param      handle Handle to settings structure in which to enable or disable subpixel corner refinement.
 	@param      mode
 		Options for this field are:
@@ -75,6 +75,8 @@ struct _ARImageProcInfo {
     unsigned char max;                  ///< Maximum luminance.
 #if AR_IMAGEPROC_USE_VIMAGE
     void *tempBuffer;                   ///< Extra buffer when using macOS/iOS vImage framework.
+#else
+    unsigned int *__restrict colSums;   ///< Running column sums for box filter, allocated as required.
 #endif
 };
 typedef struct _ARImageProcInfo ARImageProcInfo;
@@ -182,6 +184,10 @@ int arImageProcLumaHistAndOtsu(ARImageProcInfo *ipi, const ARUint8 *__restrict d
     @details 
         See https://developer.apple.com/library/ios/documentation/Performance/Reference/vImage_convolution/
         On macOS and iOS, the calculation is accelerated using the Accelerate framework.
+        On other platforms, a separable running-sum filter is used, which costs O(1) per
+        pixel regardless of boxSize, with SSE2 or NEON acceleration of the vertical pass
+        where available. Output is identical to a direct evaluation of the kernel, with
+        the kernel truncated at the image edges.
     @param ipi ARImageProcInfo structure describing the format of the image
         to be processed, as created by arImageProcInit.
     @result 0 in case of success, or a value less than 0 in case of error.
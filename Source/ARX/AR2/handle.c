@@ -116,8 +116,15 @@ static AR2HandleT *ar2CreateHandleSub( int pixFormat, int xsize, int ysize, int
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
         ar2Handle->arg[i].templ2 = NULL;
 #endif
+        ar2Handle->arg[i].busyTime = 0.0F;
         ar2Handle->threadHandle[i] = threadInit(i, &(ar2Handle->arg[i]), ar2Tracking2d);
     }
+    ar2Handle->taskQueue = threadQueueInit();
+    if( ar2Handle->taskQueue == NULL ) {
+        ARLOGe("Out of memory!!\n");
+        exit(1);
+    }
+    ar2Handle->idleTime = 0.0F;
 
     return ar2Handle;
 }
@@ -138,6 +145,8 @@ int ar2DeleteHandle( AR2HandleT **ar2Handle )
 #endif
     }
 
+    threadQueueFree( &((*ar2Handle)->taskQueue) );
+
     if( (*ar2Handle)->icpHandle != NULL ) icpDeleteHandle( &((*ar2Handle)->icpHandle) );
     //if( (*ar2Handle)->cparamLT  != NULL ) arParamLTFree( (*ar2Handle)->cparamLT );
     free( *ar2Handle );
@@ -205,6 +214,13 @@ int ar2GetSimThresh( AR2HandleT *ar2Handle, float  *simThresh )
     return 0;
 }
 
+int ar2GetWorkerIdleTime( AR2HandleT *ar2Handle, float  *idleTime )
+{
+    if( ar2Handle == NULL ) return -1;
+    *idleTime = ar2Handle->idleTime;
+    return 0;
+}
+
 int ar2SetTrackingThresh( AR2HandleT *ar2Handle, float  trackingThresh )
 {
     if( ar2Handle == NULL ) return -1;
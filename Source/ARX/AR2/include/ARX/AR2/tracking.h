@@ -96,19 +96,25 @@ typedef struct {
 typedef struct _AR2HandleT           AR2HandleT;
 typedef struct _AR2Tracking2DParamT  AR2Tracking2DParamT;
 
+// One template to be matched by ar2Tracking2d(), and its result.
+typedef struct {
+    AR2TemplateCandidateT   *candidate;
+    AR2Tracking2DResultT     result;
+    int                      ret;
+} AR2Tracking2DTaskT;
+
 // Structure to pass parameters to threads spawned to run ar2Tracking2d().
+// Each thread takes tasks from the parent AR2HandleT's taskQueue until none remain.
 struct _AR2Tracking2DParamT {
     struct _AR2HandleT      *ar2Handle;  // Reference to parent AR2HandleT.
     AR2SurfaceSetT          *surfaceSet;
-    AR2TemplateCandidateT   *candidate;
     ARUint8                 *dataPtr;    // Input image.
     ARUint8                 *mfImage;    // (Internally allocated buffer same size as input image).
     AR2TemplateT            *templ;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     AR2Template2T           *templ2;
 #endif
-    AR2Tracking2DResultT     result;
-    int                      ret;
+    float                    busyTime;   // Time spent taking and matching tasks during the last call to ar2Tracking(), in milliseconds.
 };
 
 struct _AR2HandleT {
@@ -141,6 +147,12 @@ struct _AR2HandleT {
     int                       threadNum;
     struct _AR2Tracking2DParamT       arg[AR2_THREAD_MAX];
     THREAD_HANDLE_T          *threadHandle[AR2_THREAD_MAX];
+    AR2Tracking2DTaskT        task[AR2_SEARCH_FEATURE_MAX];
+    int                       taskNum;   // Number of tasks selected for the pass in progress.
+    THREAD_QUEUE_T           *taskQueue;
+    uint64_t                  matchStartSec;
+    uint32_t                  matchStartUsec;
+    float                     idleTime;  // Total time worker threads spent waiting for other workers to finish during the last call to ar2Tracking(), in milliseconds.
 };
 
 
@@ -169,6 +181,41 @@ struct _AR2HandleT {
  */
 int             ar2Tracking              ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
                                            ARUint8 *dataPtr, float  trans[3][4], float  *err );
+
+/*!
+    Perform NFT texture tracking on a pair of frames from a stereo camera.
+        Templates are matched in both images, each using its own AR2HandleT and tracking threads,
+        and a single pose is then solved for using the matches from both images together.
+        Compared to tracking each image separately, this gives a pose with less jitter, and
+        tracking continues while the surface is visible to either camera.
+ 
+        ar2SetInitTrans() must be called on surfaceSetL (only) to set the initial tracking transform,
+        in the left camera's coordinate frame. surfaceSetR must be a separate AR2SurfaceSetT referring
+        to the same surfaces as surfaceSetL (e.g. a structure copy of it); this function keeps its pose
+        history in step with surfaceSetL's, but it holds the features used in the right image.
+ 
+        Only AR2_TRACKING_6DOF mode is supported.
+    @param ar2HandleL Tracking settings structure for the left camera, as returned via ar2CreateHandle.
+    @param ar2HandleR Tracking settings structure for the right camera, as returned via ar2CreateHandle.
+        The tracking threshold used is that of ar2HandleL.
+    @param icpStereoHandle Stereo ICP handle, created with the left and right camera matrices, with
+        matC2L the identity transform and matC2R equal to transL2R.
+    @param surfaceSetL Tracking surface set, as returned via ar2ReadSurfaceSet.
+    @param surfaceSetR Right camera copy of surfaceSetL.
+    @param dataPtrL Pointer to left image data on which tracking will be performed.
+    @param dataPtrR Pointer to right image data on which tracking will be performed.
+    @param transL2R Transform from left camera coordinates to right camera coordinates.
+    @param trans Pointer to a float[3][4] array which will be filled out with the pose, relative to the left camera.
+    @param err On successful return, will be filled out with pose error value.
+    @param numL If non-NULL, will be filled out with the number of templates matched in the left image.
+    @param numR If non-NULL, will be filled out with the number of templates matched in the right image.
+    @result 0 in case of successful tracking, or &lt; 0 in case of error. Error codes are as for ar2Tracking().
+    @see ar2Tracking ar2Tracking
+ */
+int             ar2TrackingStereo        ( AR2HandleT *ar2HandleL, AR2HandleT *ar2HandleR, ICPStereoHandleT *icpStereoHandle,
+                                           AR2SurfaceSetT *surfaceSetL, AR2SurfaceSetT *surfaceSetR,
+                                           ARUint8 *dataPtrL, ARUint8 *dataPtrR, float  transL2R[3][4],
+                                           float  trans[3][4], float  *err, int *numL, int *numR );
 void           *ar2Tracking2d            ( THREAD_HANDLE_T *threadHandle );
 /*
 int             ar2Tracking2d            ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
@@ -369,6 +416,19 @@ int             ar2SetSimThresh          ( AR2HandleT *ar2Handle, float   simThr
  */
 int             ar2GetSimThresh          ( AR2HandleT *ar2Handle, float  *simThresh      );
 
+/*!
+    Get the time tracking threads spent idle during the last tracking pass.
+        Templates are matched by a pool of tracking threads, which each take the next
+        unmatched template as soon as they are free. Once no templates remain, threads
+        which have finished wait for the others. This function reports the total of this
+        waiting time, summed over all threads, for the most recent call to ar2Tracking.
+    @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
+    @param idleTime Pointer to a float, which on return will be filled with the idle time, in milliseconds.
+    @result -1 in case of error, or 0 otherwise.
+    @see ar2Tracking ar2Tracking
+ */
+int             ar2GetWorkerIdleTime     ( AR2HandleT *ar2Handle, float  *idleTime       );
+
 /*!
     Set threshold value for acceptable pose estimate error.
         During the final phase of a single tracking pass, the pose estimate is calculated,
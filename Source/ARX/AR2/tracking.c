@@ -49,6 +49,7 @@
 #include <ARX/AR2/featureSet.h>
 #include <ARX/AR2/template.h>
 #include <ARX/AR2/tracking.h>
+#include <ARX/ARUtil/time.h>
 
 static float  ar2GetTransMat            ( ICPHandleT *icpHandle, float  initConv[3][4],
                                           float  pos2d[][2], float  pos3d[][3], int num, float  conv[3][4], int robustMode );
@@ -63,17 +64,24 @@ static int    extractVisibleFeaturesHomography( int xsize, int ysize, float  tra
                                           AR2TemplateCandidateT candidate[],
                                           AR2TemplateCandidateT candidate2[] );
 static int    getDeltaS( float  H[8], float  dU[], float  J_U_H[][8], int n );
+static int    ar2TrackingMatchStart     ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr );
+static int    ar2TrackingMatchEnd       ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, int threadNum, float *aveBlur );
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+static void   ar2UpdateBlurLevel        ( AR2HandleT *ar2Handle, float aveBlur, int num );
+#endif
+static void   ar2PushTrans              ( AR2SurfaceSetT *surfaceSet, float trans[3][4] );
+static float  ar2GetTransMatStereo      ( ICPStereoHandleT *icpStereoHandle, float  initConv[3][4],
+                                          float  pos2dL[][2], float  pos3dL[][3], int numL,
+                                          float  pos2dR[][2], float  pos3dR[][3], int numR,
+                                          float  conv[3][4], int robustMode );
 
 
 int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr, float  trans[3][4], float  *err )
 {
-    AR2TemplateCandidateT  *candidatePtr;
-    AR2TemplateCandidateT  *cp[AR2_THREAD_MAX];
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     float                   aveBlur;
 #endif
-    int                     num, num2;
-    int                     i, j, k;
+    int                     num, threadNum;
 
     if (!ar2Handle || !surfaceSet || !dataPtr || !trans || !err) return (-1);
 
@@ -84,99 +92,12 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
 
     *err = 0.0F;
 
-    for( i = 0; i < surfaceSet->num; i++ ) {
-        arUtilMatMulf( (const float (*)[4])surfaceSet->trans1, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans1[i] );
-        if( surfaceSet->contNum > 1 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans2, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans2[i] );
-        if( surfaceSet->contNum > 2 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans3, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans3[i] );
-    }
-
-    if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
-        extractVisibleFeatures(ar2Handle->cparamLT, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
-    }
-    else {
-        extractVisibleFeaturesHomography(ar2Handle->xsize, ar2Handle->ysize, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
-    }
-
-    candidatePtr = ar2Handle->candidate;
+    threadNum = ar2TrackingMatchStart( ar2Handle, surfaceSet, dataPtr );
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-    aveBlur = 0.0F;
-#endif
-    i = 0; // Counts up to searchFeatureNum.
-    num = 0;
-    while( i < ar2Handle->searchFeatureNum ) {
-        num2 = num;
-        for( j = 0; j < ar2Handle->threadNum; j++ ) {
-            if( i == ar2Handle->searchFeatureNum ) break;
-
-            k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
-            if( k < 0 ) {
-                if( candidatePtr == ar2Handle->candidate ) {
-                    candidatePtr = ar2Handle->candidate2;
-                    k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
-                    if( k < 0 ) break; // PRL 2012-05-15: Give up if we can't select template from alternate candidate either.
-                }
-                else break;
-            }
-
-            cp[j] = &(candidatePtr[k]);
-            ar2Handle->pos[num2][0] = candidatePtr[k].sx;
-            ar2Handle->pos[num2][1] = candidatePtr[k].sy;
-            ar2Handle->arg[j].ar2Handle  = ar2Handle;
-            ar2Handle->arg[j].surfaceSet = surfaceSet;
-            ar2Handle->arg[j].candidate  = &(candidatePtr[k]);
-            ar2Handle->arg[j].dataPtr    = dataPtr;
-
-            threadStartSignal( ar2Handle->threadHandle[j] );
-            num2++;
-            if( num2 == 5 ) num2 = num;
-            i++;
-        }
-        k = j;
-        if( k == 0 ) break;
-
-        for( j = 0; j < k; j++ ) {
-            threadEndWait( ar2Handle->threadHandle[j] );
-
-            if( ar2Handle->arg[j].ret == 0 && ar2Handle->arg[j].result.sim > ar2Handle->simThresh ) {
-                if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
-#ifdef ARDOUBLE_IS_FLOAT
-                    arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,
-                                        ar2Handle->arg[j].result.pos2d[0], ar2Handle->arg[j].result.pos2d[1],
-                                        &ar2Handle->pos2d[num][0], &ar2Handle->pos2d[num][1], ar2Handle->cparamLT->param.dist_function_version);
+    num = ar2TrackingMatchEnd( ar2Handle, surfaceSet, threadNum, &aveBlur );
 #else
-                    ARdouble pos2d0, pos2d1;
-                    arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,                    
-                                        (ARdouble)(ar2Handle->arg[j].result.pos2d[0]), (ARdouble)(ar2Handle->arg[j].result.pos2d[1]),
-                                        &pos2d0, &pos2d1, ar2Handle->cparamLT->param.dist_function_version);
-                    ar2Handle->pos2d[num][0] = (float)pos2d0;
-                    ar2Handle->pos2d[num][1] = (float)pos2d1;
+    num = ar2TrackingMatchEnd( ar2Handle, surfaceSet, threadNum, NULL );
 #endif
-                }
-                else {
-                    ar2Handle->pos2d[num][0] = ar2Handle->arg[j].result.pos2d[0];
-                    ar2Handle->pos2d[num][1] = ar2Handle->arg[j].result.pos2d[1];
-                }
-                ar2Handle->pos3d[num][0] = ar2Handle->arg[j].result.pos3d[0];
-                ar2Handle->pos3d[num][1] = ar2Handle->arg[j].result.pos3d[1];
-                ar2Handle->pos3d[num][2] = ar2Handle->arg[j].result.pos3d[2];
-                ar2Handle->pos[num][0] = cp[j]->sx;
-                ar2Handle->pos[num][1] = cp[j]->sy;
-                ar2Handle->usedFeature[num].snum  = cp[j]->snum;
-                ar2Handle->usedFeature[num].level = cp[j]->level;
-                ar2Handle->usedFeature[num].num   = cp[j]->num;
-                ar2Handle->usedFeature[num].flag  = 0;
-#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-                aveBlur += ar2Handle->arg[j].result.blurLevel;
-#endif
-                num++;
-            }
-        }
-    }
-    for( i = 0; i < num; i++ ) {
-        surfaceSet->prevFeature[i] = ar2Handle->usedFeature[i];
-    }
-    surfaceSet->prevFeature[num].flag = -1;
-    //ARLOGd("------\nNum = %d\n", num);
 
     if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
         if( num < 3 ) {
@@ -246,15 +167,237 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
     }
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    ar2UpdateBlurLevel( ar2Handle, aveBlur, num );
+#endif
+
+    surfaceSet->contNum++;
+    ar2PushTrans( surfaceSet, trans );
+
+    return 0;
+}
+
+int ar2TrackingStereo( AR2HandleT *ar2HandleL, AR2HandleT *ar2HandleR, ICPStereoHandleT *icpStereoHandle,
+                       AR2SurfaceSetT *surfaceSetL, AR2SurfaceSetT *surfaceSetR,
+                       ARUint8 *dataPtrL, ARUint8 *dataPtrR, float  transL2R[3][4],
+                       float  trans[3][4], float  *err, int *numL, int *numR )
+{
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    float                   aveBlurL, aveBlurR;
+#endif
+    float                   transR[3][4];
+    int                     nL, nR, threadNumL, threadNumR;
+    int                     i;
+    static const float      inlierProb[4] = {0.8F, 0.6F, 0.4F, 0.0F};
+
+    if (!ar2HandleL || !ar2HandleR || !icpStereoHandle || !surfaceSetL || !surfaceSetR || !dataPtrL || !dataPtrR || !transL2R || !trans || !err) return (-1);
+    if( ar2HandleL->trackingMode != AR2_TRACKING_6DOF || ar2HandleR->trackingMode != AR2_TRACKING_6DOF ) {
+        ARLOGe("ar2TrackingStereo() error: stereo tracking requires AR2_TRACKING_6DOF.\n");
+        return (-1);
+    }
+
+    if( surfaceSetL->contNum <= 0  ) {
+        ARLOGd("ar2TrackingStereo() error: ar2SetInitTrans() must be called first.\n");
+        return -2;
+    }
+
+    *err = 0.0F;
+
+    // The right eye's pose history is always the left eye's, seen from the right camera.
+    arUtilMatMulf( (const float (*)[4])transL2R, (const float (*)[4])surfaceSetL->trans1, surfaceSetR->trans1 );
+    if( surfaceSetL->contNum > 1 ) arUtilMatMulf( (const float (*)[4])transL2R, (const float (*)[4])surfaceSetL->trans2, surfaceSetR->trans2 );
+    if( surfaceSetL->contNum > 2 ) arUtilMatMulf( (const float (*)[4])transL2R, (const float (*)[4])surfaceSetL->trans3, surfaceSetR->trans3 );
+    surfaceSetR->contNum = surfaceSetL->contNum;
+
+    // Each eye has its own pool of tracking threads, so match both eyes at once.
+    threadNumL = ar2TrackingMatchStart( ar2HandleL, surfaceSetL, dataPtrL );
+    threadNumR = ar2TrackingMatchStart( ar2HandleR, surfaceSetR, dataPtrR );
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    nL = ar2TrackingMatchEnd( ar2HandleL, surfaceSetL, threadNumL, &aveBlurL );
+    nR = ar2TrackingMatchEnd( ar2HandleR, surfaceSetR, threadNumR, &aveBlurR );
+#else
+    nL = ar2TrackingMatchEnd( ar2HandleL, surfaceSetL, threadNumL, NULL );
+    nR = ar2TrackingMatchEnd( ar2HandleR, surfaceSetR, threadNumR, NULL );
+#endif
+    if (numL) *numL = nL;
+    if (numR) *numR = nR;
+
+    if( nL + nR < 3 ) {
+        surfaceSetL->contNum = surfaceSetR->contNum = 0;
+        return -3;
+    }
+    *err = ar2GetTransMatStereo( icpStereoHandle, surfaceSetL->trans1, ar2HandleL->pos2d, ar2HandleL->pos3d, nL,
+                                 ar2HandleR->pos2d, ar2HandleR->pos3d, nR, trans, 0 );
+    for( i = 0; i < 4 && *err > ar2HandleL->trackingThresh; i++ ) {
+        icpStereoSetInlierProbability( icpStereoHandle, inlierProb[i] );
+        *err = ar2GetTransMatStereo( icpStereoHandle, trans, ar2HandleL->pos2d, ar2HandleL->pos3d, nL,
+                                     ar2HandleR->pos2d, ar2HandleR->pos3d, nR, trans, 1 );
+    }
+    if( *err > ar2HandleL->trackingThresh ) {
+        surfaceSetL->contNum = surfaceSetR->contNum = 0;
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+        if( ar2HandleL->blurMethod == AR2_ADAPTIVE_BLUR ) ar2HandleL->blurLevel = AR2_DEFAULT_BLUR_LEVEL; // Reset the blurLevel.
+        if( ar2HandleR->blurMethod == AR2_ADAPTIVE_BLUR ) ar2HandleR->blurLevel = AR2_DEFAULT_BLUR_LEVEL;
+#endif
+        return -4;
+    }
+
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    if( nL > 0 ) ar2UpdateBlurLevel( ar2HandleL, aveBlurL, nL );
+    if( nR > 0 ) ar2UpdateBlurLevel( ar2HandleR, aveBlurR, nR );
+#endif
+
+    surfaceSetL->contNum++;
+    surfaceSetR->contNum = surfaceSetL->contNum;
+    ar2PushTrans( surfaceSetL, trans );
+    arUtilMatMulf( (const float (*)[4])transL2R, (const float (*)[4])trans, transR );
+    ar2PushTrans( surfaceSetR, transR );
+
+    return 0;
+}
+
+// Selects the templates to be matched in this pass, and starts the tracking threads matching them.
+// Returns the number of threads started, to be passed to ar2TrackingMatchEnd().
+static int ar2TrackingMatchStart( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr )
+{
+    AR2TemplateCandidateT  *candidatePtr;
+    int                     taskNum, threadNum;
+    int                     i, j, k;
+
+    for( i = 0; i < surfaceSet->num; i++ ) {
+        arUtilMatMulf( (const float (*)[4])surfaceSet->trans1, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans1[i] );
+        if( surfaceSet->contNum > 1 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans2, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans2[i] );
+        if( surfaceSet->contNum > 2 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans3, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans3[i] );
+    }
+
+    if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
+        extractVisibleFeatures(ar2Handle->cparamLT, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
+    }
+    else {
+        extractVisibleFeaturesHomography(ar2Handle->xsize, ar2Handle->ysize, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
+    }
+
+    // Select all the templates to be matched in this pass, before any is matched. The first four are spread relative
+    // to those already selected, whether or not they go on to match. (Lock-step rounds spread each round relative to
+    // the previous rounds' accepted matches only, so a template which failed to match didn't count.)
+    candidatePtr = ar2Handle->candidate;
+    for( taskNum = 0; taskNum < ar2Handle->searchFeatureNum; taskNum++ ) {
+        k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, taskNum, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
+        if( k < 0 ) {
+            if( candidatePtr == ar2Handle->candidate ) {
+                candidatePtr = ar2Handle->candidate2;
+                k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, taskNum, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
+                if( k < 0 ) break; // PRL 2012-05-15: Give up if we can't select template from alternate candidate either.
+            }
+            else break;
+        }
+        ar2Handle->task[taskNum].candidate = &(candidatePtr[k]);
+        ar2Handle->pos[taskNum][0] = candidatePtr[k].sx;
+        ar2Handle->pos[taskNum][1] = candidatePtr[k].sy;
+    }
+    ar2Handle->taskNum = taskNum;
+
+    // Match the templates. Each tracking thread takes the next unmatched template as soon as it is free.
+    threadNum = (taskNum < ar2Handle->threadNum ? taskNum : ar2Handle->threadNum);
+    threadQueueReset( ar2Handle->taskQueue, taskNum );
+    arUtilTimeSinceEpoch(&ar2Handle->matchStartSec, &ar2Handle->matchStartUsec);
+    for( j = 0; j < threadNum; j++ ) {
+        ar2Handle->arg[j].ar2Handle  = ar2Handle;
+        ar2Handle->arg[j].surfaceSet = surfaceSet;
+        ar2Handle->arg[j].dataPtr    = dataPtr;
+        threadStartSignal( ar2Handle->threadHandle[j] );
+    }
+    return threadNum;
+}
+
+// Waits for the tracking threads started by ar2TrackingMatchStart(), and gathers the matches into
+// ar2Handle->pos2d and ar2Handle->pos3d. Returns the number of matches.
+static int ar2TrackingMatchEnd( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, int threadNum, float *aveBlur )
+{
+    AR2Tracking2DTaskT     *task;
+    int                     num;
+    int                     i, j;
+    uint64_t                sec1;
+    uint32_t                usec1;
+    float                   matchTime;
+
+    for( j = 0; j < threadNum; j++ ) {
+        threadEndWait( ar2Handle->threadHandle[j] );
+    }
+    arUtilTimeSinceEpoch(&sec1, &usec1);
+    matchTime = (float)(sec1 - ar2Handle->matchStartSec)*1000.0F + ((float)usec1 - (float)ar2Handle->matchStartUsec)*0.001F;
+    ar2Handle->idleTime = 0.0F;
+    for( j = 0; j < threadNum; j++ ) {
+        if( matchTime > ar2Handle->arg[j].busyTime ) ar2Handle->idleTime += matchTime - ar2Handle->arg[j].busyTime;
+    }
+
+    // Gather the matches, in order of selection.
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    *aveBlur = 0.0F;
+#else
+    (void)aveBlur;
+#endif
+    num = 0;
+    for( i = 0; i < ar2Handle->taskNum; i++ ) {
+        task = &(ar2Handle->task[i]);
+        if( task->ret == 0 && task->result.sim > ar2Handle->simThresh ) {
+            if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
+#ifdef ARDOUBLE_IS_FLOAT
+                arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,
+                                    task->result.pos2d[0], task->result.pos2d[1],
+                                    &ar2Handle->pos2d[num][0], &ar2Handle->pos2d[num][1], ar2Handle->cparamLT->param.dist_function_version);
+#else
+                ARdouble pos2d0, pos2d1;
+                arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,                    
+                                    (ARdouble)(task->result.pos2d[0]), (ARdouble)(task->result.pos2d[1]),
+                                    &pos2d0, &pos2d1, ar2Handle->cparamLT->param.dist_function_version);
+                ar2Handle->pos2d[num][0] = (float)pos2d0;
+                ar2Handle->pos2d[num][1] = (float)pos2d1;
+#endif
+            }
+            else {
+                ar2Handle->pos2d[num][0] = task->result.pos2d[0];
+                ar2Handle->pos2d[num][1] = task->result.pos2d[1];
+            }
+            ar2Handle->pos3d[num][0] = task->result.pos3d[0];
+            ar2Handle->pos3d[num][1] = task->result.pos3d[1];
+            ar2Handle->pos3d[num][2] = task->result.pos3d[2];
+            ar2Handle->pos[num][0] = task->candidate->sx;
+            ar2Handle->pos[num][1] = task->candidate->sy;
+            ar2Handle->usedFeature[num].snum  = task->candidate->snum;
+            ar2Handle->usedFeature[num].level = task->candidate->level;
+            ar2Handle->usedFeature[num].num   = task->candidate->num;
+            ar2Handle->usedFeature[num].flag  = 0;
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+            *aveBlur += task->result.blurLevel;
+#endif
+            num++;
+        }
+    }
+    for( i = 0; i < num; i++ ) {
+        surfaceSet->prevFeature[i] = ar2Handle->usedFeature[i];
+    }
+    surfaceSet->prevFeature[num].flag = -1;
+    //ARLOGd("------\nNum = %d\n", num);
+
+    return num;
+}
+
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+static void ar2UpdateBlurLevel( AR2HandleT *ar2Handle, float aveBlur, int num )
+{
     if( ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) {
         aveBlur = aveBlur/num + 0.5F;
         ar2Handle->blurLevel += (int)aveBlur - 1;
         if( ar2Handle->blurLevel < 1 ) ar2Handle->blurLevel = 1;
         if( ar2Handle->blurLevel >= AR2_BLUR_IMAGE_MAX-1 ) ar2Handle->blurLevel = AR2_BLUR_IMAGE_MAX-2;
     }
+}
 #endif
 
-    surfaceSet->contNum++;
+static void ar2PushTrans( AR2SurfaceSetT *surfaceSet, float trans[3][4] )
+{
+    int                     i, j;
+
     for( j = 0; j < 3; j++ ) {
         for( i = 0; i < 4; i++ ) surfaceSet->trans3[j][i] = surfaceSet->trans2[j][i];
     }
@@ -264,8 +407,6 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
     for( j = 0; j < 3; j++ ) {
         for( i = 0; i < 4; i++ ) surfaceSet->trans1[j][i] = trans[j][i];
     }
-
-    return 0;
 }
 
 static int extractVisibleFeatures(const ARParamLT *cparamLT, const float  trans1[][3][4], AR2SurfaceSetT *surfaceSet,
@@ -502,6 +643,96 @@ static float  ar2GetTransMat( ICPHandleT *icpHandle, float  initConv[3][4], floa
     return (float)err;
 }
 
+// As for ar2GetTransMat(), but with points observed from both cameras of a stereo pair.
+// The pose is that of the left camera. World coordinates are recentred on the mean of all points.
+static float  ar2GetTransMatStereo( ICPStereoHandleT *icpStereoHandle, float  initConv[3][4],
+                                    float  pos2dL[][2], float  pos3dL[][3], int numL,
+                                    float  pos2dR[][2], float  pos3dR[][3], int numR,
+                                    float  conv[3][4], int robustMode )
+{
+    ICPStereoDataT data;
+    float          dx, dy, dz;
+    ARdouble       initMat[3][4], mat[3][4];
+    ARdouble       err;
+    int            i, j;
+
+    dx = dy = dz = 0.0;
+    for( i = 0; i < numL; i++ ) {
+        dx += pos3dL[i][0];
+        dy += pos3dL[i][1];
+        dz += pos3dL[i][2];
+    }
+    for( i = 0; i < numR; i++ ) {
+        dx += pos3dR[i][0];
+        dy += pos3dR[i][1];
+        dz += pos3dR[i][2];
+    }
+    dx /= (numL + numR);
+    dy /= (numL + numR);
+    dz /= (numL + numR);
+
+    data.numL = numL;
+    data.screenCoordL = NULL;
+    data.worldCoordL = NULL;
+    if( numL > 0 ) {
+        arMalloc( data.screenCoordL, ICP2DCoordT, numL );
+        arMalloc( data.worldCoordL,  ICP3DCoordT, numL );
+        for( i = 0; i < numL; i++ ) {
+            data.screenCoordL[i].x = pos2dL[i][0];
+            data.screenCoordL[i].y = pos2dL[i][1];
+            data.worldCoordL[i].x  = pos3dL[i][0] - dx;
+            data.worldCoordL[i].y  = pos3dL[i][1] - dy;
+            data.worldCoordL[i].z  = pos3dL[i][2] - dz;
+        }
+    }
+    data.numR = numR;
+    data.screenCoordR = NULL;
+    data.worldCoordR = NULL;
+    if( numR > 0 ) {
+        arMalloc( data.screenCoordR, ICP2DCoordT, numR );
+        arMalloc( data.worldCoordR,  ICP3DCoordT, numR );
+        for( i = 0; i < numR; i++ ) {
+            data.screenCoordR[i].x = pos2dR[i][0];
+            data.screenCoordR[i].y = pos2dR[i][1];
+            data.worldCoordR[i].x  = pos3dR[i][0] - dx;
+            data.worldCoordR[i].y  = pos3dR[i][1] - dy;
+            data.worldCoordR[i].z  = pos3dR[i][2] - dz;
+        }
+    }
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) initMat[j][i] = (ARdouble)(initConv[j][i]);
+    }
+    initMat[0][3] = (ARdouble)(initConv[0][0] * dx + initConv[0][1] * dy + initConv[0][2] * dz + initConv[0][3]);
+    initMat[1][3] = (ARdouble)(initConv[1][0] * dx + initConv[1][1] * dy + initConv[1][2] * dz + initConv[1][3]);
+    initMat[2][3] = (ARdouble)(initConv[2][0] * dx + initConv[2][1] * dy + initConv[2][2] * dz + initConv[2][3]);
+
+    if( robustMode == 0 ) {
+        if( icpStereoPoint( icpStereoHandle, &data, initMat, mat, &err ) < 0 ) {
+            err = 100000000.0F;
+        }
+    }
+    else {
+        if( icpStereoPointRobust( icpStereoHandle, &data, initMat, mat, &err ) < 0 ) {
+            err = 100000000.0F;
+        }
+    }
+
+    free( data.screenCoordL );
+    free( data.worldCoordL );
+    free( data.screenCoordR );
+    free( data.worldCoordR );
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) conv[j][i] = (float)mat[j][i];
+    }
+    conv[0][3] = (float)(mat[0][3] - mat[0][0] * dx - mat[0][1] * dy - mat[0][2] * dz);
+    conv[1][3] = (float)(mat[1][3] - mat[1][0] * dx - mat[1][1] * dy - mat[1][2] * dz);
+    conv[2][3] = (float)(mat[2][3] - mat[2][0] * dx - mat[2][1] * dy - mat[2][2] * dz);
+
+    return (float)err;
+}
+
 static float  ar2GetTransMatHomography( float  initConv[3][4], float  pos2d[][2], float  pos3d[][3], int num, 
                                   float  conv[3][4], int robustMode, float inlierProb )
 {
@@ -45,6 +45,7 @@
 #include <ARX/AR2/template.h>
 #include <ARX/AR2/searchPoint.h>
 #include <ARX/AR2/tracking.h>
+#include <ARX/ARUtil/time.h>
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
 static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
@@ -66,15 +67,29 @@ void *ar2Tracking2d( THREAD_HANDLE_T *threadHandle )
     
     ARLOGi("Start tracking_thread #%d.\n", ID);
     for(;;) {
+        AR2HandleT         *ar2Handle;
+        AR2Tracking2DTaskT *task;
+        uint64_t            sec0, sec1;
+        uint32_t            usec0, usec1;
+        int                 i;
+
         if( threadStartWait(threadHandle) < 0 ) break;
 
+        ar2Handle = arg->ar2Handle;
+        arUtilTimeSinceEpoch(&sec0, &usec0);
+        while( (i = threadQueueTake(ar2Handle->taskQueue)) >= 0 ) {
+            task = &(ar2Handle->task[i]);
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
-                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->templ2), &(arg->result) );
+            task->ret = ar2Tracking2dSub( ar2Handle, arg->surfaceSet, task->candidate,
+                                          arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->templ2), &(task->result) );
 #else
-        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
-                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->result) );
+            task->ret = ar2Tracking2dSub( ar2Handle, arg->surfaceSet, task->candidate,
+                                          arg->dataPtr, arg->mfImage, &(arg->templ), &(task->result) );
 #endif
+        }
+        arUtilTimeSinceEpoch(&sec1, &usec1);
+        arg->busyTime = (float)(sec1 - sec0)*1000.0F + ((float)usec1 - (float)usec0)*0.001F;
+
         threadEndSignal(threadHandle);
     }
     ARLOGi("End tracking_thread #%d.\n", ID);
@@ -68,6 +68,11 @@ ARController::ARController() :
     m_videoSourceIsStereo(false),
     m_updateFrameStamp0({0,0}),
     m_updateFrameStamp1({0,0}),
+    m_stereoPairToleranceMs(ARCONTROLLER_STEREO_PAIR_TOLERANCE_DEFAULT),
+    m_stereoPairs(0),
+    m_stereoUnmatched(0),
+    m_stereoSkewTotalMs(0.0),
+    m_stereoSkewMaxMs(0.0f),
     m_arVideoViews{NULL},
     m_trackables(),
     doSquareMarkerDetection(false),
@@ -268,6 +273,7 @@ bool ARController::startRunningStereo(const char* vconfL, const char* cparaNameL
     }
 
     m_videoSourceIsStereo = true;
+    resetStereoFramePairStats();
 	state = WAITING_FOR_VIDEO;
     stateWaitingMessageLogged = false;
 
@@ -309,6 +315,85 @@ bool ARController::updateTextureRGBA32(const int videoSourceIndex, uint32_t *buf
     }
 }
 
+void ARController::setStereoFramePairTolerance(float toleranceMs)
+{
+    m_stereoPairToleranceMs = (toleranceMs < 0.0f ? 0.0f : toleranceMs);
+}
+
+float ARController::stereoFramePairTolerance() const
+{
+    return m_stereoPairToleranceMs;
+}
+
+void ARController::stereoFramePairStats(int *pairs, int *unmatched, float *meanSkewMs, float *maxSkewMs) const
+{
+    if (pairs) *pairs = m_stereoPairs;
+    if (unmatched) *unmatched = m_stereoUnmatched;
+    if (meanSkewMs) *meanSkewMs = (m_stereoPairs ? (float)(m_stereoSkewTotalMs / m_stereoPairs) : 0.0f);
+    if (maxSkewMs) *maxSkewMs = m_stereoSkewMaxMs;
+}
+
+void ARController::resetStereoFramePairStats()
+{
+    m_stereoPairs = 0;
+    m_stereoUnmatched = 0;
+    m_stereoSkewTotalMs = 0.0;
+    m_stereoSkewMaxMs = 0.0f;
+}
+
+// Checkout a left and a right frame whose timestamps differ by no more than m_stereoPairToleranceMs.
+// Returns false if no such pair is available yet. A frame is dropped once it can no longer be matched,
+// i.e. when every newer frame from the other eye is already later than it by more than the tolerance.
+bool ARController::checkoutStereoFramePair(AR2VideoBufferT **image0p, AR2VideoBufferT **image1p)
+{
+    const int64_t tolerance = (int64_t)(m_stereoPairToleranceMs * 1000.0f);
+    AR2VideoBufferT *image0, *image1;
+    int64_t skew;
+
+    image0 = m_videoSource0->checkoutFrameIfNewerThan(m_updateFrameStamp0);
+    if (!image0) return false;
+    image1 = m_videoSource1->checkoutFrameNearest(image0->time, m_updateFrameStamp1);
+    if (!image1) {
+        m_videoSource0->checkinFrame(image0);
+        return false;
+    }
+    skew = ARVideoSource::timeDiff(image1->time, image0->time);
+
+    if (skew > tolerance) {
+        // Every new right frame is too late for the latest left frame, so it can't be paired.
+        ARLOGd("ARController::update(): dropping unmatched left frame (right frame %.1f ms later).\n", (float)skew * 0.001f);
+        m_updateFrameStamp0 = image0->time;
+        m_stereoUnmatched++;
+        m_videoSource0->checkinFrame(image0);
+        m_videoSource1->checkinFrame(image1);
+        return false;
+    } else if (skew < -tolerance) {
+        // Right eye is behind. image1 is its latest frame; look for an earlier left frame to match it.
+        m_videoSource0->checkinFrame(image0);
+        image0 = m_videoSource0->checkoutFrameNearest(image1->time, m_updateFrameStamp0);
+        if (image0) skew = ARVideoSource::timeDiff(image1->time, image0->time);
+        if (!image0 || skew > tolerance || skew < -tolerance) {
+            ARLOGd("ARController::update(): dropping unmatched right frame.\n");
+            m_updateFrameStamp1 = image1->time;
+            m_stereoUnmatched++;
+            if (image0) m_videoSource0->checkinFrame(image0);
+            m_videoSource1->checkinFrame(image1);
+            return false;
+        }
+    }
+
+    // Frames older than the pair, in either eye, will not be tracked.
+    m_updateFrameStamp0 = image0->time;
+    m_updateFrameStamp1 = image1->time;
+    float skewMs = (float)(skew < 0 ? -skew : skew) * 0.001f;
+    m_stereoPairs++;
+    m_stereoSkewTotalMs += skewMs;
+    if (skewMs > m_stereoSkewMaxMs) m_stereoSkewMaxMs = skewMs;
+    *image0p = image0;
+    *image1p = image1;
+    return true;
+}
+
 bool ARController::update()
 {
     ARLOGd("ARX::ARController::update().\n");
@@ -344,18 +429,16 @@ bool ARController::update()
 
     // Checkout frame(s).
     AR2VideoBufferT *image0, *image1 = NULL;
-    image0 = m_videoSource0->checkoutFrameIfNewerThan(m_updateFrameStamp0);
-    if (!image0) {
-        return true;
-    }
-    m_updateFrameStamp0 = image0->time;
-    if (m_videoSourceIsStereo) {
-        image1 = m_videoSource1->checkoutFrameIfNewerThan(m_updateFrameStamp1);
-        if (!image1) {
-            m_videoSource0->checkinFrame(); // If we didn't checkout this frame, but we already checked out a frame from one or more other video sources, check those back in.
+    if (!m_videoSourceIsStereo) {
+        image0 = m_videoSource0->checkoutFrameIfNewerThan(m_updateFrameStamp0);
+        if (!image0) {
+            return true;
+        }
+        m_updateFrameStamp0 = image0->time;
+    } else {
+        if (!checkoutStereoFramePair(&image0, &image1)) {
             return true;
         }
-        m_updateFrameStamp1 = image1->time;
     }
 
     //
@@ -394,8 +477,8 @@ bool ARController::update()
 #endif
 done:
     // Checkin frames.
-    m_videoSource0->checkinFrame();
-    if (m_videoSourceIsStereo) m_videoSource1->checkinFrame();
+    m_videoSource0->checkinFrame(image0);
+    if (m_videoSourceIsStereo) m_videoSource1->checkinFrame(image1);
 
     ARLOGd("ARX::ARController::update(): done.\n");
     
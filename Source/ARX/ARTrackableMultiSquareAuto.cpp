@@ -44,12 +44,14 @@
 struct ARTrackableMapPrivateMembers {
     ARTrackableMapPrivateMembers()
 #if HAVE_GTSAM
-    : m_mapper(0.04, 1)
+    : m_mapper(0.04, 1),
+    m_mapVersion(0)
 #endif
     {
     }
 #if HAVE_GTSAM
-    arx_mapper::Mapper m_mapper;
+    arx_mapper::MapperThread m_mapper;
+    long m_mapVersion; // Version of the last map snapshot taken up into m_MultiConfig.
 #endif
 };
 
@@ -126,6 +128,18 @@ bool ARTrackableMultiSquareAuto::updateWithDetectedMarkers(ARMarkerInfo* markerI
                 }
             }
             
+#if HAVE_GTSAM
+            // Take up the landmarks that changed in maps published by the mapping thread since we last looked.
+            std::shared_ptr<const arx_mapper::MapSnapshot> map = m_pm->m_mapper.Latest();
+            if (map && map->version != m_pm->m_mapVersion) {
+                for (size_t i = 0; i < map->landmarks.size(); i++) {
+                    if (map->changed[i] <= m_pm->m_mapVersion) continue;
+                    arMultiAddOrUpdateSubmarker(m_MultiConfig, map->landmarks[i].uid, AR_MULTI_PATTERN_TYPE_MATRIX, map->width, map->landmarks[i].trans, 0);
+                }
+                m_pm->m_mapVersion = map->version;
+            }
+#endif
+
             // If map is not empty, calculate the pose of the multimarker in camera frame, i.e. trans_M_c.
             if (m_MultiConfig->marker_num > 0) {
                 
@@ -171,39 +185,26 @@ bool ARTrackableMultiSquareAuto::updateWithDetectedMarkers(ARMarkerInfo* markerI
 #else
                     // Construct map using GTSAM's iSAM2 (incremental smoothing and mapping v2).
                     // This results in pose error values which are minimised over the entire map.
+                    // Mapping runs on its own thread; here we just queue this frame's observations,
+                    // and the resulting map is taken up on a later frame.
                     
-                    // Add a pose estimate to the graph.
-                    m_pm->m_mapper.AddPose(m_MultiConfig->trans);
-                    
-                    // Now add factors for our marker observations to the graph.
-                    std::vector<arx_mapper::Marker> markers;
+                    // The pose estimate, and marker observations.
+                    arx_mapper::Observation observation;
+                    memcpy(observation.trans, m_MultiConfig->trans, sizeof(observation.trans));
+                    observation.origin_uid = m_OriginMarkerUid;
+                    observation.width = m_markerWidth;
                     for (int i = 0; i < markerNum; i++) {
                         if (markerInfoCopy[i].idMatrix != -1) {
                             arx_mapper::Marker marker;
                             ARdouble err = arGetTransMatSquare(ar3DHandle, &(markerInfoCopy[i]), m_markerWidth, marker.trans);
                             if (err < m_maxErr) {
                                 marker.uid = markerInfoCopy[i].idMatrix;
-                                markers.push_back(marker);
+                                observation.markers.push_back(marker);
                             }
                         }
                     }
-                    m_pm->m_mapper.AddFactors(markers);
-                    
-                    // Do mapping.
-                    if (!m_pm->m_mapper.inited()) {
-                        // Add a landmark for the origin marker.
-                        // We fix this in the map at the origin and thus fix the scale for first pose and first landmark.
-                        m_pm->m_mapper.Initialize(m_OriginMarkerUid, m_markerWidth);
-                    } else {
-                        // This will add new landmarks for each marker not previously seen, with the
-                        // initial pose estimate calculated from the marker pose in the camera frame
-                        // composed with the camera pose in the map frame.
-                        m_pm->m_mapper.AddLandmarks(markers);
-                        m_pm->m_mapper.Optimize();
-                        // Get latest estimates from mapper and put into map.
-                        m_pm->m_mapper.Update(m_MultiConfig);
-                        // Prepare for next iteration.
-                        m_pm->m_mapper.Clear();
+                    if (!m_pm->m_mapper.Push(observation)) {
+                        ARLOGd("Mapping thread busy, dropped observations (%ld so far).\n", m_pm->m_mapper.dropped());
                     }
 #endif // HAVE_GTSAM
                     
@@ -232,6 +233,22 @@ bool ARTrackableMultiSquareAuto::updateWithDetectedMarkersStereo(ARMarkerInfo* m
     return (ARTrackable::update(transL2R)); // Parent class will finish update.
 }
 
+bool ARTrackableMultiSquareAuto::mapMetrics(int *keyframes, int *landmarks, int *factors, double *updateMs) const
+{
+#if HAVE_GTSAM
+    std::shared_ptr<const arx_mapper::MapSnapshot> map = m_pm->m_mapper.Latest();
+    if (!map) return false;
+    if (keyframes) *keyframes = map->stats.keyframes;
+    if (landmarks) *landmarks = map->stats.landmarks;
+    if (factors) *factors = (int)map->stats.factors;
+    if (updateMs) *updateMs = map->stats.update_ms;
+    return true;
+#else
+    (void)keyframes; (void)landmarks; (void)factors; (void)updateMs;
+    return false;
+#endif
+}
+
 ARMultiMarkerInfoT *ARTrackableMultiSquareAuto::copyMultiConfig()
 {
     return arMultiCopyConfig(m_MultiConfig);
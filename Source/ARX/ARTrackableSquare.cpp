@@ -177,7 +177,53 @@ void ARTrackableSquare::setConfidenceCutoff(ARdouble value)
     }
 }
 
+int ARTrackableSquare::matchDetectedMarker(ARMarkerInfo* markerInfo, int markerNum, bool useCandidates, const int *candidates, int candidateNum) const {
+    
+    // Iterate over the candidate detections, or all detections if there is no candidate list.
+    const int n = useCandidates ? candidateNum : markerNum;
+    int k = -1;
+    if (patt_type == AR_PATTERN_TYPE_TEMPLATE) {
+        for (int c = 0; c < n; c++) {
+            const int j = useCandidates ? candidates[c] : c;
+            if (patt_id == markerInfo[j].idPatt) {
+                // The pattern of detected trapezoid matches marker[k].
+                if (k == -1) {
+                    if (markerInfo[j].cfPatt > m_cfMin) k = j; // Count as a match if match confidence exceeds cfMin.
+                } else if (markerInfo[j].cfPatt > markerInfo[k].cfPatt) k = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
+            }
+        }
+        if (k != -1) {
+            markerInfo[k].id = markerInfo[k].idPatt;
+            markerInfo[k].cf = markerInfo[k].cfPatt;
+            markerInfo[k].dir = markerInfo[k].dirPatt;
+        }
+    } else {
+        for (int c = 0; c < n; c++) {
+            const int j = useCandidates ? candidates[c] : c;
+            if (patt_id == markerInfo[j].idMatrix) {
+                if (k == -1) {
+                    if (markerInfo[j].cfMatrix >= m_cfMin) k = j; // Count as a match if match confidence exceeds cfMin.
+                } else if (markerInfo[j].cfMatrix > markerInfo[k].cfMatrix) k = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
+            }
+        }
+        if (k != -1) {
+            markerInfo[k].id = markerInfo[k].idMatrix;
+            markerInfo[k].cf = markerInfo[k].cfMatrix;
+            markerInfo[k].dir = markerInfo[k].dirMatrix;
+        }
+    }
+    return k;
+}
+
 bool ARTrackableSquare::updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int markerNum, AR3DHandle *ar3DHandle) {
+    return updateMatching(markerInfo, markerNum, false, NULL, 0, ar3DHandle);
+}
+
+bool ARTrackableSquare::updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int markerNum, const int *candidates, int candidateNum, AR3DHandle *ar3DHandle) {
+    return updateMatching(markerInfo, markerNum, true, candidates, candidateNum, ar3DHandle);
+}
+
+bool ARTrackableSquare::updateMatching(ARMarkerInfo* markerInfo, int markerNum, bool useCandidates, const int *candidates, int candidateNum, AR3DHandle *ar3DHandle) {
 
     ARLOGd("ARTrackableSquare::updateWithDetectedMarkers(...)\n");
     
@@ -189,36 +235,7 @@ bool ARTrackableSquare::updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int
 
 	if (markerInfo) {
 
-        int k = -1;
-        if (patt_type == AR_PATTERN_TYPE_TEMPLATE) { 
-            // Iterate over all detected markers.
-            for (int j = 0; j < markerNum; j++ ) {
-                if (patt_id == markerInfo[j].idPatt) {
-                    // The pattern of detected trapezoid matches marker[k].
-                    if (k == -1) {
-                        if (markerInfo[j].cfPatt > m_cfMin) k = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfo[j].cfPatt > markerInfo[k].cfPatt) k = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (k != -1) {
-                markerInfo[k].id = markerInfo[k].idPatt;
-                markerInfo[k].cf = markerInfo[k].cfPatt;
-                markerInfo[k].dir = markerInfo[k].dirPatt;
-            }
-        } else {
-            for (int j = 0; j < markerNum; j++) {
-                if (patt_id == markerInfo[j].idMatrix) {
-                    if (k == -1) {
-                        if (markerInfo[j].cfMatrix >= m_cfMin) k = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfo[j].cfMatrix > markerInfo[k].cfMatrix) k = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (k != -1) {
-                markerInfo[k].id = markerInfo[k].idMatrix;
-                markerInfo[k].cf = markerInfo[k].cfMatrix;
-                markerInfo[k].dir = markerInfo[k].dirMatrix;
-            }
-        }
+        int k = matchDetectedMarker(markerInfo, markerNum, useCandidates, candidates, candidateNum);
         
 		// Consider marker visible if a match was found.
         if (k != -1) {
@@ -242,6 +259,14 @@ bool ARTrackableSquare::updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int
 }
 
 bool ARTrackableSquare::updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfoL, int markerNumL, ARMarkerInfo* markerInfoR, int markerNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]) {
+    return updateMatchingStereo(markerInfoL, markerNumL, false, NULL, 0, markerInfoR, markerNumR, NULL, 0, handle, transL2R);
+}
+
+bool ARTrackableSquare::updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfoL, int markerNumL, const int *candidatesL, int candidateNumL, ARMarkerInfo* markerInfoR, int markerNumR, const int *candidatesR, int candidateNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]) {
+    return updateMatchingStereo(markerInfoL, markerNumL, true, candidatesL, candidateNumL, markerInfoR, markerNumR, candidatesR, candidateNumR, handle, transL2R);
+}
+
+bool ARTrackableSquare::updateMatchingStereo(ARMarkerInfo* markerInfoL, int markerNumL, bool useCandidates, const int *candidatesL, int candidateNumL, ARMarkerInfo* markerInfoR, int markerNumR, const int *candidatesR, int candidateNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]) {
     
     ARLOGd("ARTrackableSquare::updateWithDetectedMarkersStereo(...)\n");
     
@@ -253,61 +278,8 @@ bool ARTrackableSquare::updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfo
     
 	if (markerInfoL && markerInfoR) {
         
-        int kL = -1, kR = -1;
-        if (patt_type == AR_PATTERN_TYPE_TEMPLATE) {
-            // Iterate over all detected markers.
-            for (int j = 0; j < markerNumL; j++ ) {
-                if (patt_id == markerInfoL[j].idPatt) {
-                    // The pattern of detected trapezoid matches marker[kL].
-                    if (kL == -1) {
-                        if (markerInfoL[j].cfPatt > m_cfMin) kL = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfoL[j].cfPatt > markerInfoL[kL].cfPatt) kL = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (kL != -1) {
-                markerInfoL[kL].id = markerInfoL[kL].idPatt;
-                markerInfoL[kL].cf = markerInfoL[kL].cfPatt;
-                markerInfoL[kL].dir = markerInfoL[kL].dirPatt;
-            }
-            for (int j = 0; j < markerNumR; j++ ) {
-                if (patt_id == markerInfoR[j].idPatt) {
-                    // The pattern of detected trapezoid matches marker[kR].
-                    if (kR == -1) {
-                        if (markerInfoR[j].cfPatt > m_cfMin) kR = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfoR[j].cfPatt > markerInfoR[kR].cfPatt) kR = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (kR != -1) {
-                markerInfoR[kR].id = markerInfoR[kR].idPatt;
-                markerInfoR[kR].cf = markerInfoR[kR].cfPatt;
-                markerInfoR[kR].dir = markerInfoR[kR].dirPatt;
-            }
-        } else {
-            for (int j = 0; j < markerNumL; j++) {
-                if (patt_id == markerInfoL[j].idMatrix) {
-                    if (kL == -1) {
-                        if (markerInfoL[j].cfMatrix >= m_cfMin) kL = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfoL[j].cfMatrix > markerInfoL[kL].cfMatrix) kL = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (kL != -1) {
-                markerInfoL[kL].id = markerInfoL[kL].idMatrix;
-                markerInfoL[kL].cf = markerInfoL[kL].cfMatrix;
-                markerInfoL[kL].dir = markerInfoL[kL].dirMatrix;
-            }
-            for (int j = 0; j < markerNumR; j++) {
-                if (patt_id == markerInfoR[j].idMatrix) {
-                    if (kR == -1) {
-                        if (markerInfoR[j].cfMatrix >= m_cfMin) kR = j; // Count as a match if match confidence exceeds cfMin.
-                    } else if (markerInfoR[j].cfMatrix > markerInfoR[kR].cfMatrix) kR = j; // Or if it exceeds match confidence of a different already matched trapezoid (i.e. assume only one instance of each marker).
-                }
-            }
-            if (kR != -1) {
-                markerInfoR[kR].id = markerInfoR[kR].idMatrix;
-                markerInfoR[kR].cf = markerInfoR[kR].cfMatrix;
-                markerInfoR[kR].dir = markerInfoR[kR].dirMatrix;
-            }
-        }
+        int kL = matchDetectedMarker(markerInfoL, markerNumL, useCandidates, candidatesL, candidateNumL);
+        int kR = matchDetectedMarker(markerInfoR, markerNumR, useCandidates, candidatesR, candidateNumR);
         
         if (kL != -1 || kR != -1) {
             
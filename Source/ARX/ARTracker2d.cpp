@@ -45,11 +45,19 @@
 #include "trackingSub.h"
 #include <ARX/OCVT/PlanarTracker.h>
 
+static double timestampDiffMs(const AR2VideoTimestampT *t1, const AR2VideoTimestampT *t0)
+{
+    return ((double)t1->sec - (double)t0->sec)*1000.0 + ((double)t1->usec - (double)t0->usec)/1000.0;
+}
+
 ARTracker2d::ARTracker2d() :
 m_videoSourceIsStereo(false),
 m_2DTrackerDataLoaded(false),
 m_2DTrackerDetectedImageCount(0),
 m_2DTracker(NULL),
+m_twoDDetectionThreaded(true),
+m_acquisitions(0),
+m_acquisitionLatencyTotalMs(0.0),
 m_running(false)
 {
 }
@@ -63,6 +71,7 @@ bool ARTracker2d::initialize()
 {
     if (!m_2DTracker) {
         m_2DTracker = std::make_shared<PlanarTracker>(PlanarTracker());
+        m_2DTracker->SetDetectionThreaded(m_twoDDetectionThreaded);
     }
     
     return true;
@@ -78,6 +87,29 @@ bool ARTracker2d::TwoDMultiMode() const
     return m_twoDMultiMode;
 }
 
+void ARTracker2d::setTwoDDetectionThreaded(bool on)
+{
+    m_twoDDetectionThreaded = on;
+    if (m_2DTracker) m_2DTracker->SetDetectionThreaded(on);
+}
+
+bool ARTracker2d::TwoDDetectionThreaded() const
+{
+    return m_twoDDetectionThreaded;
+}
+
+void ARTracker2d::acquisitionStats(int *acquisitions, float *meanLatencyMs) const
+{
+    if (acquisitions) *acquisitions = m_acquisitions;
+    if (meanLatencyMs) *meanLatencyMs = (m_acquisitions > 0 ? (float)(m_acquisitionLatencyTotalMs / m_acquisitions) : 0.0f);
+}
+
+void ARTracker2d::resetAcquisitionStats()
+{
+    m_acquisitions = 0;
+    m_acquisitionLatencyTotalMs = 0.0;
+}
+
 bool ARTracker2d::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
 {
     if (!paramLT || pixelFormat == AR_PIXEL_FORMAT_INVALID) return false;
@@ -153,7 +185,7 @@ bool ARTracker2d::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& trac
         }
     }
     
-    m_2DTracker->ProcessFrameData(buff->buff);
+    m_2DTracker->ProcessFrameData(buff->buff, buff->time);
     // Loop through all loaded 2D targets and match against tracking results.
     m_2DTrackerDetectedImageCount = 0;
     for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
@@ -165,6 +197,13 @@ bool ARTracker2d::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& trac
                 if (transMat) {
                     ARdouble *transL2R = (m_videoSourceIsStereo ? (ARdouble *)m_transL2R : NULL);
                     bool success = ((ARTrackable2d *)(*it))->updateWithTwoDResults(trackable2D->pageNo, (float (*)[4])transMat, (ARdouble (*)[4])transL2R);
+                    AR2VideoTimestampT detectionTime;
+                    if (trackable2D->visible && !trackable2D->visiblePrev && m_2DTracker->GetTrackableDetectionTime(trackable2D->UID, &detectionTime)) {
+                        double latencyMs = timestampDiffMs(&buff->time, &detectionTime);
+                        m_acquisitions++;
+                        m_acquisitionLatencyTotalMs += latencyMs;
+                        ARLOGd("Acquired trackable %d, %.1f ms after detection frame.\n", trackable2D->UID, latencyMs);
+                    }
                     m_2DTrackerDetectedImageCount++;
                     trackable2DFound = true;
                 } else {
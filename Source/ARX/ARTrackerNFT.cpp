@@ -44,6 +44,32 @@
 #include <ARX/ARTrackableNFT.h>
 #include "trackingSub.h"
 
+static double timestampDiffMs(const AR2VideoTimestampT *t1, const AR2VideoTimestampT *t0)
+{
+    return ((double)t1->sec - (double)t0->sec)*1000.0 + ((double)t1->usec - (double)t0->usec)/1000.0;
+}
+
+static void setAR2TrackingSettings(AR2HandleT *ar2Handle)
+{
+    if (threadGetCPU() <= 1) {
+        // Settings for devices with single-core CPUs.
+        ar2SetTrackingThresh( ar2Handle, 5.0 );
+        ar2SetSimThresh( ar2Handle, 0.50 );
+        ar2SetSearchFeatureNum(ar2Handle, 16);
+        ar2SetSearchSize(ar2Handle, 6);
+        ar2SetTemplateSize1(ar2Handle, 6);
+        ar2SetTemplateSize2(ar2Handle, 6);
+    } else {
+        // Settings for devices with dual/multi-core CPUs.
+        ar2SetTrackingThresh( ar2Handle, 5.0 );
+        ar2SetSimThresh( ar2Handle, 0.50 );
+        ar2SetSearchFeatureNum(ar2Handle, 16);
+        ar2SetSearchSize(ar2Handle, 12);
+        ar2SetTemplateSize1(ar2Handle, 6);
+        ar2SetTemplateSize2(ar2Handle, 6);
+    }
+}
+
 ARTrackerNFT::ARTrackerNFT() :
     m_videoSourceIsStereo(false),
     m_nftMultiMode(false),
@@ -52,7 +78,22 @@ ARTrackerNFT::ARTrackerNFT() :
     trackingThreadHandle(NULL),
     m_ar2Handle(NULL),
     m_kpmHandle(NULL),
-    m_surfaceSet{NULL}
+    m_surfaceSet{NULL},
+    m_paramLT0(NULL),
+    m_paramLT1(NULL),
+    m_ar2Handle1(NULL),
+    m_icpStereoHandle(NULL),
+    m_surfaceSet1{NULL},
+    m_kpmEye(0),
+    m_kpmFrameEye(0),
+    m_latencyCompensation(true),
+    m_frameHistoryStart(0),
+    m_frameHistoryCount(0),
+    m_kpmFrameTime{0, 0},
+    m_reacquisitionPending{false},
+    m_reacquisitionDetections(0),
+    m_reacquisitions(0),
+    m_reacquisitionLatencyTotalMs(0.0)
 {
 }
 
@@ -76,6 +117,31 @@ bool ARTrackerNFT::NFTMultiMode() const
     return m_nftMultiMode;
 }
 
+void ARTrackerNFT::setNFTLatencyCompensation(bool on)
+{
+    m_latencyCompensation = on;
+    if (!on) m_frameHistoryCount = 0;
+}
+
+bool ARTrackerNFT::NFTLatencyCompensation() const
+{
+    return m_latencyCompensation;
+}
+
+void ARTrackerNFT::reacquisitionStats(int *detections, int *reacquisitions, float *meanLatencyMs) const
+{
+    if (detections) *detections = m_reacquisitionDetections;
+    if (reacquisitions) *reacquisitions = m_reacquisitions;
+    if (meanLatencyMs) *meanLatencyMs = (m_reacquisitions > 0 ? (float)(m_reacquisitionLatencyTotalMs / m_reacquisitions) : 0.0f);
+}
+
+void ARTrackerNFT::resetReacquisitionStats()
+{
+    m_reacquisitionDetections = 0;
+    m_reacquisitions = 0;
+    m_reacquisitionLatencyTotalMs = 0.0;
+}
+
 bool ARTrackerNFT::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
 {
     if (!paramLT || pixelFormat == AR_PIXEL_FORMAT_INVALID) return false;
@@ -87,44 +153,64 @@ bool ARTrackerNFT::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
         return (false);
     }
     //kpmSetProcMode( m_kpmHandle, KpmProcHalfSize );
+    m_paramLT0 = paramLT;
     
     // AR2 init.
-    if (!(m_ar2Handle = ar2CreateHandle(paramLT, AR_PIXEL_FORMAT_MONO, AR2_TRACKING_DEFAULT_THREAD_NUM))) { // Since we're guaranteed to have luma available, we'll use it as it is the optimal case.
+    // In stereo, each camera's AR2 handle has its own pool of tracking threads and both match at the same time,
+    // so each pool gets half the CPUs.
+    int threadNum = AR2_TRACKING_DEFAULT_THREAD_NUM;
+    if (m_videoSourceIsStereo) {
+        threadNum = threadGetCPU() / 2;
+        if (threadNum < 1) threadNum = 1;
+    }
+    if (!(m_ar2Handle = ar2CreateHandle(paramLT, AR_PIXEL_FORMAT_MONO, threadNum))) { // Since we're guaranteed to have luma available, we'll use it as it is the optimal case.
         ARLOGe("ar2CreateHandle\n");
         kpmDeleteHandle(&m_kpmHandle);
         return (false);
     }
     if (threadGetCPU() <= 1) {
         ARLOGi("Using NFT tracking settings for a single CPU.\n");
-        // Settings for devices with single-core CPUs.
-        ar2SetTrackingThresh( m_ar2Handle, 5.0 );
-        ar2SetSimThresh( m_ar2Handle, 0.50 );
-        ar2SetSearchFeatureNum(m_ar2Handle, 16);
-        ar2SetSearchSize(m_ar2Handle, 6);
-        ar2SetTemplateSize1(m_ar2Handle, 6);
-        ar2SetTemplateSize2(m_ar2Handle, 6);
     } else {
         ARLOGi("Using NFT tracking settings for more than one CPU.\n");
-        // Settings for devices with dual/multi-core CPUs.
-        ar2SetTrackingThresh( m_ar2Handle, 5.0 );
-        ar2SetSimThresh( m_ar2Handle, 0.50 );
-        ar2SetSearchFeatureNum(m_ar2Handle, 16);
-        ar2SetSearchSize(m_ar2Handle, 12);
-        ar2SetTemplateSize1(m_ar2Handle, 6);
-        ar2SetTemplateSize2(m_ar2Handle, 6);
     }
+    setAR2TrackingSettings(m_ar2Handle);
     ARLOGd("ARTrackerNFT::start(): done.\n");
     return (true);
 }
 
 bool ARTrackerNFT::start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, ARParamLT *paramLT1, AR_PIXEL_FORMAT pixelFormat1, const ARdouble transL2R[3][4])
 {
+    static const ARdouble transIdentity[3][4] = {{1.0, 0.0, 0.0, 0.0}, {0.0, 1.0, 0.0, 0.0}, {0.0, 0.0, 1.0, 0.0}};
+    int i, j;
+    
     if (!paramLT1 || pixelFormat1 == AR_PIXEL_FORMAT_INVALID || !transL2R) return false;
     
     memcpy(m_transL2R, transL2R, sizeof(ARdouble)*12);
     m_videoSourceIsStereo = true;
     
-    return start(paramLT0, pixelFormat0);
+    if (!start(paramLT0, pixelFormat0)) return false;
+    
+    // Stereo init. Matches from the right image are combined with those from the left image in a single pose estimate.
+    if (!(m_ar2Handle1 = ar2CreateHandle(paramLT1, AR_PIXEL_FORMAT_MONO, m_ar2Handle->threadNum))) {
+        ARLOGe("ar2CreateHandle\n");
+        stop();
+        return (false);
+    }
+    setAR2TrackingSettings(m_ar2Handle1);
+    if (!(m_icpStereoHandle = icpStereoCreateHandle(paramLT0->param.mat, paramLT1->param.mat, transIdentity, m_transL2R))) {
+        ARLOGe("icpStereoCreateHandle\n");
+        stop();
+        return (false);
+    }
+    m_paramLT1 = paramLT1;
+    for (j = 0; j < 3; j++) for (i = 0; i < 4; i++) m_transL2Rf[j][i] = (float)m_transL2R[j][i];
+    arUtilMatInvf((const float (*)[4])m_transL2Rf, m_transR2Lf);
+    if (paramLT1->param.xsize != paramLT0->param.xsize || paramLT1->param.ysize != paramLT0->param.ysize) {
+        ARLOGw("Stereo cameras have different frame sizes. NFT page detection will use the left camera only.\n");
+    }
+    m_kpmEye = 0;
+    
+    return true;
 }
 
 bool ARTrackerNFT::unloadNFTData(void)
@@ -136,8 +222,16 @@ bool ARTrackerNFT::unloadNFTData(void)
         trackingInitQuit(&trackingThreadHandle);
         m_kpmBusy = false;
     }
-    for (i = 0; i < PAGES_MAX; i++) m_surfaceSet[i] = NULL; // Discard weak-references.
+    for (i = 0; i < PAGES_MAX; i++) {
+        m_surfaceSet[i] = NULL; // Discard weak-references.
+        if (m_surfaceSet1[i]) {
+            delete m_surfaceSet1[i];
+            m_surfaceSet1[i] = NULL;
+        }
+        m_reacquisitionPending[i] = false;
+    }
     m_kpmRequired = true;
+    m_frameHistoryCount = 0;
     
     return true;
 }
@@ -179,6 +273,8 @@ bool ARTrackerNFT::loadNFTData(std::vector<ARTrackable *>& trackables)
             
             // For convenience, create a weak reference to the AR2 data.
             m_surfaceSet[pageCount] = ((ARTrackableNFT *)(*it))->surfaceSet;
+            // For stereo, the right camera needs its own tracking state for the same surfaces.
+            if (m_ar2Handle1) m_surfaceSet1[pageCount] = new AR2SurfaceSetT(*m_surfaceSet[pageCount]);
             
             pageCount++;
             if (pageCount == PAGES_MAX) {
@@ -205,12 +301,76 @@ bool ARTrackerNFT::loadNFTData(std::vector<ARTrackable *>& trackables)
     return true;
 }
 
+// Keeps a copy of the luma image of a frame which arrived while KPM was running.
+// If the ring is full, the oldest frame is dropped.
+void ARTrackerNFT::pushHistoryFrame(AR2VideoBufferT *buff)
+{
+    if (!buff || !buff->buffLuma) return;
+    
+    size_t size = (size_t)m_ar2Handle->xsize * (size_t)m_ar2Handle->ysize;
+    int slot;
+    if (m_frameHistoryCount < NFT_FRAME_HISTORY_MAX) {
+        slot = (m_frameHistoryStart + m_frameHistoryCount) % NFT_FRAME_HISTORY_MAX;
+        m_frameHistoryCount++;
+    } else {
+        slot = m_frameHistoryStart;
+        m_frameHistoryStart = (m_frameHistoryStart + 1) % NFT_FRAME_HISTORY_MAX;
+    }
+    m_frameHistory[slot].luma.assign(buff->buffLuma, buff->buffLuma + size); // Reuses existing storage once the ring has filled.
+    m_frameHistory[slot].time = buff->time;
+}
+
+// Starts AR2 tracking of a page detected by KPM. trans is relative to the camera KPM ran on.
+// Any frames from that camera which arrived while KPM was running are tracked through first,
+// to bring the pose forward to the most recent frame. If that fails, the KPM pose is used as-is.
+void ARTrackerNFT::seedFromKPM(int pageNo, float trans[3][4])
+{
+    AR2HandleT *ar2Handle = (m_kpmFrameEye ? m_ar2Handle1 : m_ar2Handle);
+    AR2SurfaceSetT *surfaceSet = (m_kpmFrameEye ? m_surfaceSet1[pageNo] : m_surfaceSet[pageNo]);
+    float trackingTrans[3][4];
+    float err;
+    int i;
+    
+    ar2SetInitTrans(surfaceSet, trans); // Sets surfaceSet->contNum = 1.
+    for (i = 0; i < m_frameHistoryCount; i++) {
+        HistoryFrame *frame = &m_frameHistory[(m_frameHistoryStart + i) % NFT_FRAME_HISTORY_MAX];
+        if (ar2Tracking(ar2Handle, surfaceSet, frame->luma.data(), trackingTrans, &err) < 0) {
+            ARLOGd("Latency compensation for page %d failed at buffered frame %d of %d.\n", pageNo, i + 1, m_frameHistoryCount);
+            ar2SetInitTrans(surfaceSet, trans);
+            break;
+        }
+    }
+    if (m_frameHistoryCount && i == m_frameHistoryCount) ARLOGd("Latency compensation for page %d carried pose forward over %d frames.\n", pageNo, m_frameHistoryCount);
+    
+    // Keep the other camera's tracking state in step. The left camera's is the reference.
+    if (m_kpmFrameEye) {
+        float transL[3][4];
+        arUtilMatMulf((const float (*)[4])m_transR2Lf, (const float (*)[4])surfaceSet->trans1, transL);
+        ar2SetInitTrans(m_surfaceSet[pageNo], transL);
+    } else if (m_surfaceSet1[pageNo]) {
+        float transR[3][4];
+        arUtilMatMulf((const float (*)[4])m_transL2Rf, (const float (*)[4])surfaceSet->trans1, transR);
+        ar2SetInitTrans(m_surfaceSet1[pageNo], transR);
+    }
+}
+
 bool ARTrackerNFT::isRunning()
 {
     return (bool)(m_kpmHandle && m_ar2Handle);
 }
 
 bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& trackables)
+{
+    return update2(buff, NULL, trackables);
+}
+
+bool ARTrackerNFT::update(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std::vector<ARTrackable *>& trackables)
+{
+    return update2(buff0, buff1, trackables);
+}
+
+// buff1 is NULL when tracking in mono.
+bool ARTrackerNFT::update2(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std::vector<ARTrackable *>& trackables)
 {
     ARLOGd("ARX::ARTrackerNFT::update()\n");
 
@@ -226,14 +386,27 @@ bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& tra
     
     if (trackingThreadHandle) {
         
+        bool stereo = (m_ar2Handle1 && m_icpStereoHandle && buff1 && buff1->buffLuma);
+        
         // Do KPM tracking.
         float err;
         float trackingTrans[3][4];
         
         if (m_kpmRequired) {
             if (!m_kpmBusy) {
-                trackingInitStart(trackingThreadHandle, buff->buffLuma);
+                int eye = (stereo ? m_kpmEye : 0);
+                if (m_ar2Handle1) {
+                    if (kpmHandleSetCameraParam(m_kpmHandle, (eye ? m_paramLT1 : m_paramLT0)) < 0) {
+                        eye = 0;
+                        kpmHandleSetCameraParam(m_kpmHandle, m_paramLT0);
+                    }
+                }
+                AR2VideoBufferT *kpmBuff = (eye ? buff1 : buff0);
+                trackingInitStart(trackingThreadHandle, kpmBuff->buffLuma);
                 m_kpmBusy = true;
+                m_kpmFrameEye = eye;
+                m_kpmFrameTime = kpmBuff->time;
+                m_frameHistoryCount = 0;
             } else {
                 int ret;
                 int pageNo;
@@ -243,15 +416,20 @@ bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& tra
                     if (ret == 1) {
                         if (pageNo >= 0 && pageNo < PAGES_MAX) {
                             if (m_surfaceSet[pageNo]->contNum < 1) {
-                                ARLOGd("Detected page %d.\n", pageNo);
-                                ar2SetInitTrans(m_surfaceSet[pageNo], trackingTrans); // Sets surfaceSet[page]->contNum = 1.
+                                ARLOGd("Detected page %d in %s image.\n", pageNo, (m_kpmFrameEye ? "right" : "left"));
+                                seedFromKPM(pageNo, trackingTrans);
+                                m_reacquisitionDetections++;
+                                m_reacquisitionPending[pageNo] = true;
+                                m_reacquisitionStartTime[pageNo] = m_kpmFrameTime;
                             }
                         } else {
                             ARLOGe("Detected page with bad page number %d.\n", pageNo);
                         }
                     } else /*if (ret < 0)*/ {
                         ARLOGd("No page detected.\n");
+                        if (stereo) m_kpmEye = 1 - m_kpmFrameEye; // Search the other camera's image next.
                     }
+                    m_frameHistoryCount = 0;
                 }
             }
         }
@@ -266,10 +444,27 @@ bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& tra
             if ((*it)->type == ARTrackable::NFT) {
                 
                 if (m_surfaceSet[page]->contNum > 0) {
-                    if (ar2Tracking(m_ar2Handle, m_surfaceSet[page], buff->buffLuma, trackingTrans, &err) < 0) {
+                    int ret;
+                    if (stereo) {
+                        int numL = 0, numR = 0;
+                        ret = ar2TrackingStereo(m_ar2Handle, m_ar2Handle1, m_icpStereoHandle, m_surfaceSet[page], m_surfaceSet1[page], buff0->buffLuma, buff1->buffLuma, m_transL2Rf, trackingTrans, &err, &numL, &numR);
+                        // If the page is lost, look for it again in the image which last had the better view of it.
+                        if (numL != numR) m_kpmEye = (numR > numL ? 1 : 0);
+                    } else {
+                        ret = ar2Tracking(m_ar2Handle, m_surfaceSet[page], buff0->buffLuma, trackingTrans, &err);
+                    }
+                    if (ret < 0) {
                         ARLOGd("Tracking lost on page %d.\n", page);
                         success &= ((ARTrackableNFT *)(*it))->updateWithNFTResults(-1, NULL, NULL);
+                        m_reacquisitionPending[page] = false;
                     } else {
+                        if (m_reacquisitionPending[page]) {
+                            double latencyMs = timestampDiffMs(&buff0->time, &m_reacquisitionStartTime[page]);
+                            m_reacquisitions++;
+                            m_reacquisitionLatencyTotalMs += latencyMs;
+                            m_reacquisitionPending[page] = false;
+                            ARLOGd("Reacquired page %d, %.1f ms after KPM frame (%d of %d detections reacquired).\n", page, latencyMs, m_reacquisitions, m_reacquisitionDetections);
+                        }
                         ARLOGd("Tracked page %d (pos = {% 4f, % 4f, % 4f}).\n", page, trackingTrans[0][3], trackingTrans[1][3], trackingTrans[2][3]);
                         success &= ((ARTrackableNFT *)(*it))->updateWithNFTResults(page, trackingTrans, (ARdouble (*)[4])transL2R);
                         pagesTracked++;
@@ -282,16 +477,14 @@ bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& tra
         
         m_kpmRequired = (pagesTracked < (m_nftMultiMode ? page : 1));
         
+        // While KPM is running, keep this frame so that a pose from KPM can be carried forward to the current frame.
+        if (m_latencyCompensation && m_kpmRequired && m_kpmBusy) pushHistoryFrame(m_kpmFrameEye ? buff1 : buff0);
+        
     } // trackingThreadHandle
 
     return true;
 }
 
-bool ARTrackerNFT::update(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std::vector<ARTrackable *>& trackables)
-{
-    return update(buff0, trackables);
-}
-
 bool ARTrackerNFT::stop()
 {
     // Tracking thread is holding a reference to the camera parameters. Closing the
@@ -306,9 +499,16 @@ bool ARTrackerNFT::stop()
     if (m_ar2Handle) {
         ar2DeleteHandle(&m_ar2Handle); // Sets m_ar2Handle to NULL.
     }
+    if (m_ar2Handle1) {
+        ar2DeleteHandle(&m_ar2Handle1);
+    }
+    if (m_icpStereoHandle) {
+        icpStereoDeleteHandle(&m_icpStereoHandle);
+    }
     if (m_kpmHandle) {
         kpmDeleteHandle(&m_kpmHandle); // Sets m_kpmHandle to NULL.
     }
+    m_paramLT0 = m_paramLT1 = NULL;
     
     m_videoSourceIsStereo = false;
     
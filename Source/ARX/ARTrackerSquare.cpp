@@ -43,6 +43,8 @@
 #include <ARX/ARTrackableMultiSquare.h>
 #include <ARX/ARTrackableMultiSquareAuto.h>
 #include <ARX/AR/ar.h>
+#include <algorithm>
+#include <chrono>
 
 ARTrackerSquare::ARTrackerSquare() :
     m_threshold(AR_DEFAULT_LABELING_THRESH),
@@ -55,13 +57,26 @@ ARTrackerSquare::ARTrackerSquare() :
     m_debugMode(FALSE),
     m_patternSize(AR_PATT_SIZE1),
     m_patternCountMax(AR_PATT_NUM_MAX),
+    m_stereoParallelDetection(false),
     m_arHandle0(NULL),
     m_arHandle1(NULL),
     m_arPattHandle(NULL),
     m_ar3DHandle(NULL),
-    m_ar3DStereoHandle(NULL)
+    m_ar3DStereoHandle(NULL),
+    m_detectionThread1(NULL),
+    m_detectionTask0({NULL, NULL, 0, 0.0}),
+    m_detectionTask1({NULL, NULL, 0, 0.0}),
+    m_detectionTimeMs(0.0),
+    m_markerInfo0(NULL),
+    m_markerNum0(0),
+    m_markerInfo1(NULL),
+    m_markerNum1(0)
 {
-    
+    for (int i = 0; i < POSE_WORKER_COUNT; i++) m_poseThreads[i] = NULL;
+    for (int i = 0; i <= POSE_WORKER_COUNT; i++) {
+        m_poseTasks[i].tracker = this;
+        m_poseTasks[i].success = true;
+    }
 }
 
 ARTrackerSquare::~ARTrackerSquare()
@@ -279,6 +294,127 @@ int ARTrackerSquare::patternCountMax() const
     return m_patternCountMax;
 }
 
+void ARTrackerSquare::setStereoParallelDetection(bool on)
+{
+    m_stereoParallelDetection = on;
+    if (on) {
+        if (m_arHandle1) startDetectionWorker();
+    } else {
+        stopDetectionWorker();
+    }
+    ARLOGi("Stereo parallel detection set to %s.\n", on ? "on" : "off");
+}
+
+bool ARTrackerSquare::stereoParallelDetection() const
+{
+    return m_stereoParallelDetection;
+}
+
+void ARTrackerSquare::detectionTiming(double *eye0Ms, double *eye1Ms, double *totalMs) const
+{
+    if (eye0Ms) *eye0Ms = m_detectionTask0.timeMs;
+    if (eye1Ms) *eye1Ms = m_detectionTask1.timeMs;
+    if (totalMs) *totalMs = m_detectionTimeMs;
+}
+
+// ----------------------------------------------------------------------------------------------------
+#pragma mark  Stereo detection worker
+// ----------------------------------------------------------------------------------------------------
+
+static void runDetectionTask(ARHandle *arHandle, AR2VideoBufferT *buff, int *ret_p, double *timeMs_p)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    *ret_p = arDetectMarker(arHandle, buff);
+    *timeMs_p = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void *ARTrackerSquare::detectionWorker(THREAD_HANDLE_T *threadHandle)
+{
+    DetectionTask *task = (DetectionTask *)threadGetArg(threadHandle);
+    
+    ARLOGd("Start detection thread.\n");
+    while (threadStartWait(threadHandle) == 0) {
+        runDetectionTask(task->arHandle, task->buff, &task->ret, &task->timeMs);
+        threadEndSignal(threadHandle);
+    }
+    ARLOGd("End detection thread.\n");
+    return (NULL);
+}
+
+bool ARTrackerSquare::startDetectionWorker()
+{
+    if (m_detectionThread1) return true;
+    m_detectionThread1 = threadInit(1, &m_detectionTask1, detectionWorker);
+    if (!m_detectionThread1) {
+        ARLOGe("Error starting detection thread.\n");
+        return false;
+    }
+    return true;
+}
+
+void ARTrackerSquare::stopDetectionWorker()
+{
+    if (!m_detectionThread1) return;
+    threadWaitQuit(m_detectionThread1);
+    threadFree(&m_detectionThread1);
+}
+
+// ----------------------------------------------------------------------------------------------------
+#pragma mark  Pose workers
+// ----------------------------------------------------------------------------------------------------
+
+void ARTrackerSquare::runPoseTask(PoseTask *task)
+{
+    task->success = true;
+    for (std::vector<ARTrackableSquare *>::iterator it = task->trackables.begin(); it != task->trackables.end(); ++it) {
+        ARTrackableSquare *square = *it;
+        const bool matrix = (square->patt_type != AR_PATTERN_TYPE_TEMPLATE);
+        m_detectionIndex0.candidates(square->patt_id, matrix, task->candidates0);
+        if (!m_markerInfo1) {
+            task->success &= square->updateWithDetectedMarkers(m_markerInfo0, m_markerNum0, task->candidates0.data(), (int)task->candidates0.size(), m_ar3DHandle);
+        } else {
+            m_detectionIndex1.candidates(square->patt_id, matrix, task->candidates1);
+            task->success &= square->updateWithDetectedMarkersStereo(m_markerInfo0, m_markerNum0, task->candidates0.data(), (int)task->candidates0.size(), m_markerInfo1, m_markerNum1, task->candidates1.data(), (int)task->candidates1.size(), m_ar3DStereoHandle, m_transL2R);
+        }
+    }
+}
+
+void *ARTrackerSquare::poseWorker(THREAD_HANDLE_T *threadHandle)
+{
+    PoseTask *task = (PoseTask *)threadGetArg(threadHandle);
+    
+    ARLOGd("Start pose thread.\n");
+    while (threadStartWait(threadHandle) == 0) {
+        task->tracker->runPoseTask(task);
+        threadEndSignal(threadHandle);
+    }
+    ARLOGd("End pose thread.\n");
+    return (NULL);
+}
+
+bool ARTrackerSquare::startPoseWorkers()
+{
+    for (int i = 0; i < POSE_WORKER_COUNT; i++) {
+        if (m_poseThreads[i]) continue;
+        m_poseThreads[i] = threadInit(i, &m_poseTasks[i + 1], poseWorker);
+        if (!m_poseThreads[i]) {
+            ARLOGe("Error starting pose thread.\n");
+            stopPoseWorkers();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ARTrackerSquare::stopPoseWorkers()
+{
+    for (int i = 0; i < POSE_WORKER_COUNT; i++) {
+        if (!m_poseThreads[i]) continue;
+        threadWaitQuit(m_poseThreads[i]);
+        threadFree(&m_poseThreads[i]);
+    }
+}
+
 bool ARTrackerSquare::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
 {
     return start(paramLT, pixelFormat, NULL, AR_PIXEL_FORMAT_INVALID, NULL);
@@ -345,6 +481,7 @@ bool ARTrackerSquare::start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, A
             ARLOGe("ar3DStereoCreateHandle\n");
             goto bail2;
         }
+        if (m_stereoParallelDetection) startDetectionWorker(); // On failure, will fall back to detecting in each image in turn.
     }
     
     ARLOGd("ARTrackerSquare::start() done.\n");
@@ -376,39 +513,83 @@ bool ARTrackerSquare::update(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std
 
     if (!m_arHandle0 || (buff1 && !m_arHandle1)) return false;
 
-    if (arDetectMarker(m_arHandle0, buff0) < 0) {
+    auto t0 = std::chrono::steady_clock::now();
+    m_detectionTask0.arHandle = m_arHandle0;
+    m_detectionTask0.buff = buff0;
+    m_detectionTask1.arHandle = m_arHandle1;
+    m_detectionTask1.buff = buff1;
+    m_detectionTask1.timeMs = 0.0;
+    if (buff1 && m_detectionThread1) {
+        // Detect in the second image on the worker while detecting in the first image here.
+        threadStartSignal(m_detectionThread1);
+        runDetectionTask(m_arHandle0, buff0, &m_detectionTask0.ret, &m_detectionTask0.timeMs);
+        threadEndWait(m_detectionThread1);
+    } else {
+        runDetectionTask(m_arHandle0, buff0, &m_detectionTask0.ret, &m_detectionTask0.timeMs);
+        if (buff1 && m_detectionTask0.ret >= 0) runDetectionTask(m_arHandle1, buff1, &m_detectionTask1.ret, &m_detectionTask1.timeMs);
+    }
+    m_detectionTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (buff1) ARLOGd("Marker detection took %.3f ms (left %.3f ms, right %.3f ms).\n", m_detectionTimeMs, m_detectionTask0.timeMs, m_detectionTask1.timeMs);
+
+    if (m_detectionTask0.ret < 0 || (buff1 && m_detectionTask1.ret < 0)) {
         ARLOGe("arDetectMarker().\n");
         return false;
     }
     markerInfo0 = arGetMarker(m_arHandle0);
     markerNum0 = arGetMarkerNum(m_arHandle0);
     if (buff1) {
-        if (arDetectMarker(m_arHandle1, buff1) < 0) {
-            ARLOGe("arDetectMarker().\n");
-            return false;
-        }
         markerInfo1 = arGetMarker(m_arHandle1);
         markerNum1 = arGetMarkerNum(m_arHandle1);
     }
 
-    // Update square markers.
+    // Update square markers. Each trackable is given only the detections with its ID (or, for multi-square
+    // trackables, any of its submarkers' IDs); trackables with none are updated with no detections, which
+    // marks them not visible without searching.
+    m_markerInfo0 = markerInfo0;
+    m_markerNum0 = markerNum0;
+    m_markerInfo1 = markerInfo1;
+    m_markerNum1 = markerNum1;
+    m_detectionIndex0.build(markerInfo0, markerNum0);
+    if (buff1) m_detectionIndex1.build(markerInfo1, markerNum1);
+    
+    // Single-square trackables are independent, so with enough detections their matching and pose estimation
+    // are shared between the calling thread and the pose workers. When detections carry both a template and a
+    // matrix ID, trackables with different IDs can match the same detection, so they are updated in turn.
+    const bool parallel = std::max(markerNum0, markerNum1) >= POSE_PARALLEL_MIN
+        && m_patternDetectionMode != AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX && m_patternDetectionMode != AR_TEMPLATE_MATCHING_MONO_AND_MATRIX
+        && startPoseWorkers();
+    const int shares = parallel ? POSE_WORKER_COUNT + 1 : 1;
+    for (int i = 0; i < shares; i++) m_poseTasks[i].trackables.clear();
+    for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
+        if ((*it)->type == ARTrackable::SINGLE) {
+            ARTrackableSquare *square = (ARTrackableSquare *)(*it);
+            m_poseTasks[(unsigned int)square->patt_id % shares].trackables.push_back(square);
+        }
+    }
+    for (int i = 1; i < shares; i++) threadStartSignal(m_poseThreads[i - 1]);
+    runPoseTask(&m_poseTasks[0]);
+    for (int i = 1; i < shares; i++) threadEndWait(m_poseThreads[i - 1]);
     bool success = true;
+    for (int i = 0; i < shares; i++) success &= m_poseTasks[i].success;
+    
+    // Multi-square trackables, which may share detections with any other trackable, are updated afterwards.
     if (!buff1) {
         for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
-            if ((*it)->type == ARTrackable::SINGLE) {
-                success &= ((ARTrackableSquare *)(*it))->updateWithDetectedMarkers(markerInfo0, markerNum0, m_ar3DHandle);
-            } else if ((*it)->type == ARTrackable::MULTI) {
-                success &= ((ARTrackableMultiSquare *)(*it))->updateWithDetectedMarkers(markerInfo0, markerNum0, m_ar3DHandle);
+            if ((*it)->type == ARTrackable::MULTI) {
+                ARTrackableMultiSquare *multi = (ARTrackableMultiSquare *)(*it);
+                // With no detections, the multimarker pose search ends at once and resets its state.
+                const int num = multiSquareHasCandidates(multi, m_detectionIndex0) ? markerNum0 : 0;
+                success &= multi->updateWithDetectedMarkers(markerInfo0, num, m_ar3DHandle);
             } else if ((*it)->type == ARTrackable::MULTI_AUTO) {
                 success &= ((ARTrackableMultiSquareAuto *)(*it))->updateWithDetectedMarkers(markerInfo0, markerNum0, m_arHandle0->xsize, m_arHandle0->ysize, m_ar3DHandle);
             }
         }
     } else {
         for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
-            if ((*it)->type == ARTrackable::SINGLE) {
-                success &= ((ARTrackableSquare *)(*it))->updateWithDetectedMarkersStereo(markerInfo0, markerNum0, markerInfo1, markerNum1, m_ar3DStereoHandle, m_transL2R);
-            } else if ((*it)->type == ARTrackable::MULTI) {
-                success &= ((ARTrackableMultiSquare *)(*it))->updateWithDetectedMarkersStereo(markerInfo0, markerNum0, markerInfo1, markerNum1, m_ar3DStereoHandle, m_transL2R);
+            if ((*it)->type == ARTrackable::MULTI) {
+                ARTrackableMultiSquare *multi = (ARTrackableMultiSquare *)(*it);
+                const bool any = multiSquareHasCandidates(multi, m_detectionIndex0) || multiSquareHasCandidates(multi, m_detectionIndex1);
+                success &= multi->updateWithDetectedMarkersStereo(markerInfo0, any ? markerNum0 : 0, markerInfo1, any ? markerNum1 : 0, m_ar3DStereoHandle, m_transL2R);
             } else if ((*it)->type == ARTrackable::MULTI_AUTO) {
                 success &= ((ARTrackableMultiSquareAuto *)(*it))->updateWithDetectedMarkersStereo(markerInfo0, markerNum0, m_arHandle0->xsize, m_arHandle0->ysize, markerInfo1, markerNum1, m_arHandle1->xsize, m_arHandle1->ysize, m_ar3DStereoHandle, m_transL2R);
             }
@@ -418,8 +599,63 @@ bool ARTrackerSquare::update(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std
     return true;
 }
 
+void ARTrackerSquare::DetectionIndex::build(const ARMarkerInfo *markerInfo, int markerNum)
+{
+    firstPatt.clear();
+    firstMatrix.clear();
+    nextPatt.resize(markerNum);
+    nextMatrix.resize(markerNum);
+    // Backwards, so that each chain is in increasing index order, as a full scan would visit them.
+    for (int j = markerNum - 1; j >= 0; j--) {
+        nextPatt[j] = nextMatrix[j] = -1;
+        if (markerInfo[j].idPatt >= 0) {
+            std::pair<std::unordered_map<int, int>::iterator, bool> r = firstPatt.insert(std::make_pair(markerInfo[j].idPatt, j));
+            if (!r.second) {
+                nextPatt[j] = r.first->second;
+                r.first->second = j;
+            }
+        }
+        if (markerInfo[j].idMatrix >= 0) {
+            std::pair<std::unordered_map<int, int>::iterator, bool> r = firstMatrix.insert(std::make_pair(markerInfo[j].idMatrix, j));
+            if (!r.second) {
+                nextMatrix[j] = r.first->second;
+                r.first->second = j;
+            }
+        }
+    }
+}
+
+bool ARTrackerSquare::DetectionIndex::contains(int id, bool matrix) const
+{
+    return (matrix ? firstMatrix.count(id) : firstPatt.count(id)) != 0;
+}
+
+void ARTrackerSquare::DetectionIndex::candidates(int id, bool matrix, std::vector<int>& out) const
+{
+    out.clear();
+    const std::unordered_map<int, int>& first = matrix ? firstMatrix : firstPatt;
+    const std::vector<int>& next = matrix ? nextMatrix : nextPatt;
+    std::unordered_map<int, int>::const_iterator it = first.find(id);
+    if (it == first.end()) return;
+    for (int j = it->second; j != -1; j = next[j]) out.push_back(j);
+}
+
+bool ARTrackerSquare::multiSquareHasCandidates(const ARTrackableMultiSquare *multi, const DetectionIndex& index) const
+{
+    if (!multi->config) return true; // Let the trackable handle it.
+    for (int i = 0; i < multi->config->marker_num; i++) {
+        const ARMultiEachMarkerInfoT& m = multi->config->marker[i];
+        if (m.patt_type == AR_MULTI_PATTERN_TYPE_MATRIX && m.globalID != 0) return true; // Global IDs are matched by arGetTransMatMultiSquare itself.
+        if (index.contains(m.patt_id, m.patt_type == AR_MULTI_PATTERN_TYPE_MATRIX)) return true;
+    }
+    return false;
+}
+
 bool ARTrackerSquare::stop()
 {
+    stopDetectionWorker();
+    stopPoseWorkers();
+    
     //ARLOGd("Cleaning up artoolkitX handles.\n");
     if (m_ar3DHandle) {
         ar3DDeleteHandle(&m_ar3DHandle); // Sets ar3DHandle0 to NULL.
@@ -112,6 +112,34 @@ ARUTIL_EXTERN void *threadGetArg( THREAD_HANDLE_T *flag );    // Get the 'arg' v
 
 ARUTIL_EXTERN int threadGetCPU(void); // Returns the number of online CPUs in the system.
 
+//
+// Work queue.
+// Hands out the indices of a batch of work items to any number of workers, each index exactly once,
+// so that workers which finish early can take more items instead of waiting for the slowest.
+//
+
+typedef struct _THREAD_QUEUE_T THREAD_QUEUE_T;
+
+ARUTIL_EXTERN THREAD_QUEUE_T *threadQueueInit(void); // Create a new, empty work queue. Returns NULL in case of failure.
+ARUTIL_EXTERN int threadQueueFree( THREAD_QUEUE_T **queue ); // Frees the work queue pointed to by the location pointed to by queue, and sets that location to NULL.
+ARUTIL_EXTERN int threadQueueReset( THREAD_QUEUE_T *queue, int count ); // Client-side. Make items 0 to count-1 available. Call only when no worker is taking from the queue.
+ARUTIL_EXTERN int threadQueueTake( THREAD_QUEUE_T *queue ); // Worker-side. Take the index of the next available item, or -1 if none remain.
+
+// Example:
+//
+//    // Client. Workers' arg includes queue and items.
+//    threadQueueReset(queue, itemCount);
+//    for (i = 0; i < threadNum; i++) threadStartSignal(threadHandle[i]);
+//    for (i = 0; i < threadNum; i++) threadEndWait(threadHandle[i]);
+//
+//    // Worker.
+//    while (threadStartWait(threadHandle) == 0) {
+//        while ((i = threadQueueTake(queue)) >= 0) {
+//            // Do work on items[i].
+//        }
+//        threadEndSignal(threadHandle);
+//    }
+
 
 #ifdef __cplusplus
 }
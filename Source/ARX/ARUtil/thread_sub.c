@@ -87,6 +87,12 @@ struct _THREAD_HANDLE_T {
     void           *arg;
 };
 
+struct _THREAD_QUEUE_T {
+    int             next;
+    int             count;
+    pthread_mutex_t mut;
+};
+
 //
 // Worker-side.
 //
@@ -270,3 +276,46 @@ int threadGetCPU(void)
     return (int)sysconf(_SC_NPROCESSORS_ONLN);
 #endif
 }
+
+//
+// Work queue.
+//
+
+THREAD_QUEUE_T *threadQueueInit(void)
+{
+    THREAD_QUEUE_T *queue;
+
+    if ((queue = malloc(sizeof(THREAD_QUEUE_T))) == NULL) return NULL;
+    queue->next  = 0;
+    queue->count = 0;
+    pthread_mutex_init( &(queue->mut), NULL );
+    return queue;
+}
+
+int threadQueueFree( THREAD_QUEUE_T **queue )
+{
+    if (!queue || !*queue) return -1;
+    pthread_mutex_destroy(&((*queue)->mut));
+    free( *queue );
+    *queue = NULL;
+    return 0;
+}
+
+int threadQueueReset( THREAD_QUEUE_T *queue, int count )
+{
+    pthread_mutex_lock(&(queue->mut));
+    queue->next  = 0;
+    queue->count = count;
+    pthread_mutex_unlock(&(queue->mut));
+    return 0;
+}
+
+int threadQueueTake( THREAD_QUEUE_T *queue )
+{
+    int  index;
+    pthread_mutex_lock(&(queue->mut));
+    if (queue->next < queue->count) index = queue->next++;
+    else                            index = -1;
+    pthread_mutex_unlock(&(queue->mut));
+    return index;
+}
@@ -43,6 +43,8 @@
 #ifdef ARVIDEO_INPUT_IMAGE
 
 #include <string.h> // memset()
+#include <pthread.h>
+#include <ARX/ARUtil/time.h>
 #include "jpeglib.h"
 
 #define AR_VIDEO_IMAGE_XSIZE_DEFAULT   640
@@ -58,8 +60,15 @@ struct _AR2VideoImageRef {
     char *pathname;
 };
 
+// A decoded image waiting in (or just taken from) the prefetch queue.
+typedef struct {
+    unsigned char     *buff;
+    AR2VideoImageRef  *image;       // Image which was decoded into buff.
+} AR2VideoImageSlot;
+
 struct _AR2VideoParamImageT {
     AR2VideoBufferT    buffer;
+    unsigned char     *imageBuff;   // Decode buffer when not prefetching.
     int                width;
     int                height;
     AR_PIXEL_FORMAT    format;
@@ -69,6 +78,22 @@ struct _AR2VideoParamImageT {
     AR2VideoImageRef  *nextImage;
     unsigned long      imageCount;
     int                loop;
+    // Clock.
+    float              fps;         // If > 0, image n is timestamped (n + 1)/fps seconds after the epoch.
+    int                asap;        // If TRUE, images are returned as soon as decoded, rather than at fps.
+    unsigned long      frameIndex;  // Number of images returned since open.
+    uint64_t           clockStart;  // Time (microseconds since epoch) at which image 0 was, or would have been, returned. 0 if capture not yet started.
+    // Prefetch.
+    int                prefetch;    // Number of images to decode ahead, or 0 to decode in ar2VideoGetImageImage().
+    int                prefetchRunning;
+    pthread_t          prefetchThread;
+    pthread_mutex_t    prefetchLock;
+    pthread_cond_t     prefetchCond;
+    AR2VideoImageSlot *prefetchSlots; // prefetch + 1 slots; the slot before prefetchHead is held by the caller.
+    int                prefetchHead;
+    int                prefetchCount;
+    int                prefetchQuit;
+    int                prefetchDone; // Worker reached the end of the image list, or no image in it could be decoded.
 };
 
 #define OUTBUF_HEIGHT_MAX 16
@@ -237,6 +262,164 @@ static int jpegRead(FILE *fp, unsigned char *buf, int bufWidth, int bufHeight, A
     return (TRUE);
 }
 
+static int imageDecode(AR2VideoParamImageT *vid, AR2VideoImageRef *image, unsigned char *buff)
+{
+    FILE *infile;
+    int ok;
+
+    if ((infile = fopen(image->pathname, "rb")) == NULL) {
+        ARLOGe("Error: unable to open JPEG file '%s' for reading.\n", image->pathname);
+        ARLOGperror(NULL);
+        return (FALSE);
+    }
+    ok = jpegRead(infile, buff, vid->bufWidth, vid->bufHeight, vid->format);
+    fclose(infile);
+    return (ok);
+}
+
+static AR2VideoImageRef *imageNext(AR2VideoParamImageT *vid, AR2VideoImageRef *image)
+{
+    image = image->next; // Next item in linked list.
+    if (!image && vid->loop) image = vid->imageList; // If we've hit the end of the list and looping requested, go back to head of linked list.
+    return (image);
+}
+
+static uint64_t imageClockNow(void)
+{
+    uint64_t sec;
+    uint32_t usec;
+
+    arUtilTimeSinceEpoch(&sec, &usec);
+    return (sec*1000000ull + usec);
+}
+
+// Returns TRUE if the next image is due to be returned. With a fixed frame rate, image n
+// is due n/fps seconds after image 0. The clock restarts from the next image each time capture is started.
+static int imageClockDue(AR2VideoParamImageT *vid)
+{
+    uint64_t now, offset;
+
+    if (vid->fps <= 0.0f || vid->asap) return (TRUE);
+    now = imageClockNow();
+    offset = (uint64_t)((double)vid->frameIndex * 1000000.0 / vid->fps);
+    if (!vid->clockStart) {
+        vid->clockStart = now - offset;
+        return (TRUE);
+    }
+    return (now >= vid->clockStart + offset);
+}
+
+static void imageClockStamp(AR2VideoParamImageT *vid)
+{
+    uint64_t t;
+
+    if (vid->fps > 0.0f) {
+        // Frame 0 is stamped one period after the epoch, as a zero timestamp means "not set".
+        t = (uint64_t)((double)(vid->frameIndex + 1) * 1000000.0 / vid->fps);
+        vid->buffer.time.sec  = t / 1000000ull;
+        vid->buffer.time.usec = (uint32_t)(t % 1000000ull);
+    } else {
+        vid->buffer.time.sec  = 0;
+        vid->buffer.time.usec = 0;
+    }
+    vid->frameIndex++;
+}
+
+static void *imagePrefetch(void *arg)
+{
+    AR2VideoParamImageT *vid = (AR2VideoParamImageT *)arg;
+    AR2VideoImageRef *image;
+    AR2VideoImageSlot *slot;
+    int ok;
+    unsigned long failCount = 0ul; // Consecutive images which failed to decode.
+
+    pthread_mutex_lock(&vid->prefetchLock);
+    while (!vid->prefetchQuit && vid->nextImage) {
+        if (vid->prefetchCount == vid->prefetch) {
+            pthread_cond_wait(&vid->prefetchCond, &vid->prefetchLock);
+            continue;
+        }
+        slot = &vid->prefetchSlots[(vid->prefetchHead + vid->prefetchCount) % (vid->prefetch + 1)];
+        image = vid->nextImage;
+        pthread_mutex_unlock(&vid->prefetchLock);
+
+        // This slot is neither queued nor held by the caller, so decode into it unlocked.
+        ok = imageDecode(vid, image, slot->buff);
+
+        pthread_mutex_lock(&vid->prefetchLock);
+        vid->nextImage = imageNext(vid, image);
+        if (ok) {
+            failCount = 0ul;
+            slot->image = image;
+            vid->prefetchCount++;
+            pthread_cond_broadcast(&vid->prefetchCond);
+        } else if (++failCount >= vid->imageCount) {
+            // Every image in the list has failed in a row, so looping would never yield another.
+            ARLOGe("Error: no image in the list could be decoded.\n");
+            break;
+        }
+    }
+    vid->prefetchDone = TRUE;
+    pthread_cond_broadcast(&vid->prefetchCond);
+    pthread_mutex_unlock(&vid->prefetchLock);
+
+    return (NULL);
+}
+
+static int imagePrefetchStart(AR2VideoParamImageT *vid)
+{
+    int i, bufSize;
+
+    if (vid->prefetchRunning) return (0);
+
+    bufSize = vid->bufWidth * vid->bufHeight * arVideoUtilGetPixelSize(vid->format);
+    arMallocClear(vid->prefetchSlots, AR2VideoImageSlot, vid->prefetch + 1);
+    for (i = 0; i < vid->prefetch + 1; i++) arMalloc(vid->prefetchSlots[i].buff, unsigned char, bufSize);
+    vid->prefetchHead = 0;
+    vid->prefetchCount = 0;
+    vid->prefetchQuit = FALSE;
+    vid->prefetchDone = FALSE;
+    pthread_mutex_init(&vid->prefetchLock, NULL);
+    pthread_cond_init(&vid->prefetchCond, NULL);
+    if (pthread_create(&vid->prefetchThread, NULL, imagePrefetch, vid) != 0) {
+        ARLOGe("Error: unable to start image prefetch thread.\n");
+        pthread_cond_destroy(&vid->prefetchCond);
+        pthread_mutex_destroy(&vid->prefetchLock);
+        for (i = 0; i < vid->prefetch + 1; i++) free(vid->prefetchSlots[i].buff);
+        free(vid->prefetchSlots);
+        vid->prefetchSlots = NULL;
+        return (-1);
+    }
+    vid->prefetchRunning = TRUE;
+    return (0);
+}
+
+static void imagePrefetchStop(AR2VideoParamImageT *vid)
+{
+    int i;
+
+    if (!vid->prefetchRunning) return;
+
+    pthread_mutex_lock(&vid->prefetchLock);
+    vid->prefetchQuit = TRUE;
+    pthread_cond_broadcast(&vid->prefetchCond);
+    pthread_mutex_unlock(&vid->prefetchLock);
+    pthread_join(vid->prefetchThread, NULL);
+    vid->prefetchRunning = FALSE;
+
+    // Images decoded but not yet returned will be read again on restart.
+    if (vid->prefetchCount) vid->nextImage = vid->prefetchSlots[vid->prefetchHead].image;
+
+    pthread_cond_destroy(&vid->prefetchCond);
+    pthread_mutex_destroy(&vid->prefetchLock);
+    for (i = 0; i < vid->prefetch + 1; i++) free(vid->prefetchSlots[i].buff);
+    free(vid->prefetchSlots);
+    vid->prefetchSlots = NULL;
+    vid->buffer.buff = vid->imageBuff;
+    vid->buffer.buffLuma = NULL;
+    vid->buffer.fillFlag = 0;
+}
+
 int ar2VideoDispOptionImage( void )
 {
     ARPRINT(" -module=Image\n");
@@ -253,6 +436,14 @@ int ar2VideoDispOptionImage( void )
     ARPRINT("    After reading last image, next read will return first image.\n");
     ARPRINT(" -noloop\n");
     ARPRINT("    After reading last image, no further images will be returned.\n");
+    ARPRINT(" -prefetch=N\n");
+    ARPRINT("    Decode up to N images ahead on a background thread. Default 0 (decode when read).\n");
+    ARPRINT(" -fps=F\n");
+    ARPRINT("    Return images at F frames per second, and timestamp image n (from 0) at (n + 1)/F\n");
+    ARPRINT("    seconds, independent of when it was read. Default is to return images whenever\n");
+    ARPRINT("    read and timestamp them with the time of reading.\n");
+    ARPRINT(" -asap\n");
+    ARPRINT("    With -fps, return images as fast as they can be decoded, but keep the -fps timestamps.\n");
     ARPRINT("\n");
 
     return 0;
@@ -273,6 +464,7 @@ AR2VideoParamImageT *ar2VideoOpenImage( const char *config )
     int ok, err_i = 0;
 
     arMalloc( vid, AR2VideoParamImageT, 1 );
+    vid->imageBuff = NULL;
     vid->buffer.buff = vid->buffer.buffLuma = NULL;
     vid->buffer.bufPlanes = NULL;
     vid->buffer.bufPlaneCount = 0;
@@ -283,6 +475,13 @@ AR2VideoParamImageT *ar2VideoOpenImage( const char *config )
     vid->imageList = NULL;
     vid->imageCount = 0ul;
     vid->loop = FALSE;
+    vid->fps = 0.0f;
+    vid->asap = FALSE;
+    vid->frameIndex = 0ul;
+    vid->clockStart = 0ull;
+    vid->prefetch = 0;
+    vid->prefetchRunning = FALSE;
+    vid->prefetchSlots = NULL;
 
     a = config;
     if( a != NULL) {
@@ -343,6 +542,16 @@ AR2VideoParamImageT *ar2VideoOpenImage( const char *config )
                 vid->loop = TRUE;
             } else if (strncmp(a, "-noloop", 7) == 0) {
                 vid->loop = FALSE;
+            } else if (strncmp(line, "-prefetch=", 10) == 0) {
+                if (sscanf(&line[10], "%d", &vid->prefetch) != 1 || vid->prefetch < 0) {
+                    err_i = 1;
+                }
+            } else if (strncmp(line, "-fps=", 5) == 0) {
+                if (sscanf(&line[5], "%f", &vid->fps) != 1 || vid->fps < 0.0f) {
+                    err_i = 1;
+                }
+            } else if (strcmp(line, "-asap") == 0) {
+                vid->asap = TRUE;
             } else if( strcmp( line, "-module=Image" ) == 0 )    {
             } else {
                 err_i = 1;
@@ -404,6 +613,8 @@ AR2VideoParamImageT *ar2VideoOpenImage( const char *config )
     vid->nextImage = vid->imageList;
 
     ARPRINT("Image video size %dx%d@%dBpp.\n", vid->width, vid->height, arVideoUtilGetPixelSize(vid->format));
+    if (vid->prefetch) ARLOGi("Image video prefetching %d images.\n", vid->prefetch);
+    if (vid->fps > 0.0f) ARLOGi("Image video clock %.2f fps%s.\n", vid->fps, (vid->asap ? ", returning images as fast as decoded" : ""));
 
     return vid;
 bail:
@@ -416,6 +627,7 @@ int ar2VideoCloseImage( AR2VideoParamImageT *vid )
     AR2VideoImageRef *imageRefToFree;
 
     if (!vid) return (-1); // Sanity check.
+    imagePrefetchStop(vid);
     while (vid->imageList) {
         imageRefToFree = vid->imageList;
         vid->imageList = vid->imageList->next;
@@ -431,47 +643,63 @@ int ar2VideoCloseImage( AR2VideoParamImageT *vid )
 
 int ar2VideoCapStartImage( AR2VideoParamImageT *vid )
 {
+    if (!vid) return (-1); // Sanity check.
+    vid->clockStart = 0ull;
+    if (vid->prefetch) return (imagePrefetchStart(vid));
     return 0;
 }
 
 int ar2VideoCapStopImage( AR2VideoParamImageT *vid )
 {
+    if (!vid) return (-1); // Sanity check.
+    imagePrefetchStop(vid);
     return 0;
 }
 
 AR2VideoBufferT *ar2VideoGetImageImage( AR2VideoParamImageT *vid )
 {
-    FILE *infile;
-    int ok;
+    AR2VideoImageSlot *slot;
 
     if (!vid) return (NULL); // Sanity check.
 
-    if (vid->nextImage) {
-        if ((infile = fopen(vid->nextImage->pathname, "rb")) == NULL) {
-            ARLOGe("Error: unable to open JPEG file '%s' for reading.\n", vid->nextImage->pathname);
-            ARLOGperror(NULL);
-        } else {
-            ok = jpegRead(infile, vid->buffer.buff, vid->bufWidth, vid->bufHeight, vid->format);
-            fclose(infile);
-            if (!ok)
-                return (NULL);
-            vid->buffer.fillFlag  = 1;
-            if (vid->format == AR_PIXEL_FORMAT_MONO) {
-                vid->buffer.buffLuma = vid->buffer.buff;
-            } else {
-                vid->buffer.buffLuma = NULL;
-            }
-            vid->buffer.time.sec  = 0;
-            vid->buffer.time.usec = 0;
-        }
+    if (!imageClockDue(vid)) return (NULL);
 
-        vid->nextImage = vid->nextImage->next; // Next item in linked list.
-        if (!vid->nextImage && vid->loop) vid->nextImage = vid->imageList; // If we've hit the end of the list and looping requested, go back to head of linked list.
+    if (vid->prefetchRunning) {
+        // Take the next decoded image, waiting for it if the worker is behind.
+        // This also releases the previously returned image's slot to the worker.
+        pthread_mutex_lock(&vid->prefetchLock);
+        while (!vid->prefetchCount && !vid->prefetchDone) {
+            pthread_cond_wait(&vid->prefetchCond, &vid->prefetchLock);
+        }
+        if (!vid->prefetchCount) {
+            pthread_mutex_unlock(&vid->prefetchLock);
+            return (NULL);
+        }
+        slot = &vid->prefetchSlots[vid->prefetchHead];
+        vid->prefetchHead = (vid->prefetchHead + 1) % (vid->prefetch + 1);
+        vid->prefetchCount--;
+        pthread_cond_broadcast(&vid->prefetchCond);
+        pthread_mutex_unlock(&vid->prefetchLock);
+        vid->buffer.buff = slot->buff;
+    } else {
+        if (!vid->nextImage) return (NULL);
+        if (!imageDecode(vid, vid->nextImage, vid->imageBuff)) {
+            vid->nextImage = imageNext(vid, vid->nextImage);
+            return (NULL);
+        }
+        vid->nextImage = imageNext(vid, vid->nextImage);
+        vid->buffer.buff = vid->imageBuff;
+    }
 
-        return &(vid->buffer);
+    vid->buffer.fillFlag  = 1;
+    if (vid->format == AR_PIXEL_FORMAT_MONO) {
+        vid->buffer.buffLuma = vid->buffer.buff;
     } else {
-        return (NULL);
+        vid->buffer.buffLuma = NULL;
     }
+    imageClockStamp(vid);
+
+    return &(vid->buffer);
 }
 
 int ar2VideoGetSizeImage(AR2VideoParamImageT *vid, int *x,int *y)
@@ -494,10 +722,14 @@ int ar2VideoSetBufferSizeImage(AR2VideoParamImageT *vid, const int width, const
     int rowBytes;
 
     if (!vid) return (-1);
+    if (vid->prefetchRunning) {
+        ARLOGe("Error: Can't change buffer size while prefetching.\n");
+        return (-1);
+    }
 
-    if (vid->buffer.buff) {
-        free (vid->buffer.buff);
-        vid->buffer.buff = vid->buffer.buffLuma = NULL;
+    if (vid->imageBuff) {
+        free (vid->imageBuff);
+        vid->imageBuff = vid->buffer.buff = vid->buffer.buffLuma = NULL;
     }
 
     if (width && height) {
@@ -506,11 +738,12 @@ int ar2VideoSetBufferSizeImage(AR2VideoParamImageT *vid, const int width, const
             return (-1);
         }
         rowBytes = width * arVideoUtilGetPixelSize(vid->format);
-        vid->buffer.buff = (unsigned char *)malloc(height * rowBytes);
-        if (!vid->buffer.buff) {
+        vid->imageBuff = (unsigned char *)malloc(height * rowBytes);
+        if (!vid->imageBuff) {
             ARLOGe("Error: Out of memory!\n");
             return (-1);
         }
+        vid->buffer.buff = vid->imageBuff;
         vid->buffer.buffLuma = NULL;
     }
 
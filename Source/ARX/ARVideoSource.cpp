@@ -49,6 +49,8 @@
 #endif
 #include <stdlib.h>
 #include <inttypes.h>
+#include <chrono>
+#include <iterator>
 #ifdef _WIN32
 #  define _USE_MATH_DEFINES
 #endif
@@ -72,11 +74,17 @@ ARVideoSource::ARVideoSource() :
     videoHeight(0),
     pixelFormat((AR_PIXEL_FORMAT)(-1)),
     m_captureFrameWaitCount(0),
-    m_frameBuffer(NULL),
+    m_frameSlots{},
+    m_framePlaneSize{0, 0},
+    m_frameLumaSize(0),
+    m_frameLatest(-1),
+    m_frameModuleSlot(-1),
+    m_frameCopy(false),
+    m_frameDropCount(0),
+    m_frameCopyCount(0),
     m_getFrameTextureTime{0, 0},
     m_error(ARX_ERROR_NONE)
 {
-    pthread_rwlock_init(&m_frameBufferLock, NULL);
 }
 
 ARVideoSource::~ARVideoSource()
@@ -98,8 +106,6 @@ ARVideoSource::~ARVideoSource()
         cameraParamBuffer = NULL;
         cameraParamBufferLen = 0;
     }
-
-    pthread_rwlock_destroy(&m_frameBufferLock);
 }
 
 void ARVideoSource::configure(const char* vconf, bool noCpara, const char* cparaName, const char* cparaBuff, size_t cparaBuffLen)
@@ -282,12 +288,104 @@ bool ARVideoSource::open3(const ARParam *cparam_p)
         return false;
     }
 
+    m_frameDropCount = 0;
+    m_frameCopyCount = 0;
     deviceState = DEVICE_RUNNING;
 
     ARLOGd("Video capture started.\n");
     return true;
 }
 
+// Allocates storage for each slot of the frame ring, laid out to match the video module's buffer.
+bool ARVideoSource::frameRingAlloc(const AR2VideoBufferT *vbuff)
+{
+    int bufWidth, bufHeight;
+    size_t *planeSize = m_framePlaneSize;
+    size_t lumaSize, size;
+    int i, planeCount;
+    
+    if (ar2VideoGetBufferSize(m_vid, &bufWidth, &bufHeight) < 0) {
+        bufWidth = videoWidth;
+        bufHeight = videoHeight;
+    }
+    planeCount = (vbuff->bufPlaneCount == 2 ? 2 : 0);
+    if (planeCount) {
+        planeSize[0] = (size_t)bufWidth * bufHeight;
+        planeSize[1] = (size_t)bufWidth * bufHeight / 2;
+    } else {
+        planeSize[0] = (size_t)bufWidth * bufHeight * arUtilGetPixelSize(pixelFormat);
+        planeSize[1] = 0;
+    }
+    // Luma needs its own storage unless it is the first plane of the frame.
+    lumaSize = (vbuff->buffLuma == vbuff->buff ? 0 : (size_t)videoWidth * videoHeight);
+    m_frameLumaSize = lumaSize;
+    size = planeSize[0] + planeSize[1] + lumaSize;
+    
+    for (i = 0; i < ARVIDEOSOURCE_FRAME_SLOTS; i++) {
+        FrameSlot *slot = &m_frameSlots[i];
+        slot->storage = (ARUint8 *)malloc(size);
+        if (!slot->storage) {
+            ARLOGe("Out of memory!!\n");
+            frameRingFree();
+            return false;
+        }
+        memset(&slot->buffer, 0, sizeof(slot->buffer));
+        if (planeCount) {
+            slot->planes[0] = slot->storage;
+            slot->planes[1] = slot->storage + planeSize[0];
+            slot->buffer.bufPlanes = slot->planes;
+            slot->buffer.bufPlaneCount = 2;
+        }
+        slot->buffer.buff = slot->storage;
+        slot->buffer.buffLuma = (lumaSize ? slot->storage + planeSize[0] + planeSize[1] : slot->storage);
+        slot->refCount = 0;
+        slot->consumed = false;
+    }
+    m_frameLatest = -1;
+    m_frameModuleSlot = -1;
+    m_frameCopy = false;
+    return true;
+}
+
+void ARVideoSource::frameRingFree()
+{
+    int i;
+    
+    for (i = 0; i < ARVIDEOSOURCE_FRAME_SLOTS; i++) {
+        free(m_frameSlots[i].storage);
+        m_frameSlots[i].storage = NULL;
+        m_frameSlots[i].refCount = 0;
+    }
+    m_frameLatest = -1;
+    m_frameModuleSlot = -1;
+}
+
+// Copies a frame into the slot's own storage, and points the slot's buffer at it. Doesn't set fillFlag.
+void ARVideoSource::frameSlotCopy(FrameSlot *slot, const AR2VideoBufferT *vbuff)
+{
+    const AR2VideoBufferT src = *vbuff; // vbuff may be the slot's own buffer.
+    
+    if (src.bufPlaneCount == 2) {
+        memcpy(slot->planes[0], src.bufPlanes[0], m_framePlaneSize[0]);
+        memcpy(slot->planes[1], src.bufPlanes[1], m_framePlaneSize[1]);
+        slot->buffer.bufPlanes = slot->planes;
+        slot->buffer.bufPlaneCount = 2;
+    } else {
+        memcpy(slot->storage, src.buff, m_framePlaneSize[0]);
+        slot->buffer.bufPlanes = NULL;
+        slot->buffer.bufPlaneCount = 0;
+    }
+    slot->buffer.buff = slot->storage;
+    if (m_frameLumaSize) {
+        slot->buffer.buffLuma = slot->storage + m_framePlaneSize[0] + m_framePlaneSize[1];
+        memcpy(slot->buffer.buffLuma, src.buffLuma, m_frameLumaSize);
+    } else {
+        slot->buffer.buffLuma = slot->storage;
+    }
+    slot->buffer.time = src.time;
+    m_frameCopyCount++;
+}
+
 bool ARVideoSource::captureFrame()
 {
     if (deviceState == DEVICE_RUNNING) {
@@ -295,13 +393,78 @@ bool ARVideoSource::captureFrame()
             ARLOGi("Video source is running. (Waited %d calls.)\n", m_captureFrameWaitCount);
             m_captureFrameWaitCount = 0;
         }
-        pthread_rwlock_wrlock(&m_frameBufferLock);
+        // The video module may reuse the buffer holding its last frame on the next ar2VideoGetImage(), so first
+        // release the slot referencing that buffer, or, if the frame is still wanted, move it into slot storage.
+        if (m_frameModuleSlot != -1) {
+            std::lock_guard<std::mutex> lock(m_frameRingLock);
+            FrameSlot *slot = &m_frameSlots[m_frameModuleSlot];
+            if (slot->refCount != 0) {
+                // A reader is using the module's buffer, so leave the next frame in the module until it is checked in.
+                // Readers are holding frames across captures, so copy frames from now on.
+                m_frameCopy = true;
+                return false;
+            }
+            if (m_frameModuleSlot == m_frameLatest && !slot->consumed) {
+                // Not read yet. No reader holds the slot, and none can check it out while the lock is held.
+                frameSlotCopy(slot, &slot->buffer);
+            } else {
+                slot->buffer.fillFlag = 0;
+                if (m_frameModuleSlot == m_frameLatest) m_frameLatest = -1;
+            }
+            m_frameModuleSlot = -1;
+        }
+        
+        // Only this function touches the video module's buffer, so no lock is needed to fetch it.
         AR2VideoBufferT *vbuff = ar2VideoGetImage(m_vid);
-        pthread_rwlock_unlock(&m_frameBufferLock);
-        if (vbuff && vbuff->fillFlag) {
-            m_frameBuffer = vbuff;
-            return true;
+        if (!vbuff || !vbuff->fillFlag) return false;
+        
+        if (!m_frameSlots[0].storage) {
+            if (!frameRingAlloc(vbuff)) return false;
+        }
+        
+        // Find a slot which is neither checked out nor holding the latest frame.
+        // Of those, overwrite the oldest, so that earlier frames remain available to checkoutFrameNearest().
+        int i, j;
+        {
+            std::lock_guard<std::mutex> lock(m_frameRingLock);
+            i = -1;
+            for (j = 0; j < ARVIDEOSOURCE_FRAME_SLOTS; j++) {
+                if (j == m_frameLatest || m_frameSlots[j].refCount != 0) continue;
+                if (!m_frameSlots[j].buffer.fillFlag) { // Never filled, or released.
+                    i = j;
+                    break;
+                }
+                if (i == -1 || timeDiff(m_frameSlots[j].buffer.time, m_frameSlots[i].buffer.time) < 0) i = j;
+            }
+            if (i == -1) {
+                m_frameDropCount++;
+                ARLOGd("ARVideoSource::captureFrame(): all frame slots in use, dropping frame.\n");
+                return false;
+            }
+            // Once no frame is held across a capture, go back to referencing the module's buffer.
+            if (m_frameCheckouts.empty()) m_frameCopy = false;
+            FrameSlot *slot = &m_frameSlots[i];
+            if (!m_frameCopy) {
+                slot->buffer = *vbuff;
+                slot->consumed = false;
+                m_frameLatest = i;
+                m_frameModuleSlot = i;
+                return true;
+            }
+            slot->refCount = 1; // Reserve the slot while it is filled.
+            slot->buffer.fillFlag = 0;
+        }
+        
+        FrameSlot *slot = &m_frameSlots[i];
+        frameSlotCopy(slot, vbuff);
+        {
+            std::lock_guard<std::mutex> lock(m_frameRingLock);
+            slot->buffer.fillFlag = vbuff->fillFlag;
+            slot->consumed = false;
+            slot->refCount = 0;
+            m_frameLatest = i;
         }
+        return true;
     } else {
         if (!m_captureFrameWaitCount) {
             ARLOGi("Waiting for video source.\n");
@@ -323,10 +486,29 @@ bool ARVideoSource::close()
     if (deviceState == DEVICE_RUNNING) {
         ARLOGd("ARVideoSource::close(): stopping video.\n");
 
-        pthread_rwlock_wrlock(&m_frameBufferLock);
+        {
+            // Wait for readers to check their frames back in before stopping the video module, which may free
+            // buffers that frames reference, and before freeing the frame ring.
+            std::unique_lock<std::mutex> lock(m_frameRingLock);
+            std::thread::id tid = std::this_thread::get_id();
+            std::vector<std::pair<std::thread::id, int> >::const_iterator it;
+            for (it = m_frameCheckouts.begin(); it != m_frameCheckouts.end(); ++it) {
+                if (it->first == tid) {
+                    ARLOGe("ARVideoSource::close(): error: called with a frame checked out on the calling thread.\n");
+                    break;
+                }
+            }
+            if (!m_frameRingCond.wait_for(lock, std::chrono::milliseconds(ARVIDEOSOURCE_CLOSE_CHECKIN_TIMEOUT_MS), [this]{ return m_frameCheckouts.empty(); })) {
+                ARLOGe("ARVideoSource::close(): error: %d frame(s) still checked out after %d ms; closing anyway.\n", (int)m_frameCheckouts.size(), ARVIDEOSOURCE_CLOSE_CHECKIN_TIMEOUT_MS);
+                // Don't free storage still in use. It is leaked, and late checkins are reported as errors.
+                for (int i = 0; i < ARVIDEOSOURCE_FRAME_SLOTS; i++) {
+                    if (m_frameSlots[i].refCount != 0) m_frameSlots[i].storage = NULL;
+                }
+                m_frameCheckouts.clear();
+            }
+            frameRingFree();
+        }
         int err = ar2VideoCapStop(m_vid);
-        m_frameBuffer = NULL;
-        pthread_rwlock_unlock(&m_frameBufferLock);
         if (err != 0)
             ARLOGe("Error \"%d\" stopping video.\n", err);
 
@@ -393,20 +575,105 @@ AR_PIXEL_FORMAT ARVideoSource::getPixelFormat() const
 
 AR2VideoBufferT* ARVideoSource::checkoutFrameIfNewerThan(const AR2VideoTimestampT time)
 {
-    pthread_rwlock_rdlock(&m_frameBufferLock);
-    if (m_frameBuffer) {
-        //ARLOGd("ARVideoSource::checkoutFrameIfNewerThan(%" PRIu64 ", %" PRIu32 ") frame is available with time (%" PRIu64 ", %" PRIu32 ").\n", time.sec, time.usec, m_frameBuffer->time.sec, m_frameBuffer->time.usec);
-        if  (m_frameBuffer->time.sec > time.sec || (m_frameBuffer->time.sec == time.sec && m_frameBuffer->time.usec > time.usec)) {
-            return m_frameBuffer;
+    std::lock_guard<std::mutex> lock(m_frameRingLock);
+    if (m_frameLatest >= 0) {
+        FrameSlot *slot = &m_frameSlots[m_frameLatest];
+        //ARLOGd("ARVideoSource::checkoutFrameIfNewerThan(%" PRIu64 ", %" PRIu32 ") frame is available with time (%" PRIu64 ", %" PRIu32 ").\n", time.sec, time.usec, slot->buffer.time.sec, slot->buffer.time.usec);
+        if  (slot->buffer.time.sec > time.sec || (slot->buffer.time.sec == time.sec && slot->buffer.time.usec > time.usec)) {
+            slot->refCount++;
+            slot->consumed = true;
+            m_frameCheckouts.push_back(std::make_pair(std::this_thread::get_id(), m_frameLatest));
+            return &slot->buffer;
         }
     }
-    pthread_rwlock_unlock(&m_frameBufferLock);
     return NULL;
 }
 
+AR2VideoBufferT* ARVideoSource::checkoutFrameNearest(const AR2VideoTimestampT time, const AR2VideoTimestampT newerThan)
+{
+    std::lock_guard<std::mutex> lock(m_frameRingLock);
+    int i, nearest = -1;
+    int64_t dt, dtNearest = 0;
+    for (i = 0; i < ARVIDEOSOURCE_FRAME_SLOTS; i++) {
+        FrameSlot *slot = &m_frameSlots[i];
+        if (!slot->buffer.fillFlag) continue; // Empty, or being filled.
+        if (slot->buffer.time.sec < newerThan.sec || (slot->buffer.time.sec == newerThan.sec && slot->buffer.time.usec <= newerThan.usec)) continue;
+        dt = llabs(timeDiff(slot->buffer.time, time));
+        if (nearest == -1 || dt < dtNearest || (dt == dtNearest && timeDiff(slot->buffer.time, m_frameSlots[nearest].buffer.time) > 0)) {
+            nearest = i;
+            dtNearest = dt;
+        }
+    }
+    if (nearest == -1) return NULL;
+    m_frameSlots[nearest].refCount++;
+    m_frameSlots[nearest].consumed = true;
+    m_frameCheckouts.push_back(std::make_pair(std::this_thread::get_id(), nearest));
+    return &m_frameSlots[nearest].buffer;
+}
+
+void ARVideoSource::checkinFrame(AR2VideoBufferT *frame)
+{
+    if (!frame) return;
+    
+    std::lock_guard<std::mutex> lock(m_frameRingLock);
+    std::thread::id tid = std::this_thread::get_id();
+    int i;
+    for (i = 0; i < ARVIDEOSOURCE_FRAME_SLOTS; i++) {
+        if (&m_frameSlots[i].buffer == frame) break;
+    }
+    if (i == ARVIDEOSOURCE_FRAME_SLOTS || m_frameSlots[i].refCount <= 0) {
+        ARLOGe("ARVideoSource::checkinFrame(): frame was not checked out.\n");
+        return;
+    }
+    // Prefer this thread's checkout of the frame, but allow a frame to be checked in from any thread.
+    std::vector<std::pair<std::thread::id, int> >::reverse_iterator it, match = m_frameCheckouts.rend();
+    for (it = m_frameCheckouts.rbegin(); it != m_frameCheckouts.rend(); ++it) {
+        if (it->second != i) continue;
+        if (match == m_frameCheckouts.rend()) match = it;
+        if (it->first == tid) {
+            match = it;
+            break;
+        }
+    }
+    if (match != m_frameCheckouts.rend()) m_frameCheckouts.erase(std::next(match).base());
+    m_frameSlots[i].refCount--;
+    if (m_frameCheckouts.empty()) m_frameRingCond.notify_all();
+}
+
 void ARVideoSource::checkinFrame(void)
 {
-    pthread_rwlock_unlock(&m_frameBufferLock);
+    AR2VideoBufferT *frame = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_frameRingLock);
+        std::thread::id tid = std::this_thread::get_id();
+        std::vector<std::pair<std::thread::id, int> >::reverse_iterator it;
+        for (it = m_frameCheckouts.rbegin(); it != m_frameCheckouts.rend(); ++it) {
+            if (it->first == tid) {
+                frame = &m_frameSlots[it->second].buffer;
+                break;
+            }
+        }
+    }
+    if (!frame) {
+        ARLOGe("ARVideoSource::checkinFrame(): no frame checked out on this thread.\n");
+        return;
+    }
+    checkinFrame(frame);
+}
+
+int64_t ARVideoSource::timeDiff(const AR2VideoTimestampT& a, const AR2VideoTimestampT& b)
+{
+    return ((int64_t)a.sec - (int64_t)b.sec)*1000000ll + ((int64_t)a.usec - (int64_t)b.usec);
+}
+
+int ARVideoSource::getDroppedFrameCount(void) const
+{
+    return m_frameDropCount;
+}
+
+int ARVideoSource::getCopiedFrameCount(void) const
+{
+    return m_frameCopyCount;
 }
 
 AR2VideoParamT *ARVideoSource::getAR2VideoParam(void)
@@ -423,7 +690,7 @@ bool ARVideoSource::getFrameTextureRGBA32(uint32_t *buffer) {
     m_getFrameTextureTime = buff->time;
 
     int ret = videoRGBA(buffer, buff, videoWidth, videoHeight, pixelFormat);
-    checkinFrame();
+    checkinFrame(buff);
     if (ret < 0) {
         ARLOGe("ARVideoSource::getFrameTextureRGBA32: videoRGBA error.\n");
         return false;
@@ -278,7 +278,7 @@ void ARVideoView::draw(ARVideoSource* vs)
                 ARLOGe("arglPixelBufferDataUpload.\n");
             }
         }
-        vs->checkinFrame();
+        vs->checkinFrame(frame);
     } else {
         ARLOGd("ARVideoView::draw frame=NULL.\n");
     }
@@ -327,6 +327,14 @@ void arwSetTrackerOptionBool(int option, bool value)
 #endif
     } else if (option == ARW_TRACKER_OPTION_SQUARE_DEBUG_MODE) {
         gARTK->getSquareTracker()->setDebugMode(value);
+    } else if (option == ARW_TRACKER_OPTION_SQUARE_STEREO_PARALLEL_DETECTION) {
+        gARTK->getSquareTracker()->setStereoParallelDetection(value);
+    } else if (option == ARW_TRACKER_OPTION_NFT_LATENCY_COMPENSATION) {
+#if HAVE_NFT
+        gARTK->getNFTTracker()->setNFTLatencyCompensation(value);
+#else
+        return;
+#endif
     }
 }
 
@@ -383,6 +391,14 @@ bool arwGetTrackerOptionBool(int option)
 #endif
     } else if (option == ARW_TRACKER_OPTION_SQUARE_DEBUG_MODE) {
         return gARTK->getSquareTracker()->debugMode();
+    } else if (option == ARW_TRACKER_OPTION_SQUARE_STEREO_PARALLEL_DETECTION) {
+        return gARTK->getSquareTracker()->stereoParallelDetection();
+    } else if (option == ARW_TRACKER_OPTION_NFT_LATENCY_COMPENSATION) {
+#if HAVE_NFT
+        return gARTK->getNFTTracker()->NFTLatencyCompensation();
+#else
+        return false;
+#endif
     }
     return false;
 }
@@ -223,6 +223,20 @@ KPM_EXTERN int         kpmDeleteHandle( KpmHandle **kpmHandle );
 
 KPM_EXTERN int         kpmHandleGetXSize(const KpmHandle *kpmHandle);
 KPM_EXTERN int         kpmHandleGetYSize(const KpmHandle *kpmHandle);
+
+/*!
+    @brief Change the camera parameters used by a KPM handle created with kpmCreateHandle().
+    @details
+        Allows one KpmHandle (and its reference data) to be used with frames from more than one
+        camera, e.g. either camera of a stereo pair. Must not be called while kpmMatching() is in progress.
+    @param kpmHandle Handle created with kpmCreateHandle().
+    @param cparamLT Pointer to an ARParamLT structure holding camera parameters in lookup-table form.
+        As for kpmCreateHandle(), the pointer only is copied. The frame size must be the same as
+        that of the camera parameters the handle was created with.
+    @result 0 if successful, or value &lt;0 in case of error.
+    @see kpmCreateHandle kpmCreateHandle
+ */
+KPM_EXTERN int         kpmHandleSetCameraParam(KpmHandle *kpmHandle, ARParamLT *cparamLT);
     
 KPM_EXTERN int         kpmSetProcMode( KpmHandle *kpmHandle, KPM_PROC_MODE  procMode );
 KPM_EXTERN int         kpmGetProcMode( KpmHandle *kpmHandle, KPM_PROC_MODE *procMode );
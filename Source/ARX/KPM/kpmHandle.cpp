@@ -147,6 +147,15 @@ int kpmHandleGetYSize(const KpmHandle *kpmHandle)
     return kpmHandle->ysize;
 }
 
+int kpmHandleSetCameraParam(KpmHandle *kpmHandle, ARParamLT *cparamLT)
+{
+    if (!kpmHandle || !cparamLT) return -1;
+    if (kpmHandle->poseMode != KpmPose6DOF) return -1;
+    if (cparamLT->param.xsize != kpmHandle->xsize || cparamLT->param.ysize != kpmHandle->ysize) return -1;
+    kpmHandle->cparamLT = cparamLT;
+    return 0;
+}
+
 int kpmSetProcMode( KpmHandle *kpmHandle,  KPM_PROC_MODE mode )
 {
 #if !BINARY_FEATURE
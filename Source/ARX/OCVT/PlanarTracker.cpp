@@ -49,6 +49,9 @@
 #include <opencv2/video.hpp>
 #include <opencv2/highgui.hpp>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 class PlanarTracker::PlanarTrackerImpl
 {
@@ -67,6 +70,31 @@ private:
     cv::Mat _K;
     
     int _selectedFeatureDetectorType;
+    
+    // Feature detection and matching for one frame, done on the detection thread while later frames are tracked.
+    struct DetectionJob {
+        cv::Mat frame;                      // Copy of the frame.
+        AR2VideoTimestampT frameTime;       // Capture time of the frame.
+        cv::Mat featureMask;                // Excludes trackables already detected when the job was started.
+        std::vector<int> candidates;        // Indices of trackables not detected when the job was started.
+        int index;                          // Result: the trackable detected, or -1.
+        cv::Mat homography;                 // Result: homography from the trackable to the frame.
+        std::vector<cv::Mat> pyramid;       // Result: pyramid of the frame, if a trackable was detected.
+    };
+    enum DetectionState {
+        DETECTION_IDLE,
+        DETECTION_PENDING,                  // Job started and not yet finished.
+        DETECTION_DONE                      // Job finished and not yet collected.
+    };
+    bool _detectionThreaded;
+    std::thread _detectionThread;
+    std::mutex _detectionLock;              // Protects _detectionState and _detectionQuit.
+    std::condition_variable _detectionCond;
+    DetectionState _detectionState;
+    bool _detectionQuit;
+    DetectionJob _detectionJob;             // Owned by the detection thread while DETECTION_PENDING.
+    std::vector<cv::Mat> _seedPyramid;      // Pyramid of the frame in which a trackable was last detected on the detection thread.
+    
 public:
     PlanarTrackerImpl()
     {
@@ -79,6 +107,21 @@ public:
         _frameSizeX = 0;
         _frameSizeY = 0;
         _K = cv::Mat();
+        _detectionThreaded = false;
+        _detectionState = DETECTION_IDLE;
+        _detectionQuit = false;
+    }
+    
+    ~PlanarTrackerImpl()
+    {
+        if (_detectionThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(_detectionLock);
+                _detectionQuit = true;
+            }
+            _detectionCond.notify_all();
+            _detectionThread.join();
+        }
     }
     
     void Initialise(int xFrameSize, int yFrameSize, ARdouble cParam[][4])
@@ -93,14 +136,14 @@ public:
         }
     }
     
-    cv::Mat CreateFeatureMask(cv::Mat frame)
+    cv::Mat CreateFeatureMask(cv::Size size)
     {
         cv::Mat featureMask;
         for(int i=0;i<_trackables.size(); i++) {
             if(_trackables[i]._isDetected) {
                 if(featureMask.empty()) {
                     //Only create mask if we have something to draw in it.
-                    featureMask = cv::Mat::ones(frame.size(), CV_8UC1);
+                    featureMask = cv::Mat::ones(size, CV_8UC1);
                 }
                 std::vector<std::vector<cv::Point> > contours(1);
                 for(int j=0; j<4; j++) {
@@ -122,37 +165,49 @@ public:
         return (detectedFeaturesSize>minRequiredDetectedFeatures);
     }
     
-    void MatchFeatures(std::vector<cv::KeyPoint> newFrameFeatures, cv::Mat newFrameDescriptors)
+    std::vector<int> UndetectedTrackables()
+    {
+        std::vector<int> candidates;
+        for(int i=0;i<_trackables.size(); i++) {
+            if(!_trackables[i]._isDetected) {
+                candidates.push_back(i);
+            }
+        }
+        return candidates;
+    }
+    
+    // Find the candidate trackable with the most features matching the frame's, and its homography to the frame.
+    // Reads only trackable data which is fixed once the trackable is added, so may run on the detection thread.
+    int FindBestMatch(std::vector<cv::KeyPoint> newFrameFeatures, cv::Mat newFrameDescriptors, const std::vector<int>& candidates, cv::Mat& homography)
     {
         int maxMatches = 0;
         int bestMatchIndex = -1;
         std::vector<cv::KeyPoint> finalMatched1, finalMatched2;
-        for(int i=0;i<_trackables.size(); i++) {
-            if(!_trackables[i]._isDetected) {
-                std::vector< std::vector<cv::DMatch> >  matches = _featureDetector.MatchFeatures(newFrameDescriptors, _trackables[i]._descriptors);
-                if(matches.size()>minRequiredDetectedFeatures) {
-                    std::vector<cv::KeyPoint> matched1, matched2;
-                    std::vector<uchar> status;
-                    int totalGoodMatches = 0;
-                    for(unsigned int j = 0; j < matches.size(); j++) {
-                        //Ratio Test for outlier removal, removes ambiguous matches.
-                        if(matches[j][0].distance < nn_match_ratio * matches[j][1].distance) {
-                            matched1.push_back(newFrameFeatures[matches[j][0].queryIdx]);
-                            matched2.push_back(_trackables[i]._featurePoints[matches[j][0].trainIdx]);
-                            status.push_back(1);
-                            totalGoodMatches++;
-                        }
-                        else {
-                            status.push_back(0);
-                        }
+        for(int c=0;c<candidates.size(); c++) {
+            int i = candidates[c];
+            std::vector< std::vector<cv::DMatch> >  matches = _featureDetector.MatchFeatures(newFrameDescriptors, _trackables[i]._descriptors);
+            if(matches.size()>minRequiredDetectedFeatures) {
+                std::vector<cv::KeyPoint> matched1, matched2;
+                std::vector<uchar> status;
+                int totalGoodMatches = 0;
+                for(unsigned int j = 0; j < matches.size(); j++) {
+                    //Ratio Test for outlier removal, removes ambiguous matches.
+                    if(matches[j][0].distance < nn_match_ratio * matches[j][1].distance) {
+                        matched1.push_back(newFrameFeatures[matches[j][0].queryIdx]);
+                        matched2.push_back(_trackables[i]._featurePoints[matches[j][0].trainIdx]);
+                        status.push_back(1);
+                        totalGoodMatches++;
                     }
-                    if(totalGoodMatches>maxMatches) {
-                        finalMatched1 = matched1;
-                        finalMatched2 = matched2;
-                        maxMatches = totalGoodMatches;
-                        bestMatchIndex = i;
+                    else {
+                        status.push_back(0);
                     }
                 }
+                if(totalGoodMatches>maxMatches) {
+                    finalMatched1 = matched1;
+                    finalMatched2 = matched2;
+                    maxMatches = totalGoodMatches;
+                    bestMatchIndex = i;
+                }
             }
         }
         
@@ -164,16 +219,115 @@ public:
             
             HomographyInfo homoInfo = GetHomographyInliers(Points(finalMatched2), Points(finalMatched1));
             if(homoInfo.validHomography) {
-                //std::cout << "New marker detected" << std::endl;
-                _trackables[bestMatchIndex]._trackSelection.SelectPoints();
-                _trackables[bestMatchIndex]._trackSelection.SetHomography(homoInfo.homography);
-                _trackables[bestMatchIndex]._isDetected = true;
-                _trackables[bestMatchIndex]._resetTracks = true;
-                
-                perspectiveTransform(_trackables[bestMatchIndex]._bBox, _trackables[bestMatchIndex]._bBoxTransformed, homoInfo.homography);
-                _currentlyTrackedMarkers++;
+                homography = homoInfo.homography;
+                return bestMatchIndex;
             }
         }
+        return -1;
+    }
+    
+    // Detect features in the frame outside the mask (which is at the detection pyramid level), and match them.
+    int DetectAndMatch(cv::Mat frame, cv::Mat featureMask, const std::vector<int>& candidates, cv::Mat& homography)
+    {
+        cv::Mat detectionFrame;
+        cv::pyrDown(frame, detectionFrame, cv::Size(frame.cols/featureDetectPyramidLevel, frame.rows/featureDetectPyramidLevel));
+        std::vector<cv::KeyPoint> newFrameFeatures = _featureDetector.DetectFeatures(detectionFrame, featureMask);
+        
+        if(CanMatchNewFeatures(static_cast<int>(newFrameFeatures.size()))) {
+            //std::cout << "Matching new features" << std::endl;
+            cv::Mat newFrameDescriptors = _featureDetector.CalcDescriptors(detectionFrame, newFrameFeatures);
+            return FindBestMatch(newFrameFeatures, newFrameDescriptors, candidates, homography);
+        }
+        return -1;
+    }
+    
+    void AdoptDetection(int trackableIndex, cv::Mat homography, const AR2VideoTimestampT& frameTime)
+    {
+        //std::cout << "New marker detected" << std::endl;
+        _trackables[trackableIndex]._trackSelection.SelectPoints();
+        _trackables[trackableIndex]._trackSelection.SetHomography(homography);
+        _trackables[trackableIndex]._isDetected = true;
+        _trackables[trackableIndex]._resetTracks = true;
+        _trackables[trackableIndex]._detectionTime = frameTime;
+        
+        perspectiveTransform(_trackables[trackableIndex]._bBox, _trackables[trackableIndex]._bBoxTransformed, homography);
+        _currentlyTrackedMarkers++;
+    }
+    
+    void DetectionWorker()
+    {
+        std::unique_lock<std::mutex> lock(_detectionLock);
+        while (true) {
+            _detectionCond.wait(lock, [this]{ return _detectionQuit || _detectionState == DETECTION_PENDING; });
+            if (_detectionQuit) break;
+            lock.unlock();
+            
+            DetectionJob& job = _detectionJob;
+            job.index = DetectAndMatch(job.frame, job.featureMask, job.candidates, job.homography);
+            if (job.index >= 0) {
+                cv::buildOpticalFlowPyramid(job.frame, job.pyramid, winSize, maxLevel);
+            }
+            
+            lock.lock();
+            _detectionState = DETECTION_DONE;
+            _detectionCond.notify_all();
+        }
+    }
+    
+    void StartDetection(cv::Mat frame, const AR2VideoTimestampT& frameTime)
+    {
+        if (!_detectionThread.joinable()) {
+            _detectionThread = std::thread(&PlanarTrackerImpl::DetectionWorker, this);
+        }
+        // The caller may reuse the frame buffer, so the job works on a copy.
+        frame.copyTo(_detectionJob.frame);
+        _detectionJob.frameTime = frameTime;
+        _detectionJob.featureMask = CreateFeatureMask(cv::Size(frame.cols/featureDetectPyramidLevel, frame.rows/featureDetectPyramidLevel));
+        _detectionJob.candidates = UndetectedTrackables();
+        _detectionJob.index = -1;
+        {
+            std::lock_guard<std::mutex> lock(_detectionLock);
+            _detectionState = DETECTION_PENDING;
+        }
+        _detectionCond.notify_all();
+    }
+    
+    // If the detection thread has finished, take its result. Returns false if it is still busy.
+    bool CollectDetection()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_detectionLock);
+            if (_detectionState == DETECTION_PENDING) return false;
+            if (_detectionState == DETECTION_IDLE) return true;
+            _detectionState = DETECTION_IDLE;
+        }
+        int i = _detectionJob.index;
+        if ((i >= 0) && !_trackables[i]._isDetected) {
+            AdoptDetection(i, _detectionJob.homography, _detectionJob.frameTime);
+            // The homography is for the detection frame, so tracking is seeded from that frame's pyramid.
+            _trackables[i]._seedFromDetection = true;
+            _seedPyramid.swap(_detectionJob.pyramid);
+        }
+        return true;
+    }
+    
+    // Wait for the detection thread to finish and discard its result, before trackables are changed.
+    void CancelDetection()
+    {
+        std::unique_lock<std::mutex> lock(_detectionLock);
+        _detectionCond.wait(lock, [this]{ return _detectionState != DETECTION_PENDING; });
+        _detectionState = DETECTION_IDLE;
+    }
+    
+    void SetDetectionThreaded(bool on)
+    {
+        if (!on) CancelDetection();
+        _detectionThreaded = on;
+    }
+    
+    bool DetectionThreaded()
+    {
+        return _detectionThreaded;
     }
     
     std::vector<cv::Point2f> SelectTrackablePoints(int trackableIndex)
@@ -188,13 +342,13 @@ public:
         }
     }
     
-    void RunOpticalFlow(int trackableId, std::vector<cv::Point2f> trackablePoints, std::vector<cv::Point2f> trackablePointsWarped)
+    void RunOpticalFlow(int trackableId, std::vector<cv::Point2f> trackablePoints, std::vector<cv::Point2f> trackablePointsWarped, const std::vector<cv::Mat>& prevPyramid)
     {
         std::vector<cv::Point2f> flowResultPoints, trackablePointsWarpedResult;
         std::vector<uchar> statusFirstPass, statusSecondPass;
         std::vector<float> err;
-        cv::calcOpticalFlowPyrLK(_prevPyramid, _pyramid, trackablePointsWarped, flowResultPoints, statusFirstPass, err, winSize, 3, termcrit, 0, 0.001);
-        cv::calcOpticalFlowPyrLK(_pyramid, _prevPyramid, flowResultPoints, trackablePointsWarpedResult, statusSecondPass, err, winSize, 3, termcrit, 0, 0.001);
+        cv::calcOpticalFlowPyrLK(prevPyramid, _pyramid, trackablePointsWarped, flowResultPoints, statusFirstPass, err, winSize, 3, termcrit, 0, 0.001);
+        cv::calcOpticalFlowPyrLK(_pyramid, prevPyramid, flowResultPoints, trackablePointsWarpedResult, statusSecondPass, err, winSize, 3, termcrit, 0, 0.001);
         
         int killed1 =0;
         std::vector<cv::Point2f> filteredTrackablePoints, filteredTrackedPoints;
@@ -406,29 +560,29 @@ public:
         _pyramid.swap(_prevPyramid);
     }
     
-    void ProcessFrameData(unsigned char * frame)
+    void ProcessFrameData(unsigned char * frame, const AR2VideoTimestampT& frameTime)
     {
         cv::Mat newFrame(_frameSizeY, _frameSizeX, CV_8UC1, frame);
-        ProcessFrame(newFrame);
+        ProcessFrame(newFrame, frameTime);
         newFrame.release();
     }
     
-    void ProcessFrame(cv::Mat frame)
+    void ProcessFrame(cv::Mat frame, const AR2VideoTimestampT& frameTime)
     {
         //std::cout << "Building pyramid" << std::endl;
         BuildImagePyramid(frame);
-        //std::cout << "Drawing detected markers to mask" << std::endl;
-        if(CanDetectNewFeatures()) {
+        if(_detectionThreaded) {
+            // Detection runs on the detection thread, one frame at a time, while tracking continues here.
+            if(CollectDetection() && CanDetectNewFeatures()) {
+                StartDetection(frame, frameTime);
+            }
+        }
+        else if(CanDetectNewFeatures()) {
             //std::cout << "Detecting new features" << std::endl;
-            cv::Mat detectionFrame;
-            cv::pyrDown(frame, detectionFrame, cv::Size(frame.cols/featureDetectPyramidLevel, frame.rows/featureDetectPyramidLevel));
-            cv::Mat featureMask = CreateFeatureMask(detectionFrame);
-            std::vector<cv::KeyPoint> newFrameFeatures = _featureDetector.DetectFeatures(detectionFrame, featureMask);
-            
-            if(CanMatchNewFeatures(static_cast<int>(newFrameFeatures.size()))) {
-                //std::cout << "Matching new features" << std::endl;
-                cv::Mat newFrameDescriptors = _featureDetector.CalcDescriptors(detectionFrame, newFrameFeatures);
-                MatchFeatures(newFrameFeatures, newFrameDescriptors);
+            cv::Mat homography;
+            int i = DetectAndMatch(frame, CreateFeatureMask(cv::Size(frame.cols/featureDetectPyramidLevel, frame.rows/featureDetectPyramidLevel)), UndetectedTrackables(), homography);
+            if(i>=0) {
+                AdoptDetection(i, homography, frameTime);
             }
         }
         if(_frameCount>0)
@@ -440,7 +594,14 @@ public:
                         std::vector<cv::Point2f> trackablePoints = SelectTrackablePoints(i);
                         std::vector<cv::Point2f> trackablePointsWarped = _trackables[i]._trackSelection.GetSelectedFeaturesWarped();
                         //std::cout << "Starting Optical Flow" << std::endl;
-                        RunOpticalFlow(i, trackablePoints, trackablePointsWarped);
+                        if(_trackables[i]._seedFromDetection) {
+                            // Detected in an earlier frame, so follow the points from that frame to this one.
+                            RunOpticalFlow(i, trackablePoints, trackablePointsWarped, _seedPyramid);
+                            _trackables[i]._seedFromDetection = false;
+                        }
+                        else {
+                            RunOpticalFlow(i, trackablePoints, trackablePointsWarped, _prevPyramid);
+                        }
                         if(_trackables[i]._isTracking) {
                             //Refine optical flow with template match.
                             RunTemplateMatching(frame, i);
@@ -464,6 +625,7 @@ public:
     
     void RemoveAllMarkers()
     {
+        CancelDetection();
         for(int i=0;i<_trackables.size(); i++) {
             _trackables[i].CleanUp();
         }
@@ -515,6 +677,7 @@ public:
         if(fs.isOpened())
         {
             try {
+                CancelDetection();
                 int numberOfTrackables = (int) fs["totalTrackables"];
                 int featureType = defaultDetectorType;
                 fs["featureType"] >> featureType;
@@ -538,6 +701,7 @@ public:
                     newTrackable._isTracking = false;
                     newTrackable._isDetected = false;
                     newTrackable._resetTracks = false;
+                    newTrackable._seedFromDetection = false;
                     newTrackable._trackSelection = TrackingPointSelector(newTrackable._cornerPoints, newTrackable._width, newTrackable._height, markerTemplateWidth);
                     _trackables.push_back(newTrackable);
                 }
@@ -556,6 +720,7 @@ public:
     
     void AddMarker(unsigned char* buff, std::string fileName, int width, int height, int uid, float scale)
     {
+        CancelDetection();
         TrackableInfo newTrackable;
         newTrackable._image = cv::Mat(height, width, CV_8UC1, buff);
         if(!newTrackable._image.empty()) {
@@ -574,6 +739,7 @@ public:
             newTrackable._isTracking = false;
             newTrackable._isDetected = false;
             newTrackable._resetTracks = false;
+            newTrackable._seedFromDetection = false;
             newTrackable._trackSelection = TrackingPointSelector(newTrackable._cornerPoints, newTrackable._width, newTrackable._height, markerTemplateWidth);
             
             _trackables.push_back(newTrackable);
@@ -583,6 +749,7 @@ public:
     
     void AddMarker(std::string imageName, int uid, float scale)
     {
+        CancelDetection();
         TrackableInfo newTrackable;
         newTrackable._image = cv::imread(imageName, 0);
         if(!newTrackable._image.empty()) {
@@ -601,6 +768,7 @@ public:
             newTrackable._isTracking = false;
             newTrackable._isDetected = false;
             newTrackable._resetTracks = false;
+            newTrackable._seedFromDetection = false;
             newTrackable._trackSelection = TrackingPointSelector(newTrackable._cornerPoints, newTrackable._width, newTrackable._height, markerTemplateWidth);
             
             _trackables.push_back(newTrackable);
@@ -622,6 +790,20 @@ public:
         return NULL;
     }
     
+    bool GetTrackableDetectionTime(int trackableId, AR2VideoTimestampT *frameTime)
+    {
+        for(int i=0;i<_trackables.size(); i++) {
+            if(_trackables[i]._id==trackableId) {
+                if(!_trackables[i]._isDetected) {
+                    return false;
+                }
+                *frameTime = _trackables[i]._detectionTime;
+                return true;
+            }
+        }
+        return false;
+    }
+    
     bool IsTrackableVisible(int trackableId)
     {
         for(int i=0;i<_trackables.size(); i++) {
@@ -696,6 +878,7 @@ public:
     
     void SetFeatureDetector(int detectorType)
     {
+        CancelDetection();
         _selectedFeatureDetectorType = detectorType;
         _featureDetector.SetFeatureDetector(detectorType);
     }
@@ -716,7 +899,23 @@ void PlanarTracker::Initialise(int xFrameSize, int yFrameSize, ARdouble cParam[]
 
 void PlanarTracker::ProcessFrameData(unsigned char * frame)
 {
-    _trackerImpl->ProcessFrameData(frame);
+    AR2VideoTimestampT frameTime = {0, 0};
+    _trackerImpl->ProcessFrameData(frame, frameTime);
+}
+
+void PlanarTracker::ProcessFrameData(unsigned char * frame, const AR2VideoTimestampT& frameTime)
+{
+    _trackerImpl->ProcessFrameData(frame, frameTime);
+}
+
+void PlanarTracker::SetDetectionThreaded(bool on)
+{
+    _trackerImpl->SetDetectionThreaded(on);
+}
+
+bool PlanarTracker::DetectionThreaded()
+{
+    return _trackerImpl->DetectionThreaded();
 }
 
 void PlanarTracker::RemoveAllMarkers()
@@ -739,6 +938,11 @@ float* PlanarTracker::GetTrackablePose(int trackableId)
     return _trackerImpl->GetTrackablePose(trackableId);
 }
 
+bool PlanarTracker::GetTrackableDetectionTime(int trackableId, AR2VideoTimestampT *frameTime)
+{
+    return _trackerImpl->GetTrackableDetectionTime(trackableId, frameTime);
+}
+
 bool PlanarTracker::IsTrackableVisible(int trackableId)
 {
     return _trackerImpl->IsTrackableVisible(trackableId);
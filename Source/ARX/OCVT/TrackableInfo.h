@@ -41,6 +41,7 @@
 #ifndef TRACKABLE_INFO_H
 #define TRACKABLE_INFO_H
 #include "TrackingPointSelector.h"
+#include <ARX/AR/ar.h> // AR2VideoTimestampT
 class TrackableInfo
 {
 public:
@@ -60,6 +61,8 @@ public:
     std::vector<cv::Point2f> _bBox;
     std::vector<cv::Point2f> _bBoxTransformed;
     bool _isTracking, _isDetected, _resetTracks;
+    bool _seedFromDetection;            // Detected on the detection thread, so next tracked from the detection frame.
+    AR2VideoTimestampT _detectionTime;  // Capture time of the frame in which the trackable was last detected.
     
     TrackingPointSelector _trackSelection;
     
@@ -45,7 +45,7 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
-#include <ARX/AR/ar.h> // ARdouble
+#include <ARX/AR/ar.h> // ARdouble, AR2VideoTimestampT
 class TrackedImageInfo
 {
 public:
@@ -68,6 +68,13 @@ public:
     void Initialise(int xFrameSize, int yFrameSize, ARdouble cParam[][4]);
     
     void ProcessFrameData(unsigned char * frame);
+    /// As ProcessFrameData(frame), with the capture time of the frame, which is reported for detections in it.
+    void ProcessFrameData(unsigned char * frame, const AR2VideoTimestampT& frameTime);
+    
+    /// When on, feature detection and matching run on a background thread, a frame at a time, while
+    /// frames continue to be tracked. A detection seeds tracking in the frame after it completes. Default off.
+    void SetDetectionThreaded(bool on);
+    bool DetectionThreaded();
     
     void RemoveAllMarkers();
     void AddMarker(unsigned char* buff, std::string fileName, int width, int height, int uid, float scale);
@@ -75,6 +82,8 @@ public:
     
     float* GetTrackablePose(int trackableId);
     
+    /// If the trackable is detected, gets the capture time of the frame in which it was detected.
+    bool GetTrackableDetectionTime(int trackableId, AR2VideoTimestampT *frameTime);
     bool IsTrackableVisible(int trackableId);
     bool LoadTrackableDatabase(std::string fileName);
     bool SaveTrackableDatabase(std::string fileName);
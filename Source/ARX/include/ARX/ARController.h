@@ -73,6 +73,8 @@
 #  define pthread_mutex_destroy(pm)     DeleteCriticalSection(pm)
 #endif
 
+#define ARCONTROLLER_STEREO_PAIR_TOLERANCE_DEFAULT 16.0f ///< Half a frame period at 30 fps: frames further apart than this are from different exposures.
+
 /**
  * Wrapper for artoolkitX functionality. This class handles artoolkitX initialisation, updates,
  * and cleanup. It maintains a collection of trackables, providing methods to add and remove them.
@@ -103,10 +105,17 @@ private:
     bool m_videoSourceIsStereo;
     AR2VideoTimestampT m_updateFrameStamp0;
     AR2VideoTimestampT m_updateFrameStamp1;
+    float m_stereoPairToleranceMs;      ///< Maximum difference between left and right frame timestamps for the frames to be tracked as a pair.
+    int m_stereoPairs;                  ///< Number of stereo frame pairs tracked.
+    int m_stereoUnmatched;              ///< Number of frames dropped because no frame from the other eye matched.
+    double m_stereoSkewTotalMs;
+    float m_stereoSkewMaxMs;
     ARVideoView *m_arVideoViews[2];
     
     std::vector<ARTrackable *> m_trackables;    ///< List of trackables.
 
+    bool checkoutStereoFramePair(AR2VideoBufferT **image0, AR2VideoBufferT **image1);
+
     bool doSquareMarkerDetection;
     std::shared_ptr<ARTrackerSquare> m_squareTracker;
 #if HAVE_NFT
@@ -364,6 +373,32 @@ public:
 	 */
 	bool update();
 
+    /**
+     * Sets the maximum difference between the timestamps of left and right frames for them to be
+     * tracked together, when the video source is stereo.
+     * update() pairs the latest frame from one eye with the nearest-in-time frame from the other.
+     * Frames which can no longer be matched within the tolerance are dropped.
+     * @param toleranceMs Tolerance in milliseconds. Default is ARCONTROLLER_STEREO_PAIR_TOLERANCE_DEFAULT.
+     *      A tolerance of 0 requires the timestamps to be identical, as e.g. from a hardware-synchronised camera.
+     */
+    void setStereoFramePairTolerance(float toleranceMs);
+    float stereoFramePairTolerance() const;
+
+    /**
+     * Gets statistics on stereo frame pairing since the video source was started, or since
+     * resetStereoFramePairStats() was last called.
+     * @param pairs If non-NULL, filled with the number of frame pairs tracked.
+     * @param unmatched If non-NULL, filled with the number of frames dropped because no frame from the other eye matched.
+     * @param meanSkewMs If non-NULL, filled with the mean absolute difference between paired left and right timestamps, in milliseconds.
+     * @param maxSkewMs If non-NULL, filled with the maximum absolute difference between paired left and right timestamps, in milliseconds.
+     */
+    void stereoFramePairStats(int *pairs, int *unmatched, float *meanSkewMs, float *maxSkewMs) const;
+
+    /**
+     * Resets the statistics reported by stereoFramePairStats() to zero.
+     */
+    void resetStereoFramePairStats();
+
     /**
      * Populates the provided buffer with the current contents of the debug image.
      * @param videoSourceIndex Index into an array of video sources, specifying which source should
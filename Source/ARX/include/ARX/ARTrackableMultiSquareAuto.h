@@ -80,6 +80,16 @@ public:
 
     bool updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfoL, int markerNumL, int videoWidthL, int videoHeightL, ARMarkerInfo* markerInfoR, int markerNumR, int videoWidthR, int videoHeightR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]);
     
+    /**
+     * Gets the size and cost of the map being built, as of the map most recently published by the mapping thread.
+     * @param    keyframes  If non-NULL, filled with the number of camera poses (keyframes) in the map's factor graph.
+     * @param    landmarks  If non-NULL, filled with the number of markers in the map.
+     * @param    factors    If non-NULL, filled with the number of factors in the graph.
+     * @param    updateMs   If non-NULL, filled with the time taken by the last map optimization and read-out, in milliseconds.
+     * @return   true if metrics are available, or false if no map has been published yet or mapping does not use GTSAM.
+     */
+    bool mapMetrics(int *keyframes, int *landmarks, int *factors, double *updateMs) const;
+    
     /**
      * Make a copy of the multi config.
      * Caller must call arMultiFreeConfig() on the returned value when done.
@@ -52,6 +52,11 @@ class ARTrackableSquare : public ARTrackable {
 private:
     bool m_loaded;
     
+    // Index of the best detection matching this marker, or -1. Searches the candidateNum candidates (indices into markerInfo) if useCandidates, otherwise all detections.
+    int matchDetectedMarker(ARMarkerInfo* markerInfo, int markerNum, bool useCandidates, const int *candidates, int candidateNum) const;
+    bool updateMatching(ARMarkerInfo* markerInfo, int markerNum, bool useCandidates, const int *candidates, int candidateNum, AR3DHandle *ar3DHandle);
+    bool updateMatchingStereo(ARMarkerInfo* markerInfoL, int markerNumL, bool useCandidates, const int *candidatesL, int candidateNumL, ARMarkerInfo* markerInfoR, int markerNumR, const int *candidatesR, int candidateNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]);
+    
 protected:
     ARPattHandle *m_arPattHandle;
     ARdouble m_width;
@@ -86,7 +91,19 @@ public:
      */
 	bool updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int markerNum, AR3DHandle *ar3DHandle);
 
+    /**
+     * As updateWithDetectedMarkers(ARMarkerInfo*, int, AR3DHandle*), but considering only the given detections.
+     * @param candidates        Indices into markerInfo, in increasing order, of the detections that may match this marker.
+     * @param candidateNum      Number of items in candidates. If 0, the marker is not visible, and candidates may be NULL.
+     */
+    bool updateWithDetectedMarkers(ARMarkerInfo* markerInfo, int markerNum, const int *candidates, int candidateNum, AR3DHandle *ar3DHandle);
+
     bool updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfoL, int markerNumL, ARMarkerInfo* markerInfoR, int markerNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]);
+
+    /**
+     * As updateWithDetectedMarkersStereo(), but considering only the given detections in each image.
+     */
+    bool updateWithDetectedMarkersStereo(ARMarkerInfo* markerInfoL, int markerNumL, const int *candidatesL, int candidateNumL, ARMarkerInfo* markerInfoR, int markerNumR, const int *candidatesR, int candidateNumR, AR3DStereoHandle *handle, ARdouble transL2R[3][4]);
 };
 
 
@@ -70,6 +70,30 @@ public:
     void setTwoDMultiMode(bool on);
     bool TwoDMultiMode() const;
     
+    /**
+     * Sets whether feature detection and matching run on a background thread.
+     * @details With detection threaded, frames are tracked without waiting for detection, and a trackable
+     *     detected in a frame begins to be tracked from that frame in the first frame after detection completes.
+     *     Otherwise each frame is detected in before it is tracked. Default true.
+     * @param    on        true to detect on a background thread, false to detect on the calling thread.
+     */
+    void setTwoDDetectionThreaded(bool on);
+    bool TwoDDetectionThreaded() const;
+    
+    /**
+     * Gets statistics on acquisition of trackables by detection.
+     * @param    acquisitions    If non-NULL, filled with the number of times a trackable has become visible after being detected.
+     * @param    meanLatencyMs   If non-NULL, filled with the mean time, in milliseconds, from capture of the frame in which
+     *                           the trackable was detected to capture of the frame in which it became visible.
+     * @see                      resetAcquisitionStats()
+     */
+    void acquisitionStats(int *acquisitions, float *meanLatencyMs) const;
+    
+    /**
+     * Resets the statistics reported by acquisitionStats() to zero.
+     */
+    void resetAcquisitionStats();
+    
     bool start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat) override;
     bool start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, ARParamLT *paramLT1, AR_PIXEL_FORMAT pixelFormat1, const ARdouble transL2R[3][4]) override;
     bool isRunning() override;
@@ -97,6 +121,9 @@ private:
     ARdouble m_transL2R[3][4];          ///< For stereo tracking, transformation matrix from left camera to right camera.
     
     bool m_twoDMultiMode;
+    bool m_twoDDetectionThreaded;
+    int m_acquisitions;                 ///< Number of times a trackable has become visible after detection.
+    double m_acquisitionLatencyTotalMs; ///< Total latency from detection frame to visibility, over all acquisitions.
     bool m_running;
     bool unloadTwoDData();
     bool loadTwoDData(std::vector<ARTrackable *>& trackables);
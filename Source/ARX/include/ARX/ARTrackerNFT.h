@@ -49,8 +49,10 @@
 #include <ARX/ARTrackerVideo.h>
 #include <ARX/AR2/tracking.h>
 #include <ARX/KPM/kpm.h>
+#include <vector>
 
 #define PAGES_MAX 64
+#define NFT_FRAME_HISTORY_MAX 8 // Maximum number of frames kept for KPM latency compensation.
 
 class ARTrackerNFT : public ARTrackerVideo {
 public:
@@ -72,6 +74,33 @@ public:
     void setNFTMultiMode(bool on);
     bool NFTMultiMode() const;
     
+    /**
+     * Enables or disables latency compensation of KPM page detection.
+     * KPM detection runs on a background thread, so the pose it reports is for a frame which may be several
+     * frames older than the current one. When latency compensation is enabled, the luma images of frames
+     * which arrive while KPM is running are kept (up to NFT_FRAME_HISTORY_MAX frames), and a detected page's
+     * pose is carried forward through those frames by AR2 tracking before tracking continues on the current frame.
+     * Enabled by default.
+     * @param    on        true to enable latency compensation, false to seed AR2 tracking with the KPM pose as-is.
+     */
+    void setNFTLatencyCompensation(bool on);
+    bool NFTLatencyCompensation() const;
+    
+    /**
+     * Gets statistics on reacquisition of pages after loss of tracking.
+     * @param    detections      If non-NULL, filled with the number of times KPM has detected a page which was not being tracked.
+     * @param    reacquisitions  If non-NULL, filled with the number of those detections after which AR2 tracking of the page resumed.
+     * @param    meanLatencyMs   If non-NULL, filled with the mean time, in milliseconds, from capture of the frame given to KPM
+     *                           to capture of the first frame in which the page was again tracked, over all reacquisitions.
+     * @see                      resetReacquisitionStats()
+     */
+    void reacquisitionStats(int *detections, int *reacquisitions, float *meanLatencyMs) const;
+    
+    /**
+     * Resets the statistics reported by reacquisitionStats() to zero.
+     */
+    void resetReacquisitionStats();
+    
     bool start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat) override;
     bool start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, ARParamLT *paramLT1, AR_PIXEL_FORMAT pixelFormat1, const ARdouble transL2R[3][4]) override;
     bool isRunning() override;
@@ -94,9 +123,41 @@ private:
     KpmHandle           *m_kpmHandle;
     AR2SurfaceSetT      *m_surfaceSet[PAGES_MAX]; // Weak-reference. Strong reference is now in ARTrackableNFT class.
     ARdouble m_transL2R[3][4];          ///< For stereo tracking, transformation matrix from left camera to right camera.
+    
+    // Stereo NFT tracking.
+    ARParamLT           *m_paramLT0;
+    ARParamLT           *m_paramLT1;
+    AR2HandleT          *m_ar2Handle1;    ///< AR2 handle for right camera.
+    ICPStereoHandleT    *m_icpStereoHandle;
+    AR2SurfaceSetT      *m_surfaceSet1[PAGES_MAX]; ///< Right camera copies of m_surfaceSet, holding the features used in the right image.
+    float m_transL2Rf[3][4];
+    float m_transR2Lf[3][4];
+    int m_kpmEye;                       ///< Camera on which to run KPM next: the one which saw the most of the page when tracking was last lost.
+    int m_kpmFrameEye;                  ///< Camera of the frame being processed by KPM.
+    
+    // KPM latency compensation.
+    struct HistoryFrame {
+        std::vector<ARUint8> luma;
+        AR2VideoTimestampT time;
+    };
+    bool m_latencyCompensation;
+    HistoryFrame m_frameHistory[NFT_FRAME_HISTORY_MAX]; ///< Ring of luma frames which arrived while KPM was running, oldest first from m_frameHistoryStart.
+    int m_frameHistoryStart;
+    int m_frameHistoryCount;
+    AR2VideoTimestampT m_kpmFrameTime;  ///< Capture time of the frame being processed by KPM.
+    
+    // Reacquisition statistics.
+    bool m_reacquisitionPending[PAGES_MAX];
+    AR2VideoTimestampT m_reacquisitionStartTime[PAGES_MAX];
+    int m_reacquisitionDetections;
+    int m_reacquisitions;
+    double m_reacquisitionLatencyTotalMs;
 
     bool unloadNFTData();
     bool loadNFTData(std::vector<ARTrackable *>& trackables);
+    bool update2(AR2VideoBufferT *buff0, AR2VideoBufferT *buff1, std::vector<ARTrackable *>& trackables);
+    void pushHistoryFrame(AR2VideoBufferT *buff);
+    void seedFromKPM(int pageNo, float trans[3][4]);
 };
 
 #endif // HAVE_NFT
@@ -46,6 +46,9 @@
 #include <ARX/ARTrackableMultiSquare.h>
 #include <ARX/ARTrackerVideo.h>
 #include <ARX/AR/ar.h>
+#include <ARX/ARUtil/thread_sub.h>
+#include <unordered_map>
+#include <vector>
 
 class ARTrackerSquare : public ARTrackerVideo {
 public:
@@ -149,6 +152,32 @@ public:
     
     int patternCountMax() const;
     
+    /**
+     * Enables or disables parallel marker detection in stereo mode.
+     * When enabled, markers in the second image of a stereo pair are labelled and matched
+     * on a persistent worker thread while the first image is processed on the calling thread.
+     * Both are complete before stereo pose estimation begins. Has no effect on monocular input.
+     * @param    on        true to enable parallel detection, false to detect in each image in turn.
+     * @see                    stereoParallelDetection()
+     */
+    void setStereoParallelDetection(bool on);
+    
+    /**
+     * Returns whether parallel marker detection in stereo mode is enabled.
+     * @return                true when parallel detection is enabled.
+     * @see                    setStereoParallelDetection()
+     */
+    bool stereoParallelDetection() const;
+    
+    /**
+     * Gets the time taken by marker detection during the most recent call to update().
+     * @param    eye0Ms    If non-NULL, filled with the time spent detecting markers in the first (left) image, in milliseconds.
+     * @param    eye1Ms    If non-NULL, filled with the time spent detecting markers in the second (right) image, in milliseconds, or 0 for monocular input.
+     * @param    totalMs   If non-NULL, filled with the elapsed time for detection in all images, in milliseconds.
+     *                     When stereo detection runs in parallel, this is less than the sum of the per-image times.
+     */
+    void detectionTiming(double *eye0Ms, double *eye1Ms, double *totalMs) const;
+    
     bool start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat) override;
     bool start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, ARParamLT *paramLT1, AR_PIXEL_FORMAT pixelFormat1, const ARdouble transL2R[3][4]) override;
     bool isRunning() override;
@@ -173,6 +202,46 @@ private:
     bool m_debugMode;
     int m_patternSize;
     int m_patternCountMax;
+    bool m_stereoParallelDetection;
+    
+    struct DetectionTask {
+        ARHandle *arHandle;
+        AR2VideoBufferT *buff;
+        int ret;
+        double timeMs;
+    };
+    static void *detectionWorker(THREAD_HANDLE_T *threadHandle);
+    bool startDetectionWorker();
+    void stopDetectionWorker();
+    
+    /// Detections in one image indexed by template and matrix ID, so that each trackable finds the detections which
+    /// may match it without scanning them all. Detections with the same ID are chained in increasing index order.
+    struct DetectionIndex {
+        std::unordered_map<int, int> firstPatt;   ///< First detection with each template ID.
+        std::unordered_map<int, int> firstMatrix; ///< First detection with each matrix ID.
+        std::vector<int> nextPatt;                ///< For each detection, the next with the same template ID, or -1.
+        std::vector<int> nextMatrix;              ///< For each detection, the next with the same matrix ID, or -1.
+        void build(const ARMarkerInfo *markerInfo, int markerNum);
+        bool contains(int id, bool matrix) const;
+        void candidates(int id, bool matrix, std::vector<int>& out) const;
+    };
+    bool multiSquareHasCandidates(const ARTrackableMultiSquare *multi, const DetectionIndex& index) const;
+    
+    static const int POSE_WORKER_COUNT = 3;
+    static const int POSE_PARALLEL_MIN = 4; ///< Frames with fewer detections than this update all trackables on the calling thread.
+    /// A share of the single-square trackables, updated in parallel with the other shares. Trackables with the same
+    /// pattern ID fall in the same share, since matching a trackable writes to the detection it matches.
+    struct PoseTask {
+        ARTrackerSquare *tracker;
+        std::vector<ARTrackableSquare *> trackables;
+        std::vector<int> candidates0;   ///< Candidate detections in the first image for the trackable being updated.
+        std::vector<int> candidates1;   ///< Candidate detections in the second image for the trackable being updated.
+        bool success;
+    };
+    void runPoseTask(PoseTask *task);
+    static void *poseWorker(THREAD_HANDLE_T *threadHandle);
+    bool startPoseWorkers();
+    void stopPoseWorkers();
     
     ARHandle *m_arHandle0;              ///< Structure containing square tracker state.
     ARHandle *m_arHandle1;              ///< For stereo tracking, structure containing square tracker state for second tracker in stereo pair.
@@ -180,6 +249,18 @@ private:
     AR3DHandle *m_ar3DHandle;           ///< Structure used to compute 3D poses from tracking data.
     ARdouble m_transL2R[3][4];          ///< For stereo tracking, transformation matrix from left camera to right camera.
     AR3DStereoHandle *m_ar3DStereoHandle; ///< For stereo tracking, additional tracker state.
+    THREAD_HANDLE_T *m_detectionThread1; ///< For parallel stereo detection, worker thread which detects markers in the second image.
+    DetectionTask m_detectionTask0;     ///< Detection work and timing for the first image.
+    DetectionTask m_detectionTask1;     ///< Detection work and timing for the second image.
+    double m_detectionTimeMs;           ///< Elapsed time for detection in all images during the last update.
+    DetectionIndex m_detectionIndex0;   ///< Detections in the first image, by ID.
+    DetectionIndex m_detectionIndex1;   ///< Detections in the second image, by ID.
+    ARMarkerInfo *m_markerInfo0;        ///< Detections in the first image during the last update.
+    int m_markerNum0;
+    ARMarkerInfo *m_markerInfo1;        ///< Detections in the second image during the last update, or NULL if not stereo.
+    int m_markerNum1;
+    THREAD_HANDLE_T *m_poseThreads[POSE_WORKER_COUNT]; ///< Worker threads which update shares 1 to POSE_WORKER_COUNT of the single-square trackables.
+    PoseTask m_poseTasks[POSE_WORKER_COUNT + 1]; ///< Share 0 is updated on the calling thread.
 };
 
 #endif // !ARTRACKERSQUARE_H
@@ -43,7 +43,13 @@
 #include <ARX/ARVideo/video.h>
 
 #include <mutex>
-#include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#define ARVIDEOSOURCE_FRAME_SLOTS 3     ///< Number of frames in the frame ring: one being captured, the latest, and one still checked out by a slower reader.
+#define ARVIDEOSOURCE_CLOSE_CHECKIN_TIMEOUT_MS 2000 ///< How long close() waits for readers to check in their frames.
 
 /**
  * A video source provides video frames to the artoolkitX tracking module. Video sources
@@ -79,14 +85,37 @@ private:
     
     int m_captureFrameWaitCount;        ///< Number of frames captureFrame waited.
 
-    AR2VideoBufferT *m_frameBuffer;     ///< Pointer to latest frame.
+    // Frame ring. Each captured frame is placed in a free slot and published as the latest frame.
+    // Readers hold a reference on the slot they checked out, so capture can proceed into another slot meanwhile.
+    // A slot normally references the video module's buffer, which the module may reuse on the next ar2VideoGetImage().
+    // Frames are copied into slot storage only while readers are holding frames across captures.
+    struct FrameSlot {
+        AR2VideoBufferT buffer;         ///< The frame. Planes and luma point into the video module's buffer, or into storage.
+        ARUint8 *planes[2];
+        ARUint8 *storage;
+        int refCount;                   ///< Number of checkouts not yet checked in.
+        bool consumed;                  ///< true once the frame has been checked out.
+    };
+    FrameSlot m_frameSlots[ARVIDEOSOURCE_FRAME_SLOTS];
+    size_t m_framePlaneSize[2];         ///< Bytes in each plane of a frame (or in the whole frame, for non-planar formats, in m_framePlaneSize[0]).
+    size_t m_frameLumaSize;             ///< Bytes of separate luma storage in a frame, or 0 if luma is the first plane.
+    int m_frameLatest;                  ///< Index of the slot holding the latest frame, or -1 if none.
+    int m_frameModuleSlot;              ///< Index of the slot referencing the video module's buffer, or -1 if none.
+    bool m_frameCopy;                   ///< true if captured frames are to be copied into slot storage rather than referenced.
+    std::vector<std::pair<std::thread::id, int> > m_frameCheckouts; ///< Outstanding checkouts, by thread, to support checkinFrame(void).
+    std::mutex m_frameRingLock;
+    std::condition_variable m_frameRingCond;
+    std::atomic<int> m_frameDropCount;  ///< Number of captured frames dropped because no slot was free.
+    std::atomic<int> m_frameCopyCount;  ///< Number of frames copied into slot storage.
+    
+    bool frameRingAlloc(const AR2VideoBufferT *vbuff);
+    void frameRingFree();
+    void frameSlotCopy(FrameSlot *slot, const AR2VideoBufferT *vbuff);
     
     AR2VideoTimestampT m_getFrameTextureTime; ///< Time at which last call to getFrameTexture was made.
     
     int m_error;
     void setError(int error);
-    
-    pthread_rwlock_t m_frameBufferLock;
 
     static void openCallback(void *userData);
     bool open2();
@@ -155,12 +184,23 @@ public:
     
     /**
         @brief Closes the video source.
+        @details
+            Waits up to ARVIDEOSOURCE_CLOSE_CHECKIN_TIMEOUT_MS milliseconds for frames checked out on other threads
+            to be checked in. The calling thread must not hold any frame checked out.
         @return        true if the video source was closed successfully, otherwise false.
      */
     bool close();
 
     /**
         @brief Asks the video source to capture a frame.
+        @details
+            The frame is placed in a free slot of the video source's frame ring and becomes the
+            frame returned by subsequent calls to checkoutFrameIfNewerThan(). Frames already checked out
+            are unaffected, so this function may be called on a different thread from the one(s) reading frames.
+            If every slot is checked out or holds the latest frame, the captured frame is dropped.
+            The slot references the video module's buffer without copying the frame. If the frame in the module's
+            buffer is still checked out, no frame is captured until it is checked in, and subsequent frames are
+            copied into the slot's own storage for as long as readers are holding frames across captures.
         @return        true if the video source captured a frame, otherwise false
      */
     bool captureFrame();
@@ -168,14 +208,14 @@ public:
     /**
         @brief Checkout a locked video frame if the frame's timestamp is newer than 'time'.
         @details
-            This function returns a pointer to the current video frame buffer, but only if the
+            This function returns a pointer to the latest video frame buffer, but only if the
             frame's timestamp is newer than the time passed in parameter 'time'. If the return
             value is non-NULL, the caller has non-exclusive read access to the frame buffer
-            until the next call to checkinFrame(). If the return value is NULL, no further action
+            until it is checked in via checkinFrame(). If the return value is NULL, no further action
             is required. I.e. each call to this function which returns non-NULL MUST be balanced
-            with a call to checkinFrame() on the same thread.
-            Multiple callers may simultaneously checkout frames, but the next frame will not be
-            made available until all callers have called checkinFrame() on the current frame.
+            with a call to checkinFrame().
+            Multiple callers may simultaneously checkout frames. While a frame is checked out,
+            newer frames may still be captured into other slots of the frame ring, and no lock is held.
         @param         time Timestamp of frame to compare. Passing a timestamp of {0, 0} will ensure that the timestamp test always passes.
         @return        Pointer to the buffer containing the current video frame, if frame's timestamp is newer and a frame is available.
         @see checkinFrame
@@ -183,13 +223,54 @@ public:
     AR2VideoBufferT* checkoutFrameIfNewerThan(const AR2VideoTimestampT time);
 
     /**
-        @brief Checkin a locked video frame.
+        @brief Checkout the video frame whose timestamp is nearest to 'time', from those newer than 'newerThan'.
+        @details
+            Like checkoutFrameIfNewerThan(), but considers every frame still held in the frame ring rather
+            than only the latest. This allows frames from two video sources to be matched by timestamp.
+            Each call to this function which returns non-NULL MUST be balanced with a call to checkinFrame().
+        @param         time Timestamp to match.
+        @param         newerThan Only frames with timestamps newer than this are considered. Pass {0, 0} to consider all frames.
+        @return        Pointer to the buffer containing the nearest video frame, or NULL if no frame is newer than 'newerThan'.
+        @see checkinFrame
+     */
+    AR2VideoBufferT* checkoutFrameNearest(const AR2VideoTimestampT time, const AR2VideoTimestampT newerThan);
+
+    /**
+        @brief Checkin a video frame.
+        @details
+            Each call to checkoutFrameIfNewerThan() or checkoutFrameNearest() which returns non-NULL MUST be balanced with a call to this function.
+        @param frame The frame, as returned by checkoutFrameIfNewerThan() or checkoutFrameNearest().
+        @see checkoutFrameIfNewerThan
+     */
+     void checkinFrame(AR2VideoBufferT *frame);
+
+    /**
+        @brief Checkin the video frame most recently checked out on the calling thread.
         @details
-            Each call to checkoutFrameIfNewerThan() which returns non-NULL MUST be balanced with a call to this function on the same thread.
+            Equivalent to checkinFrame(AR2VideoBufferT *) with the frame most recently returned to the calling thread by
+            checkoutFrameIfNewerThan() and not yet checked in.
         @see checkoutFrameIfNewerThan
      */
      void checkinFrame(void);
 
+    /**
+        @brief Get the number of captured frames dropped because every slot in the frame ring was in use.
+        @return The number of frames dropped since the video source was opened.
+     */
+     int getDroppedFrameCount(void) const;
+
+    /**
+        @brief Get the number of captured frames copied into the frame ring rather than referenced in the video module's buffer.
+        @return The number of frames copied since the video source was opened.
+     */
+     int getCopiedFrameCount(void) const;
+
+    /**
+        @brief Get the difference between two frame timestamps.
+        @return a - b, in microseconds.
+     */
+    static int64_t timeDiff(const AR2VideoTimestampT& a, const AR2VideoTimestampT& b);
+
     /**
         @brief Get the underlying AR2VideoParamT settings structure.
         @details
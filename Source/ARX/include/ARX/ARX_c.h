@@ -409,6 +409,8 @@ extern "C" {
         ARW_TRACKER_OPTION_SQUARE_PATTERN_SIZE = 9,                    ///< Number of rows and columns in square template (pattern) markers. Defaults to AR_PATT_SIZE1, which is 16 in all versions of ARToolKit prior to 5.3. int.
         ARW_TRACKER_OPTION_SQUARE_PATTERN_COUNT_MAX = 10,              ///< Maximum number of square template (pattern) markers that may be loaded at once. Defaults to AR_PATT_NUM_MAX, which is at least 25 in all versions of ARToolKit prior to 5.3. int.
         ARW_TRACKER_OPTION_2D_TRACKER_FEATURE_TYPE = 11,              ///< Feature detector type used in the 2d Tracker - 0 AKAZE, 1 ORB, 2 BRISK, 3 KAZE
+        ARW_TRACKER_OPTION_SQUARE_STEREO_PARALLEL_DETECTION = 12,     ///< When tracking in stereo, detect markers in the left and right images in parallel. Defaults to false. bool.
+        ARW_TRACKER_OPTION_NFT_LATENCY_COMPENSATION = 13,             ///< Carry the pose of a page detected by KPM forward to the current frame by tracking through the frames which arrived while KPM was running. Defaults to true. bool.
     };
     
     /**
@@ -15,6 +15,7 @@
 #if HAVE_GTSAM
 #include "mapper.hpp"
 #include <gtsam/base/Vector.h>
+#include <chrono>
 
 // In GTSAM, measurement functions are represented as 'factors'.
 // Initialize the origin landmark location using a Prior factor.
@@ -27,28 +28,46 @@
 #  define SCALEF 1000
 #endif
 
+// Tolerance (metres and radians) within which a landmark estimate is considered unchanged.
+#define LANDMARK_CHANGE_TOLERANCE 1e-6
+
 namespace arx_mapper {
     
     using namespace gtsam;
     
-    int Mapper::pose_cnt = 0;
-    
-    Mapper::Mapper(double relinearize_thresh, int relinearize_skip) :
+    Mapper::Mapper(double relinearize_thresh, int relinearize_skip, double keyframe_translation, double keyframe_rotation) :
         inited_(false),
+        pose_cnt_(0),
+        keyframe_translation_(keyframe_translation),
+        keyframe_rotation_(keyframe_rotation),
+        keyframes_(0),
+        relinearized_(0),
+        reeliminated_(0),
         params_(ISAM2GaussNewtonParams(), relinearize_thresh, relinearize_skip),
         isam2_(params_),
         marker_noise_(noiseModel::Diagonal::Sigmas((Vector(6) << Vector3::Constant(0.20), Vector3::Constant(0.1)).finished())), // 20cm std on x,y,z, 0.1 rad (5.73 deg) on roll,pitch,yaw.
         small_noise_(noiseModel::Diagonal::Sigmas((Vector(6) << Vector3::Constant(0.10), Vector3::Constant(0.05)).finished())) {  // 10cm std on x,y,z 0.05 rad (2.86 deg) on roll,pitch,yaw.
     }
     
+    bool Mapper::IsKeyframe(const ARdouble trans[3][4], const std::vector<Marker>& markers) const {
+        if (!inited_) return true;
+        for (const Marker& marker : markers) {
+            if (all_uids_.find(marker.uid) == all_uids_.end()) return true;
+        }
+        // Camera motion since the last keyframe.
+        const Pose3 delta = pose_.between(PoseFromARTrans(trans).inverse());
+        return (delta.translation().norm() > keyframe_translation_ || Rot3::Logmap(delta.rotation()).norm() > keyframe_rotation_);
+    }
+    
     void Mapper::AddPose(const ARdouble trans[3][4]) {
-        pose_cnt++;
+        pose_cnt_++;
+        keyframes_++;
         pose_ = PoseFromARTrans(trans).inverse();
-        initial_estimates_.insert(Symbol('x', pose_cnt), pose_);
+        initial_estimates_.insert(Symbol('x', pose_cnt_), pose_);
     }
     
     void Mapper::AddFactors(const std::vector<Marker>& markers) {
-        Symbol x_i('x', pose_cnt);
+        Symbol x_i('x', pose_cnt_);
         for (const Marker& marker : markers) {
             graph_.push_back(BetweenFactor<Pose3>(x_i, Symbol('l', marker.uid), PoseFromARTrans(marker.trans), marker_noise_));
         }
@@ -56,7 +75,7 @@ namespace arx_mapper {
     
     void Mapper::Initialize(int uid, ARdouble width) {
         
-        if (pose_cnt != 1) {
+        if (pose_cnt_ != 1) {
             ARLOGe("Incorrect initial pose.\n");
             return;
         }
@@ -65,8 +84,8 @@ namespace arx_mapper {
         AddLandmark(uid, Pose3());
         
         // A very strong prior on first pose and landmark
-        ARLOGi("Add pose prior on pose %d.\n", pose_cnt);
-        graph_.push_back(PriorFactor<Pose3>(Symbol('x', pose_cnt), pose_, small_noise_));
+        ARLOGi("Add pose prior on pose %d.\n", pose_cnt_);
+        graph_.push_back(PriorFactor<Pose3>(Symbol('x', pose_cnt_), pose_, small_noise_));
         ARLOGi("Add landmark prior on uid %d.\n", uid);
         graph_.push_back(PriorFactor<Pose3>(Symbol('l', uid), Pose3(), small_noise_));
 
@@ -95,7 +114,9 @@ namespace arx_mapper {
         // Each call to iSAM2 update(*) performs one iteration of the iterative nonlinear solver.
         // If accuracy is desired at the expense of time, update(*) can be called additional times
         // to perform multiple optimizer iterations every step.
-        isam2_.update(graph_, initial_estimates_);
+        const ISAM2Result result = isam2_.update(graph_, initial_estimates_);
+        relinearized_ = result.variablesRelinearized;
+        reeliminated_ = result.variablesReeliminated;
         if (num_iterations > 1) {
             for (int i = 1; i < num_iterations; ++i) {
                 isam2_.update();
@@ -103,26 +124,133 @@ namespace arx_mapper {
         }
     }
     
-    void Mapper::Update(ARMultiMarkerInfoT* map) const {
-        
-        Values results = isam2_.calculateEstimate();
-        //results.print("Current estimate: ");
-        
-        // Update the current camera pose.
-        ARTransFromPose(map->trans, (results.at<Pose3>(Symbol('x', pose_cnt))).inverse());
-        
-        // Update the current map.
-        for (const int uid : all_uids_) {
-            ARdouble mTrans[3][4];
-            ARTransFromPose(mTrans, results.at<Pose3>(Symbol('l', uid)));
-            arMultiAddOrUpdateSubmarker(map, uid, AR_MULTI_PATTERN_TYPE_MATRIX, width_, mTrans, 0);
-        }
-    }
-    
     void Mapper::Clear() {
         graph_.resize(0);
         initial_estimates_.clear();
     }
+
+    void Mapper::GetChangedLandmarks(std::vector<Marker>& changed) {
+        // calculateEstimate(key) back-substitutes only as far as iSAM2's last update requires, and
+        // calculates just that variable, so read-out cost grows with the markers rather than the keyframes.
+        for (const int uid : all_uids_) {
+            const Pose3 estimate = isam2_.calculateEstimate<Pose3>(Symbol('l', uid));
+            std::map<int, Pose3>::iterator it = landmark_estimates_.find(uid);
+            if (it != landmark_estimates_.end()) {
+                if (it->second.equals(estimate, LANDMARK_CHANGE_TOLERANCE)) continue;
+                it->second = estimate;
+            } else {
+                landmark_estimates_.insert(std::make_pair(uid, estimate));
+            }
+            Marker marker;
+            marker.uid = uid;
+            ARTransFromPose(marker.trans, estimate);
+            changed.push_back(marker);
+        }
+    }
+
+    MapperThread::MapperThread(double relinearize_thresh, int relinearize_skip) :
+        mapper_(relinearize_thresh, relinearize_skip),
+        version_(0),
+        map_(),
+        dropped_(0),
+        quit_(false) {
+    }
+
+    MapperThread::~MapperThread() {
+        if (thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wake_lock_);
+                quit_ = true;
+            }
+            wake_.notify_one();
+            thread_.join();
+        }
+    }
+
+    bool MapperThread::Push(Observation& observation) {
+        if (!thread_.joinable()) thread_ = std::thread(&MapperThread::Run, this);
+        if (!queue_.Push(observation)) {
+            dropped_++;
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_lock_); // So that the wakeup can't fall between the thread's check and its wait.
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+    void MapperThread::Run() {
+        ARLOGd("Start mapping thread.\n");
+        Observation observation;
+        std::vector<Marker> changed;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wake_lock_);
+                wake_.wait(lock, [this]{ return quit_ || !queue_.Empty(); });
+                if (quit_) break;
+            }
+
+            // Add everything queued that makes a keyframe, then optimize once.
+            bool added = false;
+            while (queue_.Pop(observation)) {
+                map_.stats.frames++;
+                if (!mapper_.IsKeyframe(observation.trans, observation.markers)) {
+                    map_.stats.frames_skipped++;
+                    continue;
+                }
+                mapper_.AddPose(observation.trans);
+                mapper_.AddFactors(observation.markers);
+                if (!mapper_.inited()) {
+                    // Add a landmark for the origin marker.
+                    // We fix this in the map at the origin and thus fix the scale for first pose and first landmark.
+                    mapper_.Initialize(observation.origin_uid, observation.width);
+                } else {
+                    // This will add new landmarks for each marker not previously seen, with the
+                    // initial pose estimate calculated from the marker pose in the camera frame
+                    // composed with the camera pose in the map frame.
+                    mapper_.AddLandmarks(observation.markers);
+                    added = true;
+                }
+            }
+            if (!added) continue;
+
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            mapper_.Optimize();
+            // Prepare for next iteration.
+            mapper_.Clear();
+
+            // Read out only the landmarks that changed.
+            map_.version = ++version_;
+            map_.width = mapper_.width();
+            changed.clear();
+            mapper_.GetChangedLandmarks(changed);
+            for (const Marker& marker : changed) {
+                std::map<int, size_t>::iterator it = landmark_index_.find(marker.uid);
+                if (it == landmark_index_.end()) {
+                    it = landmark_index_.insert(std::make_pair(marker.uid, map_.landmarks.size())).first;
+                    map_.landmarks.push_back(marker);
+                    map_.changed.push_back(version_);
+                } else {
+                    map_.landmarks[it->second] = marker;
+                    map_.changed[it->second] = version_;
+                }
+            }
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            MapperStats& stats = map_.stats;
+            stats.keyframes = mapper_.keyframes();
+            stats.landmarks = mapper_.landmarks();
+            stats.factors = mapper_.factors();
+            stats.relinearized = mapper_.relinearized();
+            stats.reeliminated = mapper_.reeliminated();
+            stats.update_ms = ms;
+            stats.mean_update_ms = (stats.mean_update_ms * stats.updates + ms) / (stats.updates + 1);
+            stats.updates++;
+            std::atomic_store(&snapshot_, std::shared_ptr<const MapSnapshot>(std::make_shared<MapSnapshot>(map_)));
+        }
+        ARLOGd("End mapping thread.\n");
+    }
     
     Pose3 PoseFromARTrans(const ARdouble trans[3][4]) {
         Point3 t(trans[0][3] / SCALEF, trans[1][3] / SCALEF, trans[2][3] / SCALEF);
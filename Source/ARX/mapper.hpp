@@ -34,9 +34,16 @@
 // Use Between factors to model the camera's landmark observations.
 #include <gtsam/slam/BetweenFactor.h>
 
-// Map is stored as an ARMultiMarkerInfoT structure.
+// Poses are exchanged with artoolkitX as ARdouble[3][4] transforms.
 #include <ARX/AR/ar.h>
-#include <ARX/AR/arMulti.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace arx_mapper {
     
@@ -47,25 +54,41 @@ namespace arx_mapper {
 
     class Mapper {
     public:
-        static int pose_cnt;
-        
-        Mapper(double relinearize_thresh, int relinearize_skip);
+        // A pose is added as a keyframe only if the camera has moved by more than keyframe_translation (metres) or
+        // turned by more than keyframe_rotation (radians) since the last keyframe, or it sees a new marker.
+        Mapper(double relinearize_thresh, int relinearize_skip, double keyframe_translation = 0.05, double keyframe_rotation = 0.087);
         
+        bool IsKeyframe(const ARdouble trans[3][4], const std::vector<Marker>& markers) const; // Map pose in camera coordinates.
         void AddPose(const ARdouble trans[3][4]); // Map pose in camera coordinates.
         void AddFactors(const std::vector<Marker>& markers);
 
         bool inited() const { return inited_; }
         void Optimize(int num_iterations = 1);
-        void Update(ARMultiMarkerInfoT* map) const;
         void AddLandmarks(const std::vector<Marker>& markers);
         void Initialize(int uid, ARdouble width);
         void Clear();
+        // Calculates the estimate of each landmark (but not of the keyframe poses), and appends to changed those
+        // landmarks that are new or have moved since the last call, with their poses in map coordinates.
+        void GetChangedLandmarks(std::vector<Marker>& changed);
+        ARdouble width() const { return width_; }
+        int keyframes() const { return keyframes_; }
+        int landmarks() const { return (int)all_uids_.size(); }
+        size_t factors() const { return isam2_.getFactorsUnsafe().size(); }
+        size_t relinearized() const { return relinearized_; } // Variables relinearized in the last Optimize().
+        size_t reeliminated() const { return reeliminated_; } // Variables re-eliminated in the last Optimize().
         
     private:
         void AddLandmark(int uid, const gtsam::Pose3& pose);
         
         ARdouble width_;
         bool inited_;
+        int pose_cnt_; // Index of the latest pose in this mapper's graph.
+        double keyframe_translation_;
+        double keyframe_rotation_;
+        int keyframes_;
+        size_t relinearized_;
+        size_t reeliminated_;
+        std::map<int, gtsam::Pose3> landmark_estimates_; // As of the last GetChangedLandmarks().
         gtsam::ISAM2Params params_;
         gtsam::ISAM2 isam2_;
         gtsam::NonlinearFactorGraph graph_;
@@ -76,6 +99,99 @@ namespace arx_mapper {
         std::set<int> all_uids_;
     };
     
+    // One frame's observations, for the mapping thread.
+    struct Observation {
+        ARdouble trans[3][4];         // Map pose in camera coordinates.
+        std::vector<Marker> markers;  // Marker poses in camera coordinates.
+        int origin_uid;               // Marker fixed at the map origin, and the marker width, for initialising the map.
+        ARdouble width;
+    };
+
+    // Size and cost of mapping, as of the last update.
+    struct MapperStats {
+        int keyframes;             // Poses in the graph.
+        int landmarks;
+        size_t factors;            // Factors in the graph.
+        long frames;               // Observations taken from the queue, and those not added as keyframes.
+        long frames_skipped;
+        long updates;              // Optimization steps, and the variables relinearized and re-eliminated in the last one.
+        size_t relinearized;
+        size_t reeliminated;
+        double update_ms;          // Time for the last optimization step and read-out, and the mean over all steps.
+        double mean_update_ms;
+    };
+
+    // Map estimate published by the mapping thread.
+    struct MapSnapshot {
+        long version;                 // Increases with each snapshot published.
+        ARdouble width;
+        std::vector<Marker> landmarks; // Marker poses in map coordinates.
+        std::vector<long> changed;    // For each landmark, the version in which it last changed.
+        MapperStats stats;
+    };
+
+    // Lock-free ring of up to N items, for one producer thread and one consumer thread.
+    template <typename T, size_t N>
+    class SPSCQueue {
+    public:
+        SPSCQueue() : head_(0), tail_(0) {}
+
+        // Producer. Returns false, leaving item as it was, if the queue is full.
+        bool Push(T& item) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == N) return false;
+            slots_[tail % N] = std::move(item);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // Consumer. Returns false if the queue is empty.
+        bool Pop(T& item) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) return false;
+            item = std::move(slots_[head % N]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+        bool Empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+    private:
+        T slots_[N];
+        std::atomic<size_t> head_, tail_;
+    };
+
+    // Runs a Mapper on its own thread, so that optimization never holds up the frame thread. The frame thread pushes
+    // each frame's observations, and takes up the map from the most recently published snapshot. The thread is
+    // started on the first push.
+    class MapperThread {
+    public:
+        static const size_t kQueueLength = 8;
+
+        MapperThread(double relinearize_thresh, int relinearize_skip);
+        ~MapperThread();
+
+        // Queue observations for mapping. Returns false, and counts the frame as dropped, if the mapping thread is too
+        // far behind to take them.
+        bool Push(Observation& observation);
+        // Most recently published map, or null if none has been published yet.
+        std::shared_ptr<const MapSnapshot> Latest() const { return std::atomic_load(&snapshot_); }
+        long dropped() const { return dropped_.load(); }
+
+    private:
+        void Run();
+
+        Mapper mapper_;
+        SPSCQueue<Observation, kQueueLength> queue_;
+        std::shared_ptr<const MapSnapshot> snapshot_; // Accessed only with std::atomic_load and std::atomic_store.
+        long version_;
+        std::map<int, size_t> landmark_index_;        // Index of each landmark in the snapshots.
+        MapSnapshot map_;                             // Contents of the next snapshot; used only on the mapping thread.
+        std::atomic<long> dropped_;
+        std::atomic<bool> quit_;
+        std::mutex wake_lock_;             // Only for the mapping thread to sleep on; the queue is lock-free.
+        std::condition_variable wake_;
+        std::thread thread_;
+    };
+
     gtsam::Pose3 PoseFromARTrans(const ARdouble trans[3][4]);
     void ARTransFromPose(ARdouble trans[3][4], const gtsam::Pose3 &pose);
 
@@ -0,0 +1,203 @@
+/*
+ *  benchBoxFilter.c
+ *  artoolkitX
+ *
+ *  Time the adaptive-threshold box filter against a direct evaluation of the kernel, for a range of kernel sizes.
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2026 artoolkitX contributors.
+ *
+ *  Author(s): artoolkitX contributors.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ARX/AR/ar.h>
+#include <ARX/AR/arImageProc.h>
+#include <ARX/ARUtil/time.h>
+
+#define KERNEL_SIZES_MAX 16
+
+static int                  xsize = 1280;
+static int                  ysize = 720;
+static int                  iterations = 10;
+static int                  bias = -7;
+static int                  kernelSizes[KERNEL_SIZES_MAX] = {5, 9, 15, 25, 31, 51, 101};
+static int                  kernelSizeCount = 7;
+
+
+static void          usage(char *com);
+static void          init(int argc, char *argv[]);
+static void          boxFilterDirect(const ARUint8 *dataPtr, ARUint8 *out, const int boxSize);
+
+
+int main(int argc, char *argv[])
+{
+    ARImageProcInfo    *ipi;
+    ARUint8            *image;
+    ARUint8            *ref;
+    int                 i, k, n;
+    double              tDirect, tFast;
+    int                 mismatch = 0;
+
+    init(argc, argv);
+
+    image = (ARUint8 *)malloc(xsize*ysize);
+    ref = (ARUint8 *)malloc(xsize*ysize);
+    ipi = arImageProcInit(xsize, ysize);
+    if (!image || !ref || !ipi) {
+        ARPRINT("Out of memory!!\n");
+        exit(ENOMEM);
+    }
+
+    // Synthetic luma frame: a gradient with some dark squares and noise, so that neither path can shortcut on flat regions.
+    srand(1);
+    for (i = 0; i < xsize*ysize; i++) {
+        int x = i % xsize, y = i / xsize;
+        int v = (x * 255) / xsize / 2 + (y * 255) / ysize / 2 + (rand() & 0x1f) - 0x10;
+        if (((x / 64) + (y / 64)) % 3 == 0) v /= 4;
+        image[i] = (ARUint8)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    ARPRINT("Box filter, %dx%d, bias %d, %d iterations per kernel size.\n", xsize, ysize, bias, iterations);
+    ARPRINT("  kernel   direct [ms]   running-sum [ms]   speedup   output\n");
+    for (k = 0; k < kernelSizeCount; k++) {
+        arUtilTimerReset();
+        for (n = 0; n < iterations; n++) {
+            arImageProcLumaHist(ipi, image);
+            boxFilterDirect(image, ref, kernelSizes[k]);
+        }
+        tDirect = arUtilTimer() * 1000.0 / iterations;
+
+        arUtilTimerReset();
+        for (n = 0; n < iterations; n++) {
+            if (arImageProcLumaHistAndBoxFilterWithBias(ipi, image, kernelSizes[k], bias) < 0) {
+                ARPRINT("Error in arImageProcLumaHistAndBoxFilterWithBias().\n");
+                exit(-1);
+            }
+        }
+        tFast = arUtilTimer() * 1000.0 / iterations;
+
+        n = memcmp(ref, ipi->image2, xsize*ysize);
+        if (n) mismatch = 1;
+        ARPRINT("  %6d   %11.3f   %16.3f   %7.1fx   %s\n", kernelSizes[k], tDirect, tFast, (tFast > 0.0 ? tDirect / tFast : 0.0), (n ? "MISMATCH" : "identical"));
+    }
+
+    arImageProcFinal(ipi);
+    free(ref);
+    free(image);
+
+    return (mismatch ? -1 : 0);
+}
+
+// Direct O(k^2)-per-pixel evaluation of the box filter with the kernel truncated at the image edges.
+static void boxFilterDirect(const ARUint8 *dataPtr, ARUint8 *out, const int boxSize)
+{
+    int i, j, kernelSizeHalf;
+
+    kernelSizeHalf = boxSize >> 1;
+    for (j = 0; j < ysize; j++) {
+        for (i = 0; i < xsize; i++) {
+            int val, count, kernel_i, kernel_j, ii, jj;
+            val = count = 0;
+            for (kernel_j = -kernelSizeHalf; kernel_j <= kernelSizeHalf; kernel_j++) {
+                jj = j + kernel_j;
+                if (jj < 0 || jj >= ysize) continue;
+                for (kernel_i = -kernelSizeHalf; kernel_i <= kernelSizeHalf; kernel_i++) {
+                    ii = i + kernel_i;
+                    if (ii < 0 || ii >= xsize) continue;
+                    val += dataPtr[ii + jj*xsize];
+                    count++;
+                }
+            }
+            out[i + j*xsize] = val / count;
+        }
+    }
+    if (bias) for (i = 0; i < xsize*ysize; i++) out[i] += bias;
+}
+
+static void usage( char *com )
+{
+    ARPRINT("Usage: %s [options] [kernel size]...\n", com);
+    ARPRINT("Times the adaptive-threshold box filter against a direct evaluation of the kernel, and checks the output is identical.\n");
+    ARPRINT("  -width=w: use an image of width w (default 1280).\n");
+    ARPRINT("  -height=h: use an image of height h (default 720).\n");
+    ARPRINT("  -iterations=n: time n passes per kernel size (default 10).\n");
+    ARPRINT("  -bias=b: add bias b to the filtered image (default -7).\n");
+    ARPRINT("  --version: Print artoolkitX version and exit.\n");
+    ARPRINT("  -loglevel=l: Set the log level to l, where l is one of DEBUG INFO WARN ERROR.\n");
+    ARPRINT("  -h -help --help: show this message\n");
+    ARPRINT("If no kernel sizes are given, sizes 5, 9, 15, 25, 31, 51 and 101 are timed.\n");
+    exit(0);
+}
+
+static void init(int argc, char *argv[])
+{
+    int                i;
+    int                gotKernelSize = FALSE;
+
+    i = 1; // argv[0] is name of app, so start at 1.
+    while (i < argc) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+        } else if (strcmp(argv[i], "--version") == 0 || strcmp(argv[i], "-version") == 0 || strcmp(argv[i], "-v") == 0) {
+            ARPRINT("%s version %s\n", argv[0], AR_HEADER_VERSION_STRING);
+            exit(0);
+        } else if( strncmp(argv[i], "-loglevel=", 10) == 0 ) {
+            if (strcmp(&(argv[i][10]), "DEBUG") == 0) arLogLevel = AR_LOG_LEVEL_DEBUG;
+            else if (strcmp(&(argv[i][10]), "INFO") == 0) arLogLevel = AR_LOG_LEVEL_INFO;
+            else if (strcmp(&(argv[i][10]), "WARN") == 0) arLogLevel = AR_LOG_LEVEL_WARN;
+            else if (strcmp(&(argv[i][10]), "ERROR") == 0) arLogLevel = AR_LOG_LEVEL_ERROR;
+            else usage(argv[0]);
+        } else if( strncmp(argv[i], "-width=", 7) == 0 ) {
+            if( sscanf(&(argv[i][7]), "%d", &xsize) != 1 ) usage(argv[0]);
+            if( xsize <= 0 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-height=", 8) == 0 ) {
+            if( sscanf(&(argv[i][8]), "%d", &ysize) != 1 ) usage(argv[0]);
+            if( ysize <= 0 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-iterations=", 12) == 0 ) {
+            if( sscanf(&(argv[i][12]), "%d", &iterations) != 1 ) usage(argv[0]);
+            if( iterations <= 0 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-bias=", 6) == 0 ) {
+            if( sscanf(&(argv[i][6]), "%d", &bias) != 1 ) usage(argv[0]);
+        } else {
+            if (!gotKernelSize) {
+                kernelSizeCount = 0;
+                gotKernelSize = TRUE;
+            }
+            if (kernelSizeCount == KERNEL_SIZES_MAX || sscanf(argv[i], "%d", &kernelSizes[kernelSizeCount]) != 1 || kernelSizes[kernelSizeCount] <= 0) {
+                ARLOGe("Error: invalid command line argument '%s'.\n", argv[i]);
+                usage(argv[0]);
+            }
+            kernelSizeCount++;
+        }
+        i++;
+    }
+}
@@ -0,0 +1,212 @@
+/*
+ *  benchVideoSource.cpp
+ *  artoolkitX
+ *
+ *  Measure tracking throughput with video capture and tracking run in sequence on one thread,
+ *  versus capture on its own thread, handing frames to the tracking thread through the
+ *  ARVideoSource frame ring.
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2026 artoolkitX contributors.
+ *
+ *  Author(s): artoolkitX contributors.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <ARX/AR/ar.h>
+#include <ARX/AR/arImageProc.h>
+#include <ARX/ARVideoSource.h>
+
+static int                       frames = 300;
+static int                       work = 4;
+static std::vector<const char *> vconfs;
+
+
+static void          usage(char *com);
+static void          init(int argc, char *argv[]);
+static bool          bench(const char *vconf);
+static void          track(ARImageProcInfo *ipi, AR2VideoBufferT *frame);
+
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+
+    init(argc, argv);
+    if (vconfs.empty()) vconfs.push_back("-module=Dummy -width=1280 -height=720");
+
+    for (std::vector<const char *>::iterator it = vconfs.begin(); it != vconfs.end(); ++it) {
+        ok &= bench(*it);
+    }
+
+    return (ok ? 0 : -1);
+}
+
+// Stand-in for a tracker update: adaptive thresholding of the luma image, repeated 'work' times.
+static void track(ARImageProcInfo *ipi, AR2VideoBufferT *frame)
+{
+    int i;
+
+    for (i = 0; i < work; i++) {
+        arImageProcLumaHistAndBoxFilterWithBias(ipi, frame->buffLuma, 9, -7);
+    }
+}
+
+static bool bench(const char *vconf)
+{
+    ARVideoSource       *vs;
+    ARImageProcInfo     *ipi;
+    AR2VideoTimestampT   stamp;
+    AR2VideoBufferT     *frame;
+    int                  n, captured;
+    double               tSerial, tPipelined;
+
+    vs = new ARVideoSource;
+    vs->configure(vconf, true, NULL, NULL, 0);
+    if (!vs->open()) {
+        ARPRINT("Unable to open video source with configuration '%s'.\n", vconf);
+        delete vs;
+        return false;
+    }
+    while (!vs->isRunning()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ipi = arImageProcInit(vs->getVideoWidth(), vs->getVideoHeight());
+    if (!ipi) {
+        ARPRINT("Out of memory!!\n");
+        exit(ENOMEM);
+    }
+
+    ARPRINT("Video configuration '%s': %dx%d %s, %d frames, tracking work %d.\n", vconf, vs->getVideoWidth(), vs->getVideoHeight(), arUtilGetPixelFormatName(vs->getPixelFormat()), frames, work);
+
+    // Serial: capture, then track, on one thread.
+    stamp = {0, 0};
+    captured = 0;
+    int copied0 = vs->getCopiedFrameCount();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (n = 0; n < frames; ) {
+        if (!vs->captureFrame()) continue;
+        captured++;
+        if ((frame = vs->checkoutFrameIfNewerThan(stamp))) {
+            stamp = frame->time;
+            track(ipi, frame);
+            vs->checkinFrame(frame);
+            n++;
+        }
+    }
+    tSerial = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    ARPRINT("  serial:    %8.1f frames/s tracked (%d captured, %d copied).\n", frames / tSerial, captured, vs->getCopiedFrameCount() - copied0);
+
+    // Pipelined: capture on its own thread, tracking always takes the latest frame.
+    std::atomic<bool> quit(false);
+    std::atomic<int> capturedPipelined(0);
+    int dropped0 = vs->getDroppedFrameCount();
+    copied0 = vs->getCopiedFrameCount();
+    std::thread captureThread([&]() {
+        while (!quit) {
+            if (vs->captureFrame()) capturedPipelined++;
+            else std::this_thread::yield();
+        }
+    });
+    t0 = std::chrono::steady_clock::now();
+    for (n = 0; n < frames; ) {
+        if (!(frame = vs->checkoutFrameIfNewerThan(stamp))) {
+            std::this_thread::yield();
+            continue;
+        }
+        stamp = frame->time;
+        track(ipi, frame);
+        vs->checkinFrame(frame);
+        n++;
+    }
+    tPipelined = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    quit = true;
+    captureThread.join();
+    ARPRINT("  pipelined: %8.1f frames/s tracked (%d captured, %d copied, %d dropped with all slots in use).\n", frames / tPipelined, (int)capturedPipelined, vs->getCopiedFrameCount() - copied0, vs->getDroppedFrameCount() - dropped0);
+    ARPRINT("  speedup:   %8.2fx\n", (tPipelined > 0.0 ? tSerial / tPipelined : 0.0));
+
+    arImageProcFinal(ipi);
+    vs->close();
+    delete vs;
+    return true;
+}
+
+static void usage( char *com )
+{
+    ARPRINT("Usage: %s [options]\n", com);
+    ARPRINT("Measures tracked frames per second with capture and tracking in sequence on one thread, versus capture on a separate thread.\n");
+    ARPRINT("  -vconf=\"video configuration\": benchmark this video configuration. May be repeated.\n");
+    ARPRINT("      Default is \"-module=Dummy -width=1280 -height=720\".\n");
+    ARPRINT("      E.g. for the Image module: -vconf=\"-module=Image -image=frame.jpg -loop\"\n");
+    ARPRINT("  -frames=n: track n frames in each mode (default 300).\n");
+    ARPRINT("  -work=n: simulate tracking with n adaptive-threshold passes per frame (default 4).\n");
+    ARPRINT("  --version: Print artoolkitX version and exit.\n");
+    ARPRINT("  -loglevel=l: Set the log level to l, where l is one of DEBUG INFO WARN ERROR.\n");
+    ARPRINT("  -h -help --help: show this message\n");
+    exit(0);
+}
+
+static void init(int argc, char *argv[])
+{
+    int                i;
+
+    arLogLevel = AR_LOG_LEVEL_WARN;
+
+    i = 1; // argv[0] is name of app, so start at 1.
+    while (i < argc) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+        } else if (strcmp(argv[i], "--version") == 0 || strcmp(argv[i], "-version") == 0 || strcmp(argv[i], "-v") == 0) {
+            ARPRINT("%s version %s\n", argv[0], AR_HEADER_VERSION_STRING);
+            exit(0);
+        } else if( strncmp(argv[i], "-loglevel=", 10) == 0 ) {
+            if (strcmp(&(argv[i][10]), "DEBUG") == 0) arLogLevel = AR_LOG_LEVEL_DEBUG;
+            else if (strcmp(&(argv[i][10]), "INFO") == 0) arLogLevel = AR_LOG_LEVEL_INFO;
+            else if (strcmp(&(argv[i][10]), "WARN") == 0) arLogLevel = AR_LOG_LEVEL_WARN;
+            else if (strcmp(&(argv[i][10]), "ERROR") == 0) arLogLevel = AR_LOG_LEVEL_ERROR;
+            else usage(argv[0]);
+        } else if( strncmp(argv[i], "-vconf=", 7) == 0 ) {
+            vconfs.push_back(&(argv[i][7]));
+        } else if( strncmp(argv[i], "-frames=", 8) == 0 ) {
+            if( sscanf(&(argv[i][8]), "%d", &frames) != 1 ) usage(argv[0]);
+            if( frames <= 0 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-work=", 6) == 0 ) {
+            if( sscanf(&(argv[i][6]), "%d", &work) != 1 ) usage(argv[0]);
+            if( work < 0 ) usage(argv[0]);
+        } else {
+            ARLOGe("Error: invalid command line argument '%s'.\n", argv[i]);
+            usage(argv[0]);
+        }
+        i++;
+    }
+}
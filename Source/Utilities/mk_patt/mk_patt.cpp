@@ -268,7 +268,7 @@ int main(int argc, char *argv[])
                 }
                 
                 // Done with frame.
-                vs->checkinFrame();
+                vs->checkinFrame(image);
                 
                 // The display has changed.
                 drawView();